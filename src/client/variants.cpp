@@ -27,12 +27,12 @@ const char USAGE[] = R"(aseq Variant analysis commands
 
 Usage:
   aseq variants (-h | --help)
-  aseq variants merge -R <ref> <files>...
-  aseq variants split [-l <N>] <file>
-  aseq variants normalize -R <ref> [--minimal] <file>
-  aseq variants intervals [--flank <F>] <file>
-  aseq variants consensus [--flank <F>] [--noREF | --noALT] -R <ref> <file>
-  aseq variants table [--F <field>...] [--GF <field>...] <file>
+  aseq variants merge [--threads <T>] [-r <bed>] -R <ref> <files>...
+  aseq variants split [--threads <T>] [-r <bed>] [-l <N>] <file>
+  aseq variants normalize [--threads <T>] [-r <bed>] -R <ref> [--minimal] <file>
+  aseq variants intervals [--threads <T>] [-r <bed>] [--flank <F>] <file>
+  aseq variants consensus [--threads <T>] [-r <bed>] [--flank <F>] [--noREF | --noALT] -R <ref> <file>
+  aseq variants table [--threads <T>] [-r <bed>] [--F <field>...] [--GF <field>...] <file>
 
 Options:
   -h --help                  Show this screen.
@@ -44,8 +44,30 @@ Options:
   --GF <field>               Genotype (FORMAT) field
   -l <N>                     Number of variants per split [default: 1]
   --minimal                  Sites-only output
+  --threads <T>              Threads for reading inputs and writing outputs [default: 1]
+  -r <bed>, --regions-file <bed>  Restrict to variants in BED regions (indexed inputs)
 )";
 
+size_t Threads(std::map<std::string, docopt::value>& args) {
+  long threads = args["--threads"].asLong();
+  if (threads < 1) {
+    throw aseq::util::invalid_argument() << aseq::util::error_message(
+        "--threads argument must be > 0");
+  }
+  return threads;
+}
+
+// Restrict source to the regions in the optional BED file (with 0-indexed, half-open coordinates)
+void SetRegions(std::map<std::string, docopt::value>& args,
+                aseq::io::VariantSourceInterface& source) {
+  using namespace aseq::io;
+
+  if (!args["--regions-file"]) return;
+
+  auto reader = ASCIILineReaderInterface::MakeLineReader(args["--regions-file"].asString());
+  source.SetRegions(ReadBEDRegions(*reader));
+}
+
 int MergeMain(std::map<std::string, docopt::value>& args) {
   using namespace aseq::io;
   using namespace aseq::algorithm;
@@ -54,17 +76,20 @@ int MergeMain(std::map<std::string, docopt::value>& args) {
 
   auto files = args["<files>"].asStringList();
   if (files.size() == 1) {
-    auto source = VariantSourceInterface::MakeVariantSource(files[0]);
-    auto sink = VariantSinkInterface::MakeVariantSink(*source, std::cout);
-    while (auto v = source->NextVariant()) {
+    auto source = VariantSourceInterface::MakeVariantSource(files[0], Threads(args));
+    SetRegions(args, *source);
+    auto sink = VariantSinkInterface::MakeVariantSink(*source, std::cout, false, Threads(args));
+    aseq::model::VariantContext v;
+    while (source->NextVariant(v)) {
       // TODO: Add merge info field, and any modifications to sample names
-      sink->PushVariant(*v);
+      sink->PushVariant(std::move(v));  // Threaded sinks format the moved variants in parallel
     }
+    sink->Flush();  // Surface any formatting or write errors (the destructor only logs them)
   } else {
     std::vector<VariantSourceInterface::FactoryResult> sources;
 
     for (const auto& file : files) {
-      sources.push_back(VariantSourceInterface::MakeVariantSource(file));
+      sources.push_back(VariantSourceInterface::MakeVariantSource(file, Threads(args)));
     }
     // TODO: Manipulate samples and other aspects of the header to achieve desired
     // merging properties, e.g. unique sample names
@@ -78,10 +103,13 @@ int MergeMain(std::map<std::string, docopt::value>& args) {
           std::move(higher_priority), std::move(lower_priority)));
     }
     auto& source = sources.front();
-    auto sink = VariantSinkInterface::MakeVariantSink(*source, std::cout);
-    while (auto v = source->NextVariant()) {
-      sink->PushVariant(*v);
+    SetRegions(args, *source);
+    auto sink = VariantSinkInterface::MakeVariantSink(*source, std::cout, false, Threads(args));
+    aseq::model::VariantContext v;
+    while (source->NextVariant(v)) {
+      sink->PushVariant(std::move(v));
     }
+    sink->Flush();
   }
 
   return 0;
@@ -99,14 +127,17 @@ int SplitMain(std::map<std::string, docopt::value>& args) {
 
   std::string pattern = (fs::temp_directory_path() / "%%%%-%%%%-%%%%-%%%%.vcf").native();
 
-  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString());
-  for (auto v = source->NextVariant(); v;) {
+  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString(), Threads(args));
+  SetRegions(args, *source);
+  aseq::model::VariantContext v;
+  for (bool more = source->NextVariant(v); more;) {
     auto path = fs::unique_path(pattern);
     auto sink = VariantSinkInterface::MakeVariantSink(*source, path);
-    for (size_t i = 0; i < n && v; i++) {
-      sink->PushVariant(*v);
-      v = source->NextVariant();
+    for (size_t i = 0; i < n && more; i++) {
+      sink->PushVariant(v);
+      more = source->NextVariant(v);
     }
+    sink->Close();  // Surface any errors writing (or indexing) the file
     std::cout << path.native() << std::endl;
   }
 
@@ -118,11 +149,15 @@ int NormalizeMain(std::map<std::string, docopt::value>& args) {
   using namespace aseq::algorithm;
 
   ReferenceSource ref(args["--ref"].asString());
-  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString());
-  auto sink = VariantSinkInterface::MakeVariantSink(*source, std::cout, args["--minimal"].asBool());
-  while (auto v = source->NextVariant()) {
-    sink->PushVariant(Normalize(ref, std::move(*v)));
+  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString(), Threads(args));
+  SetRegions(args, *source);
+  auto sink = VariantSinkInterface::MakeVariantSink(*source, std::cout, args["--minimal"].asBool(),
+                                                    Threads(args));
+  aseq::model::VariantContext v;
+  while (source->NextVariant(v)) {
+    sink->PushVariant(Normalize(ref, std::move(v)));
   }
+  sink->Flush();
   return 0;
 }
 
@@ -137,10 +172,20 @@ int IntervalsMain(std::map<std::string, docopt::value>& args) {
     return 1;
   }
 
-  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString());
-  while (auto v = source->NextVariant()) {
-    fmt::print(std::cout, "{}:{}-{}\n", v->contig(),
-               std::max(v->pos() - flank, static_cast<Pos>(1)), v->end() + flank);
+  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString(), Threads(args));
+  SetRegions(args, *source);
+
+  // Only the variant extents are needed
+  VariantProjection projection;
+  projection.info.emplace();
+  projection.format.emplace();
+  projection.samples.emplace();
+  source->SetProjection(projection);
+
+  aseq::model::VariantContext v;
+  while (source->NextVariant(v)) {
+    fmt::print(std::cout, "{}:{}-{}\n", v.contig(),
+               std::max(v.pos() - flank, static_cast<Pos>(1)), v.end() + flank);
   }
   return 0;
 }
@@ -157,7 +202,8 @@ int ConsensusMain(std::map<std::string, docopt::value>& args) {
   }
 
   ReferenceSource ref(args["--ref"].asString());
-  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString());
+  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString(), Threads(args));
+  SetRegions(args, *source);
   FastaSink sink(std::cout);
 
   auto v = source->NextVariant();
@@ -187,9 +233,17 @@ int VariantsToTableMain(std::map<std::string, docopt::value>& args) {
   auto& Fs = args["--F"].asStringList();
   auto& GFs = args["--GF"].asStringList();
 
-  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString());
+  auto source = VariantSourceInterface::MakeVariantSource(args["<file>"].asString(), Threads(args));
+  SetRegions(args, *source);
   auto& header = source->header();
 
+  // Only parse the requested fields
+  VariantProjection projection;
+  projection.info.emplace(Fs.begin(), Fs.end());
+  projection.format.emplace(GFs.begin(), GFs.end());
+  if (GFs.empty()) projection.samples.emplace();
+  source->SetProjection(projection);
+
   for (size_t i = 0; i < Fs.size(); i++) {
     fmt::print(std::cout, ((i == 0) ? "{}" : "\t{}"), Fs[i]);
   }
@@ -201,16 +255,23 @@ int VariantsToTableMain(std::map<std::string, docopt::value>& args) {
   }
   std::cout << std::endl;
 
-  while (auto v = source->NextVariant()) {
+  // Decode each FORMAT field as a column, instead of decoding every genotype
+  std::vector<Attributes::key_type> format_keys(GFs.begin(), GFs.end());
+  std::vector<aseq::model::VariantContext::FormatColumn> columns(format_keys.size());
+
+  aseq::model::VariantContext v;
+  while (source->NextVariant(v)) {
     for (size_t i = 0; i < Fs.size(); i++) {
       fmt::print(std::cout, ((i == 0) ? "{}" : "\t{}"),
-                 v->GetAttributeOr<Attributes::mapped_type>(Fs[i], missing));
+                 v.GetAttributeOr<Attributes::mapped_type>(Fs[i], missing));
     }
-    for (size_t i = 0; i < header.NumSamples(); i++) {
-      auto& gt = v->GetGenotype(header.sample(i));
+    for (size_t j = 0; j < format_keys.size(); j++) v.GetFormatColumn(format_keys[j], columns[j]);
+    for (size_t i = 0; i < header.NumSamples() && !GFs.empty(); i++) {
+      size_t g = v.GenotypeIndex(header.sample(i));
       for (size_t j = 0; j < GFs.size(); j++) {
+        auto& value = columns[j][g];
         fmt::print(std::cout, ((j == 0 && Fs.empty()) ? "{}" : "\t{}"),
-                   gt.GetAttributeOr<Attributes::mapped_type>(GFs[j], missing));
+                   value.empty() ? missing : value);
       }
     }
     std::cout << std::endl;
@@ -237,7 +298,7 @@ int VariantsMain(const std::vector<std::string>& argv) {
     } else if (args["table"].asBool()) {
       return VariantsToTableMain(args);
     }
-  } catch (aseq::util::exception_base& e) {
+  } catch (std::exception& e) {  // Includes aseq::util::exception_base
     LOG(ERROR) << e.what();
   }
 
@@ -4,9 +4,12 @@
 
 #pragma once
 
+#include <cstdint>
 #include <iosfwd>
 #include <string>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace boost {
 namespace filesystem {
@@ -17,19 +20,43 @@ class path;
 
 namespace aseq {
 namespace io {
+
+namespace impl {
+class BGZFWriter;
+}
+
 class FastaSink {
  public:
   FastaSink(std::ostream& ostream) : FastaSink(ostream, 80) {}
   FastaSink(const boost::filesystem::path& path) : FastaSink(path, 80) {}
-  FastaSink(std::ostream& ostream, size_t columns) : ostream_(ostream), columns_(columns) {}
-  FastaSink(const boost::filesystem::path& path, size_t columns);
+  FastaSink(std::ostream& ostream, size_t columns);
+  // Files with a .gz extension are BGZF compressed (in parallel with threads > 1). A FASTA index
+  // (.fai, and .gzi for compressed files) is built while writing so that the file can be used as a
+  // ReferenceSource once the sink is closed.
+  FastaSink(const boost::filesystem::path& path, size_t columns, size_t threads = 1);
+  ~FastaSink();
 
   FastaSink& PushSequence(const std::string& name, const std::string& sequence);
 
+  // Write any buffered sequences (and the index)
+  void Close();
+
  private:
+  void WriteBuffer();
+
   std::unique_ptr<std::ostream> owned_ostream_;
-  std::ostream& ostream_;
+  std::ostream* ostream_ = nullptr;
+  std::unique_ptr<impl::BGZFWriter> bgzf_;
   size_t columns_;
+
+  std::string buffer_;
+  uint64_t written_ = 0;  // Uncompressed bytes written before the buffer
+  bool closed_ = false;
+
+  // Index entries, only built for files
+  std::string path_;
+  std::string fai_;
+  std::vector<std::pair<uint64_t, uint64_t> > gzi_;  // Compressed and uncompressed block offsets
 };
 }
 }
@@ -6,6 +6,8 @@
 
 #include <memory>
 #include <iosfwd>
+#include <string>
+#include <vector>
 
 #include <boost/optional.hpp>
 #include <boost/range/iterator_range.hpp>
@@ -26,6 +28,44 @@ namespace io {
 
 typedef boost::iterator_range<const char*> Line;
 
+// Block of lines stored contiguously, each followed by a newline, in a single buffer. A batch is
+// "full" once it reaches either the maximum number of lines or bytes (but always has room for at
+// least one line, regardless of its length).
+class LineBatch {
+ public:
+  explicit LineBatch(size_t max_lines = 1024, size_t max_bytes = 1 << 22)
+      : max_lines_(max_lines), max_bytes_(max_bytes), offsets_(1, 0) {}
+
+  size_t size() const { return offsets_.size() - 1; }
+  size_t bytes() const { return buffer_.size(); }
+  bool empty() const { return size() == 0; }
+  bool full() const { return full(size(), bytes()); }
+  bool full(size_t lines, size_t bytes) const { return lines >= max_lines_ || bytes >= max_bytes_; }
+
+  Line operator[](size_t idx) const {
+    return Line(buffer_.data() + offsets_[idx], buffer_.data() + offsets_[idx + 1] - 1);
+  }
+
+  void clear() {
+    buffer_.clear();
+    offsets_.resize(1);
+  }
+
+  void push_back(const Line& line) {
+    buffer_.append(line.begin(), line.end());
+    buffer_.push_back('\n');
+    offsets_.push_back(buffer_.size());
+  }
+
+  // Append block of one or more complete lines, e.g. "line1\nline2\n"
+  void append(const char* begin, const char* end);
+
+ private:
+  size_t max_lines_, max_bytes_;
+  std::string buffer_;
+  std::vector<size_t> offsets_;
+};
+
 class ASCIILineReaderInterface {
  public:
   typedef std::unique_ptr<ASCIILineReaderInterface> FactoryResult;
@@ -38,12 +78,31 @@ class ASCIILineReaderInterface {
   virtual void SetRegion(model::Contig contig, model::Pos pos, model::Pos end) {
     throw util::indexed_access_not_supported();
   }
+  // Read lines overlapping any of the regions (each line is returned once)
+  virtual void SetRegions(const model::Regions& regions) {
+    throw util::indexed_access_not_supported();
+  }
   virtual NextResult ReadNextLine() = 0;
 
+  // Divide the input remaining after the current position (e.g. after the header) into num_shards
+  // byte ranges of similar size. The shard reader returns the lines that start within its range.
+  virtual bool IsShardable() const { return false; }
+  virtual FactoryResult MakeShard(size_t shard, size_t num_shards) const {
+    throw util::sharding_not_supported();
+  }
+
+  // Read lines into batch until it is full, returning the number of lines read (0 at the end)
+  virtual size_t ReadNextLines(LineBatch& batch);
+
   static FactoryResult MakeLineReader(std::istream& istream);
-  static FactoryResult MakeLineReader(const boost::filesystem::path& file);
+  // For BGZF compressed files, threads > 1 decompresses blocks in parallel ahead of the reader
+  static FactoryResult MakeLineReader(const boost::filesystem::path& file, size_t threads = 1);
 };
 
+// Read the regions in a BED file (with 0-indexed, half-open coordinates) as 1-indexed, closed
+// regions, skipping comment, "track" and "browser" lines
+model::Regions ReadBEDRegions(ASCIILineReaderInterface& reader);
+
 class ASCIILineWriterInterface {
  public:
   typedef std::unique_ptr<ASCIILineWriterInterface> FactoryResult;
@@ -57,9 +116,25 @@ class ASCIILineWriterInterface {
     Write(boost::make_iterator_range(line.data(), line.data() + line.size()));
   }
 
+  // Buffered writers expose their buffer (nullptr otherwise) so that lines can be formatted
+  // directly into it instead of into a temporary string. Commit after appending complete lines.
+  virtual std::string* buffer() { return nullptr; }
+  virtual void Commit() {}
+  // Write any buffered lines to the underlying stream or file
+  virtual void Flush() {}
+  // Flush and finish the output, e.g. write the BGZF EOF marker and the tabix index, reporting any
+  // errors. Lines can't be written afterwards. Writers are closed when destroyed, but then any
+  // errors are only logged.
+  virtual void Close() { Flush(); }
+
   static FactoryResult MakeLineWriter(std::ostream& ostream);
+  // Lines are collected into large blocks written through the stream's buffer, the stream is only
+  // complete after the writer is flushed or destroyed
+  static FactoryResult MakeBufferedLineWriter(std::ostream& ostream);
+  // For BGZF compressed files, threads > 1 compresses blocks in parallel. A tabix index is built
+  // while writing files with an indexable format.
   static FactoryResult MakeLineWriter(const boost::filesystem::path& file,
-                                      FileFormat format = FileFormat::UNKNOWN);
+                                      FileFormat format = FileFormat::UNKNOWN, size_t threads = 1);
 };
 
 }  // namespace io
@@ -30,6 +30,15 @@ class VariantHeaderInterface {
   virtual void SetSitesOnly() = 0;
 };
 
+// Subset of the INFO fields, FORMAT fields and samples needed by the caller, so that sources can
+// skip parsing the remainder. An empty optional indicates all of the fields (or samples).
+struct VariantProjection {
+  typedef util::Attributes::key_type Key;
+
+  boost::optional<std::vector<Key>> info, format;
+  boost::optional<std::vector<model::Sample>> samples;
+};
+
 class VariantSourceInterface {
  public:
   typedef std::unique_ptr<VariantSourceInterface> FactoryResult;
@@ -45,10 +54,28 @@ class VariantSourceInterface {
   virtual void SetRegion(model::Contig contig, model::Pos pos, model::Pos end) {
     throw util::indexed_access_not_supported();
   }
+  // Iterate variants overlapping any of the regions (each variant is returned once)
+  virtual void SetRegions(const model::Regions& regions) {
+    throw util::indexed_access_not_supported();
+  }
   virtual NextResult NextVariant() = 0;
+  // Refill variant with the next variant (returning false at the end), reusing its storage, e.g.
+  // vector capacities, when supported by the source
+  virtual bool NextVariant(model::VariantContext& variant);
+
+  // Sources may omit unrequested fields. Genotypes are only returned for the requested samples.
+  virtual void SetProjection(const VariantProjection& projection) {}
+
+  // Divide the variants into num_shards disjoint sources (by byte range of the input) that can be
+  // processed in parallel. Must be invoked before reading any variants.
+  virtual bool IsShardable() const { return false; }
+  virtual FactoryResult MakeShard(size_t shard, size_t num_shards) const {
+    throw util::sharding_not_supported();
+  }
 
   static FactoryResult MakeVariantSource(std::istream& istream);
-  static FactoryResult MakeVariantSource(const boost::filesystem::path& path);
+  // With threads > 1, bgzip-ed inputs are decompressed and variants parsed in parallel
+  static FactoryResult MakeVariantSource(const boost::filesystem::path& path, size_t threads = 1);
 };
 
 class VariantSinkInterface {
@@ -59,14 +86,28 @@ class VariantSinkInterface {
   virtual ~VariantSinkInterface() {}
 
   virtual void PushVariant(const model::VariantContext&) = 0;
-
-  static FactoryResult MakeVariantSink(FileFormat format, std::ostream& ostream);
-  static FactoryResult MakeVariantSink(FileFormat format, const boost::filesystem::path& path);
+  // Sinks that retain variants, e.g. to write them asynchronously, can take ownership of the
+  // context instead of copying it
+  virtual void PushVariant(model::VariantContext&& context) {
+    PushVariant(static_cast<const model::VariantContext&>(context));
+  }
+  // Wait until all of the pushed variants have been written
+  virtual void Flush() {}
+  // Write all of the pushed variants and finish the output (e.g. write the index), reporting any
+  // errors. Variants can't be pushed afterwards.
+  virtual void Close() { Flush(); }
+
+  // Stream outputs are buffered, the stream is only complete once the sink is flushed or destroyed.
+  // With threads > 1, variants are formatted and bgzip-ed outputs compressed in parallel.
+  static FactoryResult MakeVariantSink(FileFormat format, std::ostream& ostream,
+                                       size_t threads = 1);
+  static FactoryResult MakeVariantSink(FileFormat format, const boost::filesystem::path& path,
+                                       size_t threads = 1);
   static FactoryResult MakeVariantSink(const VariantSourceInterface& source, std::ostream& ostream,
-                                       bool sites_only = false);
+                                       bool sites_only = false, size_t threads = 1);
   static FactoryResult MakeVariantSink(const VariantSourceInterface& source,
                                        const boost::filesystem::path& path,
-                                       bool sites_only = false);
+                                       bool sites_only = false, size_t threads = 1);
 };
 }
 }
@@ -4,12 +4,11 @@
 
 #pragma once
 
+#include <deque>
 #include <type_traits>
 #include <unordered_map>
 #include <iosfwd>
 
-#include <boost/range/adaptor/map.hpp>
-
 #include "aseq/io/line.hpp"
 #include "aseq/io/variant.hpp"
 #include "aseq/model/genotype.hpp"
@@ -67,8 +66,33 @@ class VCFHeader : public VariantHeaderInterface {
 #undef FORMAT_FIELD
   };
 
-  typedef std::unordered_map<util::Attributes::key_type, Field> Fields;
+  // Fields in the order they were added (i.e. the order of the header lines), with lookup by ID
+  class Fields {
+   public:
+    typedef Field::ID key_type;
+    typedef std::deque<Field>::const_iterator const_iterator;
+    typedef const_iterator iterator;  // Fields are only modified via emplace or operator[]
+
+    std::pair<Field&, bool> emplace(const key_type& key, const Field& field);
+    Field& operator[](const key_type& key);
+    const Field& at(const key_type& key) const;
+    const_iterator find(const key_type& key) const;
+
+    const_iterator begin() const { return fields_.begin(); }
+    const_iterator end() const { return fields_.end(); }
+    size_t size() const { return fields_.size(); }
+    bool empty() const { return fields_.empty(); }
+    void clear() {
+      fields_.clear();
+      index_.clear();
+    }
+
+   private:
+    std::deque<Field> fields_;  // Deque so references remain valid as fields are added
+    std::unordered_map<key_type, size_t> index_;
+  };
   typedef std::vector<model::Sample> Samples;
+  typedef model::ContigDictionary Contigs;
 
  public:
   VCFHeader() : file_format_(FileFormat::UNKNOWN) {}
@@ -85,9 +109,7 @@ class VCFHeader : public VariantHeaderInterface {
 
 #define FIELD(prefix)                                                                             \
   Fields& prefix() { return prefix##_; }                                                          \
-  boost::select_second_const_range<Fields> prefix##Values() const {                               \
-    return boost::adaptors::values(prefix##_);                                                    \
-  }                                                                                               \
+  const Fields& prefix##Values() const { return prefix##_; }                                      \
   std::pair<const Field&, bool> Add##prefix##Field(const Field& field) {                          \
     return AddField(prefix##_, field);                                                            \
   };                                                                                              \
@@ -100,6 +122,12 @@ class VCFHeader : public VariantHeaderInterface {
 
 #undef FIELD
 
+  // contig methods, contigs are in the order of the ##contig lines
+  const Contigs& contigs() const { return contigs_; }
+  model::ContigID AddContig(const model::Contig& contig, model::Pos length = 0) {
+    return contigs_.Add(contig, length);
+  }
+
   // sample methods
   const Samples& samples() const { return samples_; }
   const model::Sample& sample(size_t idx) const override { return samples_.at(idx); }
@@ -116,6 +144,7 @@ class VCFHeader : public VariantHeaderInterface {
  private:
   FileFormat file_format_;
   Fields FILTER_, INFO_, FORMAT_;
+  Contigs contigs_;
   Samples samples_;
 
   friend class VCFSource;
@@ -129,7 +158,10 @@ namespace impl {
 template <typename Line>
 class VCFVariantParser;
 
-class VCFVariantGeneratorInterface {};
+class VCFVariantGeneratorInterface {
+ public:
+  virtual ~VCFVariantGeneratorInterface() = default;
+};
 }  // namespace impl
 
 class VCFSource : public VariantSourceInterface {
@@ -137,7 +169,8 @@ class VCFSource : public VariantSourceInterface {
   typedef ASCIILineReaderInterface::FactoryResult Reader;
 
   VCFSource() = delete;
-  VCFSource(FileFormat format, Reader&& reader);
+  // With threads > 1, variants are parsed on a pool of worker threads (in file order)
+  VCFSource(FileFormat format, Reader&& reader, size_t threads = 1);
   virtual ~VCFSource() = default;
 
   virtual FileFormat file_format() const override;
@@ -145,12 +178,32 @@ class VCFSource : public VariantSourceInterface {
 
   virtual bool IsIndexed() const override { return reader_->IsIndexed(); }
   virtual void SetRegion(model::Contig contig, model::Pos pos, model::Pos end) override;
+  virtual void SetRegions(const model::Regions& regions) override;
+  // The sample columns are only checked for count when the variant is read. Their values are
+  // validated when the genotypes are first decoded (see VariantContext::genotypes), so unmodified
+  // variants written verbatim by a VCFSink aren't validated at all.
   virtual NextResult NextVariant() override;
+  virtual bool NextVariant(model::VariantContext& variant) override;
+
+  // END and GT are always parsed since they determine the variant extent and genotype alleles
+  virtual void SetProjection(const VariantProjection& projection) override;
+
+  virtual bool IsShardable() const override { return reader_->IsShardable(); }
+  virtual FactoryResult MakeShard(size_t shard, size_t num_shards) const override;
 
  private:
+  // Create source for a shard of an existing VCF file with an already parsed header
+  VCFSource(const VCFHeader& header, Reader&& reader);
+
   VCFHeader header_;
   Reader reader_;
 
+  // Lines are read in batches to amortize the per-line overhead of the reader
+  LineBatch batch_;
+  size_t batch_line_ = 0;
+
+  VariantProjection projection_;
+
   typedef impl::VCFVariantParser<Line> Parser;
   struct ParserDeleter {
     void operator()(Parser*);
@@ -158,6 +211,14 @@ class VCFSource : public VariantSourceInterface {
 
   // Specify the deleter to enable the incomplete type
   std::unique_ptr<Parser, ParserDeleter> parser_;
+
+  // Parallel parsing pipeline, created on first use (and destroyed before the reader)
+  size_t threads_ = 1;
+  class Pipeline;
+  struct PipelineDeleter {
+    void operator()(Pipeline*);
+  };
+  std::unique_ptr<Pipeline, PipelineDeleter> pipeline_;
 };
 
 class VCFSink : public VariantSinkInterface {
@@ -166,10 +227,20 @@ class VCFSink : public VariantSinkInterface {
 
  public:
   VCFSink() = delete;
-  VCFSink(const VCFHeader& header, Writer&& writer);
-  virtual ~VCFSink() = default;
+  // With threads > 1, variants are formatted on a pool of worker threads and written (in the order
+  // they were pushed) on a dedicated thread. PushVariant only blocks when the queue of pending
+  // batches is full. Variants pushed by const reference are formatted on the caller's thread, so
+  // move variants into the sink to format them in parallel.
+  VCFSink(const VCFHeader& header, Writer&& writer, size_t threads = 1);
+  virtual ~VCFSink();  // Waits for all of the pushed variants to be written
 
   virtual void PushVariant(const model::VariantContext& context) override;
+  virtual void PushVariant(model::VariantContext&& context) override;
+  // Flushes the writer and rethrows any error that occurred while asynchronously formatting or
+  // writing variants
+  virtual void Flush() override;
+  // Flushes and closes the writer, rethrowing any error
+  virtual void Close() override;
 
  private:
   VCFHeader header_;
@@ -177,6 +248,13 @@ class VCFSink : public VariantSinkInterface {
 
   // Specify the deleter to enable the incomplete type
   std::unique_ptr<impl::VCFVariantGeneratorInterface> generator_;
+
+  // Asynchronous formatting pipeline (destroyed before the writer)
+  class Pipeline;
+  struct PipelineDeleter {
+    void operator()(Pipeline*);
+  };
+  std::unique_ptr<Pipeline, PipelineDeleter> pipeline_;
 };
 }
 }
\ No newline at end of file
@@ -4,6 +4,13 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+#include <iterator>
+#include <string>
+
 #include <boost/range/iterator_range.hpp>
 
 #include "aseq/util/flyweight.hpp"
@@ -13,31 +20,118 @@ namespace model {
 
 struct allele_tag {};
 
-class Allele : public util::flyweight_string_no_track<allele_tag> {
-  typedef util::flyweight_string_no_track<allele_tag> BaseType;
+// Short alleles (the vast majority, e.g. SNVs) are stored inline without any lookup in the global
+// string interner, while longer and symbolic alleles are interned. Each allele has exactly one
+// representation, so equality and hashing compare the fixed-size storage (the bases or the
+// pointer to the interned string) instead of the allele string.
+class Allele {
+  typedef util::impl::StringInterner<allele_tag> interner;
 
  public:
-  typedef typename BaseType::initializer initializer;
+  /* String Interface */
+  typedef char value_type;
+  typedef const char& const_reference;
+  typedef const char* const_iterator;
+  typedef std::reverse_iterator<const_iterator> reverse_const_iterator;
+
+  static constexpr size_t kMaxInlineSize = 15;
 
   static const Allele A, G, C, T, N;
   static const Allele MISSING;
   static const Allele NON_REF;
 
-  using BaseType::BaseType;
+  Allele() : Allele(".") {}  // MISSING
+  Allele(const std::string& s) : Allele(s.begin(), s.end()) {}
+  Allele(const char* s) : Allele(s, s + strlen(s)) {}
+  template <typename I>
+  Allele(const boost::iterator_range<I>& r) : Allele(r.begin(), r.end()) {}
+  template <typename I>
+  Allele(I begin, I end) {
+    memset(data_, 0, sizeof(data_));
+    auto size = static_cast<size_t>(std::distance(begin, end));
+    if (size <= kMaxInlineSize && (size == 0 || *begin != '<')) {
+      std::copy(begin, end, data_);
+      data_[kTagByte] = static_cast<char>(kMaxInlineSize - size);  // 0 (i.e. NUL) if full
+    } else {
+      const std::string* interned = &interner::Intern(begin, end)->first;
+      memcpy(data_, &interned, sizeof(interned));
+      data_[kTagByte] = kInternedTag;
+    }
+  }
 
-  Allele() : BaseType(MISSING) {}
   Allele(const Allele& allele) = default;
   Allele(Allele&& allele) = default;
 
   Allele& operator=(const Allele& allele) = default;
   Allele& operator=(Allele&& allele) = default;
 
+  const char* data() const { return IsInline() ? data_ : interned()->data(); }
+  const char* c_str() const { return data(); }
+  size_t size() const {
+    return IsInline() ? kMaxInlineSize - data_[kTagByte] : interned()->size();
+  }
+  bool empty() const { return size() == 0; }
+
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size(); }
+  reverse_const_iterator rbegin() const { return reverse_const_iterator(end()); }
+  reverse_const_iterator rend() const { return reverse_const_iterator(begin()); }
+
+  const_reference front() const { return *begin(); }
+  const_reference back() const { return *(end() - 1); }
+
+  std::string str() const { return std::string(begin(), end()); }
+  operator std::string() const { return str(); }
+
+  bool IsInline() const { return data_[kTagByte] != kInternedTag; }
   bool IsSymbolic() const;
   Allele SubAllele(size_t pos = 0, size_t len = std::string::npos) const;
+
+  bool operator==(const Allele& other) const {
+    return Word(0) == other.Word(0) && Word(1) == other.Word(1);
+  }
+  bool operator!=(const Allele& other) const { return !(*this == other); }
+  bool operator<(const Allele& other) const {
+    return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+  }
+
+  size_t hash() const { return Word(0) * 0x9E3779B97F4A7C15ULL ^ Word(1); }
+
+ private:
+  static constexpr size_t kTagByte = kMaxInlineSize;
+  static constexpr char kInternedTag = static_cast<char>(0xFF);
+
+  const std::string* interned() const {
+    const std::string* interned;
+    memcpy(&interned, data_, sizeof(interned));
+    return interned;
+  }
+
+  uint64_t Word(size_t i) const {
+    uint64_t word;
+    memcpy(&word, data_ + i * sizeof(word), sizeof(word));
+    return word;
+  }
+
+  // Inline bases (zero padded) with kMaxInlineSize - size in the final byte, or the pointer to the
+  // interned string with kInternedTag in the final byte
+  alignas(8) char data_[kMaxInlineSize + 1];
 };
 
-inline Allele operator+(const std::string& lhs, Allele rhs) { return Allele(lhs + rhs.get()); }
-inline Allele operator+(Allele lhs, const std::string& rhs) { return Allele(lhs.get() + rhs); }
+inline Allele operator+(const std::string& lhs, Allele rhs) { return Allele(lhs + rhs.str()); }
+inline Allele operator+(Allele lhs, const std::string& rhs) { return Allele(lhs.str() + rhs); }
+
+std::ostream& operator<<(std::ostream& os, const Allele& allele);
+
+inline std::size_t hash_value(const Allele& allele) { return allele.hash(); }
 
 }  // namespace model
-}  // namespace aseq
\ No newline at end of file
+}  // namespace aseq
+
+namespace std {
+
+template <>
+struct hash<aseq::model::Allele> {
+  std::size_t operator()(const aseq::model::Allele& allele) const { return allele.hash(); }
+};
+}
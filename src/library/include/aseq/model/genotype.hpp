@@ -11,8 +11,6 @@
 namespace aseq {
 namespace model {
 
-class VariantContext;
-
 typedef int AlleleIndex;
 
 struct sample_tag {};
@@ -48,18 +46,15 @@ class Genotype : public util::HasAttributes {
   // Commonly observed genotypes (*P are phased)
   static const Alleles kNone, kNoCallNoCall, kRefRef, kRefAlt, kAltAlt, kRefAltP, kAltRefP;
 
+  // Genotypes don't refer to their VariantContext, so that they (and the context) can be moved
+  // cheaply, e.g. along with the storage of the context's genotypes
   Genotype() = delete;
-  Genotype(const VariantContext& variant, const Sample& sample)
-      : Genotype(variant, sample, kNone, {}) {}
-  Genotype(const VariantContext& variant, const Sample& sample, util::Attributes&& attr)
-      : Genotype(variant, sample, kNone, std::move(attr)) {}
-  Genotype(const VariantContext& variant, const Sample& sample, const Alleles& alleles)
-      : Genotype(variant, sample, kNone, {}) {}
-  Genotype(const VariantContext& variant, const Sample& sample, const Alleles& alleles,
-           util::Attributes&& attr);
-  Genotype(const VariantContext&, Genotype&&);
-
-  const VariantContext& variant_context() const { return *variant_; }
+  explicit Genotype(const Sample& sample) : Genotype(sample, kNone, {}) {}
+  Genotype(const Sample& sample, util::Attributes&& attr)
+      : Genotype(sample, kNone, std::move(attr)) {}
+  Genotype(const Sample& sample, const Alleles& alleles) : Genotype(sample, alleles, {}) {}
+  Genotype(const Sample& sample, const Alleles& alleles, util::Attributes&& attr);
+
   const Sample& sample() const { return sample_; }
   const Alleles& alleles() const { return alleles_; }
 
@@ -70,10 +65,6 @@ class Genotype : public util::HasAttributes {
   bool Diploid() const { return Ploidy() == 2; }
 
   friend void swap(Genotype& a, Genotype& b) {
-    if (a.variant_ != b.variant_) {
-      throw util::invalid_argument();
-    }
-
     using std::swap;
     swap(static_cast<util::HasAttributes&>(a), static_cast<util::HasAttributes&>(b));
     swap(a.sample_, b.sample_);
@@ -83,7 +74,6 @@ class Genotype : public util::HasAttributes {
  private:
   const impl::PhasedIndices& indices() const { return alleles_.get(); }
 
-  const VariantContext* variant_;
   Sample sample_;
   Alleles alleles_;
 };
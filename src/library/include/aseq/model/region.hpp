@@ -4,6 +4,10 @@
 
 #pragma once
 
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
 #include "aseq/util/flyweight.hpp"
 
 namespace aseq {
@@ -14,18 +18,77 @@ typedef util::flyweight_string_no_track<contig_tag> Contig;
 
 typedef int64_t Pos;
 
+// Dense index of a contig in a ContigDictionary, i.e. its position in genome order
+typedef int32_t ContigID;
+constexpr ContigID kUnknownContigID = -1;
+
+// Contigs in genome order, e.g. from the ##contig lines of a VCF header, with their lengths (0 if
+// unknown)
+class ContigDictionary {
+ public:
+  struct Entry {
+    Contig contig;
+    Pos length;
+  };
+  typedef std::vector<Entry>::const_iterator const_iterator;
+
+  // Add contig (if not already present) at the end of the dictionary, returning its ID
+  ContigID Add(const Contig &contig, Pos length = 0) {
+    auto r = ids_.emplace(contig, static_cast<ContigID>(entries_.size()));
+    if (r.second)
+      entries_.push_back(Entry{contig, length});
+    else if (length != 0)
+      entries_[r.first->second].length = length;
+    return r.first->second;
+  }
+
+  ContigID Find(const Contig &contig) const {
+    auto i = ids_.find(contig);
+    return (i != ids_.end()) ? i->second : kUnknownContigID;
+  }
+
+  const Entry &operator[](ContigID id) const { return entries_[id]; }
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+  const_iterator begin() const { return entries_.begin(); }
+  const_iterator end() const { return entries_.end(); }
+
+ private:
+  std::vector<Entry> entries_;
+  std::unordered_map<Contig, ContigID> ids_;
+};
+
 class HasRegion {
  public:
-  HasRegion(const Contig &contig, Pos pos, Pos end) : contig_(contig), pos_(pos), end_(end) {}
+  HasRegion(const Contig &contig, Pos pos, Pos end, ContigID contig_id = kUnknownContigID)
+      : contig_(contig), contig_id_(contig_id), pos_(pos), end_(end) {}
 
   const Contig &contig() const { return contig_; }
+  // Position of the contig in the dictionary of the region's source (if known)
+  ContigID contig_id() const { return contig_id_; }
+  void set_contig_id(ContigID contig_id) { contig_id_ = contig_id; }
   Pos pos() const { return pos_; }
   Pos end() const { return end_; }
   size_t size() const { return end_ - pos_ + 1; }
 
+  // Contig ID and position packed into a single key for genome-order comparisons (only meaningful
+  // if the contig ID is known)
+  uint64_t ContigPosKey() const {
+    return (static_cast<uint64_t>(contig_id_) << 40) | static_cast<uint64_t>(pos_);
+  }
+
  protected:
   Contig contig_;
+  ContigID contig_id_;
   Pos pos_, end_;
 };
+
+// Genomic interval, e.g. query target, with 1-indexed inclusive coordinates
+class Region : public HasRegion {
+ public:
+  using HasRegion::HasRegion;
+};
+
+typedef std::vector<Region> Regions;
 }
 }
\ No newline at end of file
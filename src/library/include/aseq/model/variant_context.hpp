@@ -4,7 +4,11 @@
 
 #pragma once
 
+#include <atomic>
 #include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/optional.hpp>
@@ -12,6 +16,7 @@
 #include "aseq/model/allele.hpp"
 #include "aseq/model/genotype.hpp"
 #include "aseq/model/region.hpp"
+#include "aseq/util/arena.hpp"
 #include "aseq/util/attributes.hpp"
 #include "aseq/util/exception.hpp"
 
@@ -20,22 +25,53 @@ namespace model {
 
 class CompareVariants;
 
-class VariantContext : public util::HasAttributes, public HasRegion {
+// Position of each sample in the genotypes, shared by the variants with the same samples
+typedef std::unordered_map<Sample, size_t> SampleIndex;
+
+namespace impl {
+
+// Decoder for genotypes retained in their serialized form, e.g. the sample columns of a VCF line
+class GenotypeDecoder {
+ public:
+  virtual ~GenotypeDecoder() {}
+
+  virtual size_t NumGenotypes() const = 0;
+  // Append the decoded genotypes to genotypes
+  virtual void Decode(std::vector<Genotype, util::ArenaAllocator<Genotype> > &genotypes) const = 0;
+
+  // Decode the values of a single FORMAT field for all of the samples (in genotype order)
+  virtual void DecodeColumn(const util::Attributes::key_type &key,
+                            std::vector<util::Attributes::mapped_type> &column) const = 0;
+
+  // Position of each sample in the decoded genotypes (if known)
+  virtual std::shared_ptr<const SampleIndex> sample_index() const { return nullptr; }
+};
+}  // namespace impl
+
+// The attributes are inherited privately so that all mutations go through the tracked accessors
+class VariantContext : private util::HasAttributes, public HasRegion {
  public:
   static_assert(std::is_signed<AlleleIndex>::value, "AlleleIndex must be signed type");
   static constexpr AlleleIndex kNoCallIdx = -1, kNonRefIdx = -2, kRefIdx = 0, kFirstAltIdx = 1;
   static constexpr size_t kMaxAlleles = std::numeric_limits<AlleleIndex>::max();
 
-  typedef std::vector<Allele> Alleles;
-  typedef std::vector<std::string> IDs;
+  // Containers allocate from the heap, or from the arena set with SetArena
+  typedef std::vector<Allele, util::ArenaAllocator<Allele> > Alleles;
+  typedef std::vector<std::string, util::ArenaAllocator<std::string> > IDs;
   typedef boost::optional<float> Qual;
   typedef util::Attributes::key_type Filter;
-  typedef std::vector<Filter> Filters;
-  typedef std::vector<Genotype> Genotypes;
+  typedef std::vector<Filter, util::ArenaAllocator<Filter> > Filters;
+  typedef std::vector<Genotype, util::ArenaAllocator<Genotype> > Genotypes;
+  typedef std::vector<util::Attributes::mapped_type> FormatColumn;
+  // Serialized form of the variant (e.g. a VCF line without the newline) and the samples in the
+  // order of its sample columns
+  typedef std::vector<char, util::ArenaAllocator<char> > Record;
+  typedef std::shared_ptr<const std::vector<Sample> > RecordSamples;
 
   enum class Flags : unsigned int { kNone = 0, kSymbolic = 0x1 };
 
  public:
+  VariantContext();  // Empty context, e.g. to be filled by VariantSourceInterface::NextVariant
   VariantContext(const Contig &contig, Pos pos, const Allele &ref);
   VariantContext(const Contig &contig, Pos pos, const Allele &ref, const Allele &alt);
   VariantContext(const Contig &contig, Pos pos, const Allele &ref,
@@ -45,15 +81,23 @@ class VariantContext : public util::HasAttributes, public HasRegion {
   template <typename Iterator>
   VariantContext(const Contig &contig, Pos pos, Pos end, const Allele &ref, Iterator alt_begin,
                  Iterator alt_end);
+  VariantContext(const Contig &contig, Pos pos, Pos end, const Allele &ref, Alleles &&alts);
 
-  VariantContext(VariantContext &&);
-  VariantContext &operator=(VariantContext &&);
+  // Moves transfer the containers (including the genotypes) without copying their contents
+  VariantContext(VariantContext &&) noexcept;
+  VariantContext &operator=(VariantContext &&) noexcept;
 
   VariantContext(VariantContext &&, const Allele &ref);
   template <typename Iterator>
   VariantContext(VariantContext &&, const Contig &contig, Pos pos, const Allele &ref,
                  Iterator alt_begin, Iterator alt_end);
 
+  // Reinitialize the context with a new site for reuse, clearing the other fields (including the
+  // genotypes and any genotype decoder) but retaining the capacity of the containers
+  template <typename Iterator>
+  void Reset(const Contig &contig, Pos pos, Pos end, const Allele &ref, Iterator alt_begin,
+             Iterator alt_end);
+
   // Flags
   bool flags(Flags flags) const { return flags_ & std::underlying_type<Flags>::type(flags); }
   VariantContext &SetFlag(Flags flags);
@@ -69,44 +113,162 @@ class VariantContext : public util::HasAttributes, public HasRegion {
   bool IsMultiAllelic() const { return alts_.size() > 1; }
 
   const IDs &ids() const { return ids_; }
+  IDs &ids() {
+    MarkDirty();
+    return ids_;
+  }
 
   const Qual &qual() const { return qual_; }
   bool HasQual() const { return static_cast<bool>(qual_); }
-  void SetQual(Qual::argument_type qual) { qual_ = qual; }
-  void SetQual(const Qual &qual) { qual_ = qual; }
+  void SetQual(Qual::argument_type qual) {
+    MarkDirty();
+    qual_ = qual;
+  }
+  void SetQual(const Qual &qual) {
+    MarkDirty();
+    qual_ = qual;
+  }
 
   const Filters &filters() const { return filters_; }
+  Filters &filters() {
+    MarkDirty();
+    return filters_;
+  }
   bool HasFilter() const { return !filters_.empty(); }
   bool IsPASSing() const;
 
-  const Genotypes &genotypes() const { return genotypes_; }
-  Genotypes &&genotypes() { return std::move(genotypes_); }
+  // Genotypes may be decoded lazily, on the first access to genotypes or a specific genotype. The
+  // serialized genotypes aren't validated until then, so the const genotype accessors (including
+  // GetFormatColumn) can throw parse errors, e.g. util::file_parse_error for a malformed sample
+  // column. Lazy decoding is synchronized, so const access from multiple threads is safe.
+  const Genotypes &genotypes() const {
+    DecodeGenotypes();
+    return genotypes_;
+  }
+  Genotypes &&genotypes() {
+    MarkDirty();
+    DecodeGenotypes();
+    sample_index_.reset();
+    return std::move(genotypes_);
+  }
 
-  size_t NumGenotypes() const { return genotypes_.size(); }
+  size_t NumGenotypes() const {
+    return (decoder_ && !decoded_) ? decoder_->NumGenotypes() : genotypes_.size();
+  }
   const Genotype &GetGenotype(const Sample &sample) const;
   Genotype GetGenotypeOrNoCall(const Sample &sample) const;
+  // Genotype for sample or nullptr if there isn't one, i.e. without copying a no-call genotype
+  const Genotype *FindGenotype(const Sample &sample) const;
+  // Position of the sample in genotypes() and FORMAT columns, constant time for genotypes produced
+  // by a decoder with a sample index
+  size_t GenotypeIndex(const Sample &sample) const;
+
+  // Values of FORMAT field key for all genotypes (in genotype order, empty if missing). Undecoded
+  // genotypes aren't decoded, instead the column is decoded directly from the serialized form.
+  void GetFormatColumn(const util::Attributes::key_type &key, FormatColumn &column) const;
 
   template <typename... Args>
   Genotype &AddGenotype(Args &&... args) {
-    genotypes_.emplace_back(*this, std::forward<Args>(args)...);
+    MarkDirty();
+    DecodeGenotypes();
+    sample_index_.reset();
+    genotypes_.emplace_back(std::forward<Args>(args)...);
     return genotypes_.back();
   }
   void MergeGenotypes(Genotypes &&);
 
+  // Replace any genotypes with those produced by decoder on first access
+  void SetGenotypeDecoder(std::unique_ptr<impl::GenotypeDecoder> &&decoder);
+  // The decoder is retained after decoding so that it can be released and reused, e.g. by a source
+  // refilling this context with the next variant. Any genotypes not yet decoded are discarded.
+  std::unique_ptr<impl::GenotypeDecoder> ReleaseGenotypeDecoder();
+
+  // Allocate the context's containers, including genotypes added or decoded later, from arena. The
+  // arena is released when the last of those containers is destroyed.
+  void SetArena(const std::shared_ptr<util::Arena> &arena);
+
+  // INFO attributes, as with HasAttributes, but mutable access marks the context as modified
+  using util::HasAttributes::attributes;
+  using util::HasAttributes::HasAttribute;
+  using util::HasAttributes::GetAttribute;
+  using util::HasAttributes::GetAttributeOr;
+  util::Attributes &attributes() {
+    MarkDirty();
+    return attrs_;
+  }
+  template <typename T, typename = util::AttributeValue::EnableIfStored<T> >
+  T &GetAttribute(const util::Attributes::key_type &key) {
+    MarkDirty();
+    return util::HasAttributes::GetAttribute<T>(key);
+  }
+  template <typename T>
+  T &GetOrAddAttribute(const util::Attributes::key_type &key, const T &val) {
+    MarkDirty();
+    return util::HasAttributes::GetOrAddAttribute(key, val);
+  }
+  template <typename T>
+  util::AttributeValue::Result<T> SetAttribute(const util::Attributes::key_type &key, T &&v) {
+    MarkDirty();
+    return util::HasAttributes::SetAttribute(key, std::forward<T>(v));
+  }
+  void EraseAttribute(const util::Attributes::key_type &key) {
+    MarkDirty();
+    util::HasAttributes::EraseAttribute(key);
+  }
+
+  // Sources can retain the record the context was parsed from, so that sinks can write unmodified
+  // variants without reformatting them. The mutable accessors above mark the context as modified
+  // (i.e. "dirty").
+  void SetSourceRecord(const char *begin, const char *end, const RecordSamples &samples) {
+    record_.assign(begin, end);
+    record_samples_ = samples;
+    dirty_ = false;
+  }
+  const Record &source_record() const { return record_; }
+  const RecordSamples &source_samples() const { return record_samples_; }
+
+  bool IsDirty() const { return dirty_; }
+  void MarkDirty() { dirty_ = true; }
+  // True if the source record is present and still describes the context
+  bool HasCleanRecord() const { return !dirty_ && record_samples_; }
+
   friend std::ostream &operator<<(std::ostream &, const VariantContext &);
 
- public:
-  // VCF-style Context Fields, including INFO attributes
+ private:
+  // VCF-style Context Fields, the INFO attributes are in attrs_
   IDs ids_;
   Qual qual_;
   Filters filters_;
 
- private:
-  std::underlying_type<Flags>::type flags_;
+  std::underlying_type<Flags>::type flags_ = 0;
 
   Allele ref_;
   Alleles alts_;
-  Genotypes genotypes_;
+
+  void DecodeGenotypes() const {
+    if (!decoder_ || decoded_) return;
+    std::lock_guard<std::mutex> lock(decode_mutex_);
+    if (decoded_) return;  // Decoded by another thread
+    try {
+      decoder_->Decode(genotypes_);  // Decode directly, to reuse the genotypes' capacity
+    } catch (...) {
+      genotypes_.clear();  // Discard any partially decoded genotypes
+      throw;
+    }
+    decoded_ = true;
+  }
+
+  bool FindGenotypeIndex(const Sample &sample, size_t &index) const;
+
+  mutable Genotypes genotypes_;
+  std::unique_ptr<impl::GenotypeDecoder> decoder_;
+  mutable std::atomic<bool> decoded_{false};
+  mutable std::mutex decode_mutex_;  // Serializes lazy decoding, not transferred by moves
+  std::shared_ptr<const SampleIndex> sample_index_;  // Valid if genotypes are in index order
+
+  Record record_;
+  RecordSamples record_samples_;  // Set only when the record is retained
+  bool dirty_ = false;
 
   friend class CompareVariants;
 };
@@ -126,9 +288,11 @@ template <typename Iterator>
 inline VariantContext::VariantContext(VariantContext &&context, const Contig &contig, Pos pos,
                                       const Allele &ref, Iterator alt_begin, Iterator alt_end)
     : VariantContext(std::move(context)) {
-  this->HasRegion::operator=(HasRegion(contig, pos, pos + ref.size() - 1));
+  auto contig_id = (contig == contig_) ? contig_id_ : kUnknownContigID;
+  this->HasRegion::operator=(HasRegion(contig, pos, pos + ref.size() - 1, contig_id));
   ref_ = ref;
   alts_.assign(alt_begin, alt_end);
+  dirty_ = true;
 }
 
 template <typename Iterator>
@@ -139,6 +303,26 @@ inline VariantContext::VariantContext(const Contig &contig, Pos pos, Pos end, co
   alts_.assign(alt_begin, alt_end);
 }
 
+template <typename Iterator>
+inline void VariantContext::Reset(const Contig &contig, Pos pos, Pos end, const Allele &ref,
+                                  Iterator alt_begin, Iterator alt_end) {
+  this->HasRegion::operator=(HasRegion(contig, pos, end));
+  attrs_.clear();
+  ids_.clear();
+  qual_ = boost::none;
+  filters_.clear();
+  flags_ = 0;
+  ref_ = ref;
+  alts_.assign(alt_begin, alt_end);
+  genotypes_.clear();
+  decoder_.reset();
+  decoded_ = false;
+  sample_index_.reset();
+  record_.clear();
+  record_samples_.reset();
+  dirty_ = false;
+}
+
 inline VariantContext::Flags operator|(VariantContext::Flags lhs, VariantContext::Flags rhs) {
   return VariantContext::Flags(std::underlying_type<VariantContext::Flags>::type(lhs) |
                                std::underlying_type<VariantContext::Flags>::type(rhs));
@@ -156,19 +156,13 @@ class basic_any {
   template <typename T>
   explicit basic_any(T const& x)
       : table(util::detail::get_table<T>::template get<Char>()), object(0) {
-    if (detail::get_table<T>::is_small::value)
-      new (&object) T(x);
-    else
-      object = new T(x);
+    construct(x, typename detail::get_table<T>::is_small());
   }
 
   template <typename T>
   explicit basic_any(T&& x)
       : table(util::detail::get_table<T>::template get<Char>()), object(0) {
-    if (detail::get_table<T>::is_small::value)
-      new (&object) T(x);
-    else
-      object = new T(x);
+    construct(x, typename detail::get_table<T>::is_small());
   }
 
   basic_any()
@@ -211,22 +205,15 @@ class basic_any {
     if (table == x_table) {
       // if so, we can avoid deallocating and re-use memory
       table->destruct(&object);  // first destruct the old content
-      if (util::detail::get_table<T>::is_small::value) {
-        // create copy on-top of object pointer itself
-        new (&object) T(x);
-      } else {
-        // create copy on-top of old version
-        new (object) T(x);
-      }
+      // create copy on-top of object pointer itself (small) or on-top of old version (big)
+      reconstruct(x, typename util::detail::get_table<T>::is_small());
     } else {
       if (util::detail::get_table<T>::is_small::value) {
-        // create copy on-top of object pointer itself
         table->destruct(&object);  // first destruct the old content
-        new (&object) T(x);
       } else {
         reset();  // first delete the old content
-        object = new T(x);
       }
+      construct(x, typename util::detail::get_table<T>::is_small());
       table = x_table;  // update table pointer
     }
     return *this;
@@ -288,6 +275,25 @@ class basic_any {
     return !(lhs == rhs);
   }
 
+ private:
+  // Only the branch for the size of T is instantiated, i.e. big types are never placed in object
+  template <typename T>
+  void construct(T const& x, boost::mpl::true_) {
+    new (&object) T(x);
+  }
+  template <typename T>
+  void construct(T const& x, boost::mpl::false_) {
+    object = new T(x);
+  }
+  template <typename T>
+  void reconstruct(T const& x, boost::mpl::true_) {
+    new (&object) T(x);
+  }
+  template <typename T>
+  void reconstruct(T const& x, boost::mpl::false_) {
+    new (object) T(x);
+  }
+
 #ifndef BOOST_NO_MEMBER_TEMPLATE_FRIENDS
  private:  // types
   template <typename T, typename Char_>
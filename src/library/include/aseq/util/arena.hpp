@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace aseq {
+namespace util {
+
+// Monotonic ("bump") allocator. Individual deallocations are no-ops, the memory is released as a
+// unit when the arena is destroyed (or reused after Reset). Arenas are not thread-safe.
+class Arena {
+ public:
+  static const size_t kDefaultBlockSize = 4096;
+  static const size_t kMaxBlockSize = 1 << 20;
+
+  explicit Arena(size_t initial_size = kDefaultBlockSize)
+      : block_(nullptr), ptr_(nullptr), end_(nullptr), next_size_(initial_size) {}
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  ~Arena() { Release(block_); }
+
+  void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+    auto aligned = Align(ptr_, alignment);
+    if (!ptr_ || aligned + bytes > reinterpret_cast<uintptr_t>(end_)) {
+      AddBlock(bytes + alignment);
+      aligned = Align(ptr_, alignment);
+    }
+    ptr_ = reinterpret_cast<char*>(aligned + bytes);
+    return reinterpret_cast<void*>(aligned);
+  }
+
+  // Release all allocations, retaining the most recent (largest) block for reuse
+  void Reset() {
+    if (!block_) return;
+    Release(block_->previous);
+    block_->previous = nullptr;
+    ptr_ = reinterpret_cast<char*>(block_ + 1);
+  }
+
+ private:
+  // Blocks are a single allocation, a header followed by the block data
+  struct Block {
+    Block* previous;
+    size_t size;
+  };
+
+  static uintptr_t Align(const char* ptr, size_t alignment) {
+    return (reinterpret_cast<uintptr_t>(ptr) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+  }
+
+  static void Release(Block* block) {
+    while (block) {
+      Block* previous = block->previous;
+      ::operator delete(block);
+      block = previous;
+    }
+  }
+
+  void AddBlock(size_t min_size) {
+    size_t size = next_size_ > min_size ? next_size_ : min_size;
+    block_ = new (::operator new(sizeof(Block) + size)) Block{block_, size};
+    ptr_ = reinterpret_cast<char*>(block_ + 1);
+    end_ = ptr_ + size;
+    if (size < kMaxBlockSize) next_size_ = size * 2;  // Grow geometrically up to the maximum
+  }
+
+  Block* block_;
+  char *ptr_, *end_;
+  size_t next_size_;
+};
+
+// Standard allocator that allocates from a (shared) Arena, or from the heap if there is no arena.
+// Each container holds a reference to its arena so that the arena outlives any data allocated from
+// it. Containers copied from arena-backed containers allocate from the heap.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  ArenaAllocator() noexcept {}
+  ArenaAllocator(const std::shared_ptr<Arena>& arena) noexcept : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_) return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    if (!arena_) std::allocator<T>().deallocate(p, n);
+  }
+
+  ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+  const std::shared_ptr<Arena>& arena() const { return arena_; }
+
+ private:
+  std::shared_ptr<Arena> arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) {
+  return lhs.arena() == rhs.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) {
+  return !(lhs == rhs);
+}
+
+}  // namespace util
+}  // namespace aseq
@@ -0,0 +1,413 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <boost/container/small_vector.hpp>
+
+#include "aseq/util/any.hpp"
+
+namespace aseq {
+namespace util {
+
+// Representation of the value held by an AttributeValue, i.e. the VCF attribute types
+enum class AttributeType : uint8_t {
+  EMPTY,
+  FLAG,
+  INTEGER,
+  FLOAT,
+  CHARACTER,
+  STRING,
+  INTEGERS,
+  FLOATS,
+  CHARACTERS,
+  STRINGS,
+  OTHER  // Any other type, e.g. genotype alleles or filters, held in a (type-erased) any
+};
+
+namespace impl {
+
+constexpr size_t kInlineAttributeValues = 10;
+
+template <typename T>
+using InlineVector = boost::container::small_vector<T, kInlineAttributeValues>;
+
+// Type used to store values of type T, std::vectors of numbers and characters are stored as (and
+// converted to) inline vectors
+template <typename T>
+struct StoredAttribute {
+  typedef T type;
+};
+template <>
+struct StoredAttribute<std::vector<int> > {
+  typedef InlineVector<int> type;
+};
+template <>
+struct StoredAttribute<std::vector<float> > {
+  typedef InlineVector<float> type;
+};
+template <>
+struct StoredAttribute<std::vector<char> > {
+  typedef InlineVector<char> type;
+};
+}  // namespace impl
+
+// Attribute value as a tagged union of the VCF types. Numeric and character vectors are stored in
+// inline storage that fits the common multi-valued fields, e.g. AD and PL at multi-allelic sites,
+// so creating, copying and destroying those values doesn't allocate.
+//
+// For compatibility with code written against std::vector attributes, std::vectors of numbers or
+// characters are converted to the inline vectors when stored and converted back (i.e. copied) when
+// read with cast<std::vector<T> >. Mutable access requires the inline vector types.
+class AttributeValue {
+ public:
+  static constexpr size_t kInlineValues = impl::kInlineAttributeValues;
+
+  template <typename T>
+  using Vector = impl::InlineVector<T>;
+
+  typedef bool Flag;
+  typedef int Integer;
+  typedef Vector<Integer> Integers;
+  typedef float Float;
+  typedef Vector<Float> Floats;
+  typedef char Character;
+  typedef Vector<Character> Characters;
+  typedef std::string String;
+  typedef std::vector<String> Strings;
+
+ private:
+  template <typename T>
+  using Decay = std::decay_t<T>;
+
+  template <typename T>
+  using EnableIfValue = std::enable_if_t<!std::is_same<Decay<T>, AttributeValue>::value>;
+
+  template <typename T>
+  using Stored = typename impl::StoredAttribute<Decay<T> >::type;
+
+ public:
+  template <typename T>
+  using IsStored = std::is_same<Stored<T>, Decay<T> >;
+
+  // Type returned by const accessors: a reference to the stored value, or a converted copy
+  template <typename T>
+  using Result = std::conditional_t<IsStored<T>::value, const Decay<T>&, Decay<T> >;
+
+  // Mutable accessors are only defined for the stored types
+  template <typename T>
+  using EnableIfStored = std::enable_if_t<IsStored<T>::value>;
+
+ private:
+  template <typename T>
+  static constexpr AttributeType TypeOf() {
+    return StoredTypeOf<Stored<T> >();
+  }
+
+  template <typename T>
+  static constexpr AttributeType StoredTypeOf() {
+    return std::is_same<T, Flag>::value ? AttributeType::FLAG
+         : std::is_same<T, Integer>::value ? AttributeType::INTEGER
+         : std::is_same<T, Float>::value ? AttributeType::FLOAT
+         : std::is_same<T, Character>::value ? AttributeType::CHARACTER
+         : std::is_same<T, String>::value ? AttributeType::STRING
+         : std::is_same<T, Integers>::value ? AttributeType::INTEGERS
+         : std::is_same<T, Floats>::value ? AttributeType::FLOATS
+         : std::is_same<T, Characters>::value ? AttributeType::CHARACTERS
+         : std::is_same<T, Strings>::value ? AttributeType::STRINGS
+         : AttributeType::OTHER;
+  }
+
+ public:
+  AttributeValue() noexcept : type_(AttributeType::EMPTY) {}
+
+  template <typename T, typename = EnableIfValue<T> >
+  explicit AttributeValue(T&& v) : type_(AttributeType::EMPTY) {
+    Construct(std::forward<T>(v));
+  }
+
+  AttributeValue(const AttributeValue& other) : type_(AttributeType::EMPTY) { Construct(other); }
+  AttributeValue(AttributeValue&& other) noexcept : type_(AttributeType::EMPTY) {
+    Construct(std::move(other));
+  }
+
+  ~AttributeValue() { reset(); }
+
+  // Assigning a value of the same type reuses the existing storage, e.g. the capacity of a string
+  AttributeValue& operator=(const AttributeValue& other) {
+    if (&other != this) Assign(other);
+    return *this;
+  }
+  AttributeValue& operator=(AttributeValue&& other) noexcept {
+    if (&other != this) Assign(std::move(other));
+    return *this;
+  }
+
+  template <typename T, typename = EnableIfValue<T> >
+  AttributeValue& operator=(T&& v) {
+    typedef Decay<T> D;
+    if (type_ == TypeOf<D>() && TypeOf<D>() != AttributeType::OTHER) {
+      AssignValue(std::forward<T>(v), IsStored<D>());
+    } else {
+      reset();
+      Construct(std::forward<T>(v));
+    }
+    return *this;
+  }
+
+  AttributeType type() const { return type_; }
+  bool empty() const { return type_ == AttributeType::EMPTY; }
+
+  void reset() {
+    if (!empty()) {
+      Visit(*this, [](auto& v) {
+        typedef Decay<decltype(v)> D;
+        v.~D();
+      });
+      type_ = AttributeType::EMPTY;
+    }
+  }
+
+  void swap(AttributeValue& other) {
+    AttributeValue tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  // Pointer to the value if it has type T, nullptr otherwise
+  template <typename T>
+  T* get_if() {
+    return const_cast<T*>(static_cast<const AttributeValue*>(this)->get_if<T>());
+  }
+
+  template <typename T>
+  const T* get_if() const {
+    typedef Decay<T> D;
+    static_assert(IsStored<D>::value, "std::vector values can only be read with cast");
+    if (TypeOf<D>() == AttributeType::OTHER)
+      return type_ == AttributeType::OTHER ? any_cast<D>(&As<any>()) : nullptr;
+    return type_ == TypeOf<D>() ? &As<D>() : nullptr;
+  }
+
+  template <typename T>
+  Result<T> cast() const {
+    auto value = get_if<Stored<T> >();
+    if (!value) throw bad_any_cast(type_info(), typeid(T));
+    return Convert<Decay<T> >(*value, IsStored<T>());
+  }
+
+  const std::type_info& type_info() const {
+    if (empty()) return typeid(void);
+    return Visit(*this, [](const auto& v) -> const std::type_info& { return TypeInfo(v); });
+  }
+
+  friend bool operator==(const AttributeValue& lhs, const AttributeValue& rhs) {
+    if (lhs.type_ != rhs.type_) return false;
+    if (lhs.empty()) return true;
+    return Visit(lhs, [&rhs](const auto& v) { return Equal(v, rhs.As<Decay<decltype(v)> >()); });
+  }
+
+  friend bool operator!=(const AttributeValue& lhs, const AttributeValue& rhs) {
+    return !(lhs == rhs);
+  }
+
+  // Vectors are written as comma-separated values, the same as in VCF files
+  friend std::ostream& operator<<(std::ostream& os, const AttributeValue& value) {
+    if (!value.empty()) Visit(value, [&os](const auto& v) { Write(os, v); });
+    return os;
+  }
+
+ private:
+  template <typename T>
+  T& As() {
+    return *reinterpret_cast<T*>(&storage_);
+  }
+  template <typename T>
+  const T& As() const {
+    return *reinterpret_cast<const T*>(&storage_);
+  }
+
+  // Invoke f with the typed value, which must not be empty
+  template <typename Value, typename F>
+  static auto Visit(Value& value, F&& f) -> decltype(f(value.template As<Flag>())) {
+    switch (value.type_) {
+      case AttributeType::FLAG:
+        return f(value.template As<Flag>());
+      case AttributeType::INTEGER:
+        return f(value.template As<Integer>());
+      case AttributeType::FLOAT:
+        return f(value.template As<Float>());
+      case AttributeType::CHARACTER:
+        return f(value.template As<Character>());
+      case AttributeType::STRING:
+        return f(value.template As<String>());
+      case AttributeType::INTEGERS:
+        return f(value.template As<Integers>());
+      case AttributeType::FLOATS:
+        return f(value.template As<Floats>());
+      case AttributeType::CHARACTERS:
+        return f(value.template As<Characters>());
+      case AttributeType::STRINGS:
+        return f(value.template As<Strings>());
+      default:
+        return f(value.template As<any>());
+    }
+  }
+
+  template <typename T>
+  void Construct(T&& v) {
+    typedef Decay<T> D;
+    typedef std::integral_constant<bool, TypeOf<D>() == AttributeType::OTHER> IsOther;
+    Emplace<D>(std::forward<T>(v), IsOther(), IsStored<D>());
+    type_ = TypeOf<D>();
+  }
+
+  template <typename D, typename T>
+  void Emplace(T&& v, std::false_type, std::true_type) {
+    new (&storage_) D(std::forward<T>(v));
+  }
+  template <typename D, typename T>
+  void Emplace(T&& v, std::false_type, std::false_type) {
+    new (&storage_) Stored<D>(v.begin(), v.end());
+  }
+  template <typename D, typename T>
+  void Emplace(T&& v, std::true_type, std::true_type) {
+    new (&storage_) any(static_cast<const D&>(v));
+  }
+
+  template <typename T>
+  void AssignValue(T&& v, std::true_type) {
+    As<Decay<T> >() = std::forward<T>(v);
+  }
+  template <typename T>
+  void AssignValue(T&& v, std::false_type) {
+    As<Stored<T> >().assign(v.begin(), v.end());
+  }
+
+  template <typename T>
+  static const T& Convert(const T& v, std::true_type) {
+    return v;
+  }
+  template <typename T, typename S>
+  static T Convert(const S& v, std::false_type) {
+    return T(v.begin(), v.end());
+  }
+
+  void Construct(const AttributeValue& other) {
+    if (other.empty()) return;
+    Visit(other, [this](const auto& v) { new (&storage_) Decay<decltype(v)>(v); });
+    type_ = other.type_;
+  }
+
+  void Construct(AttributeValue&& other) {
+    if (other.empty()) return;
+    Visit(other, [this](auto& v) { new (&storage_) Decay<decltype(v)>(std::move(v)); });
+    type_ = other.type_;
+  }
+
+  void Assign(const AttributeValue& other) {
+    if (type_ == other.type_ && !empty()) {
+      Visit(other, [this](const auto& v) { As<Decay<decltype(v)> >() = v; });
+    } else {
+      reset();
+      Construct(other);
+    }
+  }
+
+  void Assign(AttributeValue&& other) {
+    if (type_ == other.type_ && !empty()) {
+      Visit(other, [this](auto& v) { As<Decay<decltype(v)> >() = std::move(v); });
+    } else {
+      reset();
+      Construct(std::move(other));
+    }
+  }
+
+  template <typename T>
+  static const std::type_info& TypeInfo(const T&) {
+    return typeid(T);
+  }
+  static const std::type_info& TypeInfo(const any& v) { return v.type(); }
+
+  // Floats are compared bitwise, i.e. values are equal if they have the same representation
+  template <typename T>
+  static bool Equal(const T& lhs, const T& rhs) {
+    return lhs == rhs;
+  }
+  static bool Equal(Float lhs, Float rhs) { return std::memcmp(&lhs, &rhs, sizeof(Float)) == 0; }
+  static bool Equal(const Floats& lhs, const Floats& rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                      [](Float l, Float r) { return Equal(l, r); });
+  }
+
+  template <typename T>
+  static void Write(std::ostream& os, const T& v) {
+    os << v;
+  }
+  template <typename T>
+  static void Write(std::ostream& os, const Vector<T>& v) {
+    WriteValues(os, v);
+  }
+  template <typename T, typename A>
+  static void Write(std::ostream& os, const std::vector<T, A>& v) {
+    WriteValues(os, v);
+  }
+  template <typename C>
+  static void WriteValues(std::ostream& os, const C& values) {
+    for (auto i = values.begin(); i != values.end(); ++i) {
+      if (i != values.begin()) os << ',';
+      os << *i;
+    }
+  }
+
+  std::aligned_union_t<0, Integer, Float, String, Integers, Floats, Characters, Strings, any>
+      storage_;
+  AttributeType type_;
+};
+
+inline void swap(AttributeValue& lhs, AttributeValue& rhs) { lhs.swap(rhs); }
+
+// boost::any-like casting, as with util::any
+template <typename T>
+inline T* any_cast(AttributeValue* operand) {
+  return operand ? operand->get_if<T>() : nullptr;
+}
+
+template <typename T>
+inline const T* any_cast(const AttributeValue* operand) {
+  return operand ? operand->get_if<T>() : nullptr;
+}
+
+template <typename T>
+std::enable_if_t<AttributeValue::IsStored<T>::value, T> any_cast(AttributeValue& operand) {
+  typedef std::remove_reference_t<T> nonref;
+  nonref* result = any_cast<nonref>(&operand);
+  if (!result) throw bad_any_cast(operand.type_info(), typeid(T));
+  return *result;
+}
+
+// std::vectors can only be read (as a converted copy)
+template <typename T>
+std::enable_if_t<!AttributeValue::IsStored<T>::value, AttributeValue::Result<T> > any_cast(
+    AttributeValue& operand) {
+  static_assert(!std::is_lvalue_reference<T>::value ||
+                    std::is_const<std::remove_reference_t<T> >::value,
+                "std::vector values can only be read");
+  return static_cast<const AttributeValue&>(operand).cast<T>();
+}
+
+template <typename T>
+AttributeValue::Result<T> any_cast(const AttributeValue& operand) {
+  return operand.cast<T>();
+}
+
+}  // namespace util
+}  // namespace aseq
@@ -4,116 +4,193 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <ostream>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
-#include <map>
 
+#include "aseq/util/arena.hpp"
+#include "aseq/util/attribute_value.hpp"
 #include "aseq/util/flyweight.hpp"
-#include "aseq/util/any.hpp"
 
 namespace aseq {
 namespace util {
 
+// Attributes are stored as a compact vector of slots ordered by the index of their key. Keys are
+// interned and assigned small integer indices when first created, e.g. when fields are added to a
+// VCFHeader, so lookup with a key (instead of a string) doesn't hash or compare strings.
 class Attributes {
   // We expect to have a small set of attributes keys overall, so use flyweight to optimize
   // storage
   struct attributes_tag {};
-  typedef std::map<flyweight_string_no_track<attributes_tag>, any> AttrMap;
 
  public:
-  typedef AttrMap::key_type key_type;
-  typedef AttrMap::mapped_type mapped_type;
-  typedef AttrMap::value_type value_type;
-  typedef AttrMap::iterator iterator;
-  typedef AttrMap::const_iterator const_iterator;
+  typedef indexed_flyweight_string_no_track<attributes_tag> key_type;
+  typedef AttributeValue mapped_type;
+
+  // Attribute slot, akin to std::pair but with non-throwing moves so that slots are relocated
+  // (instead of copied) as the vector grows
+  struct value_type {
+    value_type(const key_type& k, const mapped_type& v) : first(k), second(v) {}
+    value_type(const key_type& k, mapped_type&& v) : first(k), second(std::move(v)) {}
+    value_type(const value_type&) = default;
+    value_type(value_type&& other) noexcept : first(other.first), second(std::move(other.second)) {}
+
+    value_type& operator=(const value_type&) = default;
+    value_type& operator=(value_type&& other) noexcept {
+      first = other.first;
+      second = std::move(other.second);
+      return *this;
+    }
+
+    key_type first;
+    mapped_type second;
+  };
+
+ private:
+  typedef std::vector<value_type, ArenaAllocator<value_type> > Slots;
+
+ public:
+  typedef Slots::allocator_type allocator_type;
+  typedef Slots::iterator iterator;
+  typedef Slots::const_iterator const_iterator;
 
   // Common attribute types (for convenience)
-  typedef int Integer;
-  typedef std::vector<Integer> Integers;
-  typedef float Float;
-  typedef std::vector<Float> Floats;
-  typedef char Character;
-  typedef std::vector<Character> Characters;
-  typedef std::string String;
-  typedef std::vector<String> Strings;
+  typedef AttributeValue::Flag Flag;
+  typedef AttributeValue::Integer Integer;
+  typedef AttributeValue::Integers Integers;
+  typedef AttributeValue::Float Float;
+  typedef AttributeValue::Floats Floats;
+  typedef AttributeValue::Character Character;
+  typedef AttributeValue::Characters Characters;
+  typedef AttributeValue::String String;
+  typedef AttributeValue::Strings Strings;
+
+  Attributes() : present_(0) {}
+  explicit Attributes(const allocator_type& alloc) : slots_(alloc), present_(0) {}
+  explicit Attributes(std::initializer_list<value_type> il) : present_(0) {
+    insert(il.begin(), il.end());
+  }
 
-  Attributes() {}
-  explicit Attributes(std::initializer_list<value_type> il) : attrs_(il) {}
+  size_t size() const { return slots_.size(); }
+  bool empty() const { return slots_.empty(); }
+  void reserve(size_t n) { slots_.reserve(n); }
+  void clear() {  // Retains the capacity of the slots
+    slots_.clear();
+    present_ = 0;
+  }
+  allocator_type get_allocator() const { return slots_.get_allocator(); }
 
-  const_iterator find(const key_type& k) const { return attrs_.find(k); }
+  iterator find(const key_type& k) {
+    auto i = lower_bound(k.index());
+    return (i != slots_.end() && i->first == k) ? i : slots_.end();
+  }
+  const_iterator find(const key_type& k) const { return const_cast<Attributes*>(this)->find(k); }
 
-  iterator begin() { return attrs_.begin(); }
-  const_iterator begin() const { return attrs_.begin(); }
-  iterator end() { return attrs_.end(); }
-  const_iterator end() const { return attrs_.end(); }
+  iterator begin() { return slots_.begin(); }
+  const_iterator begin() const { return slots_.begin(); }
+  iterator end() { return slots_.end(); }
+  const_iterator end() const { return slots_.end(); }
 
-  mapped_type& operator[](const key_type& k) { return attrs_[k]; }
+  mapped_type& operator[](const key_type& k) {
+    return emplace(k, mapped_type()).first->second;
+  }
 
+  // Const access returns a reference to the value, or a converted copy (see AttributeValue)
   template <typename T>
-  const T& at(const key_type& k) const {
-    return any_cast<const T&>(attrs_.at(k));
+  AttributeValue::Result<T> at(const key_type& k) const {
+    return any_cast<const T&>(checked_find(k)->second);
   }
 
-  template <typename T>
+  template <typename T, typename = AttributeValue::EnableIfStored<T> >
   T& at(const key_type& k) {
-    return any_cast<T&>(attrs_.at(k));
+    return any_cast<T&>(const_cast<mapped_type&>(checked_find(k)->second));
   }
 
   template <typename T>
-  static const T& at(const_iterator i) {
+  static AttributeValue::Result<T> at(const_iterator i) {
     return any_cast<const T&>(i->second);
   }
 
   template <typename T>
-  const T& at_or(const key_type& k, const T& v) const {
-    auto i = attrs_.find(k);
-    return i != attrs_.end() ? any_cast<const T&>(i->second) : v;
+  AttributeValue::Result<T> at_or(const key_type& k, const T& v) const {
+    auto i = find(k);
+    return i != end() ? any_cast<const T&>(i->second) : v;
   }
 
+  // As with std::map, existing attributes are not replaced. Values are copied, or moved if first
+  // and last are move iterators.
   template <class InputIterator>
   void insert(InputIterator first, InputIterator last) {
-    attrs_.insert(first, last);
+    for (; first != last; ++first) {
+      auto&& v = *first;
+      emplace(v.first, std::forward<decltype(v)>(v).second);
+    }
   }
-  iterator erase(const_iterator i) { return attrs_.erase(i); }
-  size_t erase(const key_type& k) { return attrs_.erase(k); }
 
-  template <class T>
-  std::pair<iterator, bool> emplace(const key_type& k, const T& v) {
-    return attrs_.emplace(k, mapped_type(v));
+  iterator erase(const_iterator i) {
+    if (i->first.index() < kIndexed) present_ &= ~(uint64_t(1) << i->first.index());
+    return slots_.erase(i);
+  }
+  size_t erase(const key_type& k) {
+    auto i = find(k);
+    if (i == end()) return 0;
+    erase(i);
+    return 1;
   }
 
   template <class T>
   std::pair<iterator, bool> emplace(const key_type& k, T&& v) {
-    return attrs_.emplace(k, mapped_type(std::forward<T>(v)));
+    auto i = lower_bound(k.index());
+    if (i != slots_.end() && i->first == k) return std::make_pair(i, false);
+    if (k.index() < kIndexed) present_ |= uint64_t(1) << k.index();
+    return std::make_pair(slots_.emplace(i, k, ToValue(std::forward<T>(v))), true);
   }
 
  private:
-  AttrMap attrs_;
+  template <class T,
+            typename = std::enable_if_t<!std::is_same<std::decay_t<T>, mapped_type>::value> >
+  static mapped_type ToValue(T&& v) {
+    return mapped_type(std::forward<T>(v));
+  }
+  static const mapped_type& ToValue(const mapped_type& v) { return v; }
+  static mapped_type&& ToValue(mapped_type&& v) { return std::move(v); }
+
+  // Presence of the slots for the first kIndexed keys is tracked in a bitmap, so that the position
+  // of those slots can be computed in constant time
+  static const uint32_t kIndexed = 64;
+
+  iterator lower_bound(uint32_t index) {
+    if (index < kIndexed) {
+      return slots_.begin() + __builtin_popcountll(present_ & ((uint64_t(1) << index) - 1));
+    }
+    return std::lower_bound(slots_.begin() + __builtin_popcountll(present_), slots_.end(), index,
+                            [](const value_type& v, uint32_t i) { return v.first.index() < i; });
+  }
+
+  const_iterator checked_find(const key_type& k) const {
+    auto i = find(k);
+    if (i == end()) throw std::out_of_range("Attributes::at");
+    return i;
+  }
+
+  Slots slots_;
+  uint64_t present_;
 };
 
 template <>
 inline const Attributes::mapped_type& Attributes::at<Attributes::mapped_type>(
     const Attributes::key_type& k) const {
-  return attrs_.at(k);
+  return checked_find(k)->second;
 }
 
 template <>
 inline const Attributes::mapped_type& Attributes::at_or<Attributes::mapped_type>(
     const Attributes::key_type& k, const Attributes::mapped_type& v) const {
-  auto i = attrs_.find(k);
-  return i != attrs_.end() ? i->second : v;
-}
-
-template <>
-inline std::pair<Attributes::iterator, bool> Attributes::emplace<Attributes::mapped_type>(
-    const key_type& k, const mapped_type& v) {
-  return attrs_.emplace(k, v);
-}
-
-template <>
-inline std::pair<Attributes::iterator, bool> Attributes::emplace<Attributes::mapped_type>(
-    const key_type& k, mapped_type&& v) {
-  return attrs_.emplace(k, std::forward<mapped_type>(v));
+  auto i = find(k);
+  return i != end() ? i->second : v;
 }
 
 class HasAttributes {
@@ -129,17 +206,17 @@ class HasAttributes {
   }
 
   template <typename T>
-  const T& GetAttribute(const Attributes::key_type& key) const {
+  AttributeValue::Result<T> GetAttribute(const Attributes::key_type& key) const {
     return attrs_.at<T>(key);
   }
 
-  template <typename T>
+  template <typename T, typename = AttributeValue::EnableIfStored<T> >
   T& GetAttribute(const Attributes::key_type& key) {
     return attrs_.at<T>(key);
   }
 
   template <typename T>
-  const T& GetAttributeOr(const Attributes::key_type& key, const T& v) const {
+  AttributeValue::Result<T> GetAttributeOr(const Attributes::key_type& key, const T& v) const {
     return attrs_.at_or<T>(key, v);
   }
 
@@ -151,8 +228,9 @@ class HasAttributes {
   }
 
   template <typename T>
-  const T& SetAttribute(const Attributes::key_type& key, T&& v) {
-    return any_cast<const T&>(attrs_[key] = std::forward<T>(v));
+  AttributeValue::Result<T> SetAttribute(const Attributes::key_type& key, T&& v) {
+    const Attributes::mapped_type& value = attrs_[key] = std::forward<T>(v);
+    return any_cast<const T&>(value);
   }
 
   void EraseAttribute(const Attributes::key_type& key) { attrs_.erase(key); }
@@ -165,8 +243,8 @@ class HasAttributes {
 }  // namespace aseq
 
 namespace std {
-template <typename T>
-inline std::ostream& operator<<(std::ostream& ostream, const std::vector<T>& attr) {
+template <typename T, typename A>
+inline std::ostream& operator<<(std::ostream& ostream, const std::vector<T, A>& attr) {
   if (attr.size() > 1) {
     copy(attr.begin(), attr.end() - 1, std::ostream_iterator<T>(ostream, ","));
   }
@@ -4,85 +4,214 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <mutex>
 #include <string>
 #include <functional>
+#include <unordered_map>
+#include <utility>
 
 #include <boost/functional/hash.hpp>
 #include <boost/flyweight.hpp>
-#include <boost/flyweight/tag.hpp>
 #include <boost/flyweight/no_tracking.hpp>
 #include <boost/range/iterator_range.hpp>
 
 namespace aseq {
 namespace util {
 
+namespace impl {
+
+// String interface shared by the flyweight strings, Derived must implement get()
+template <class Derived>
+class flyweight_string_facade {
+ public:
+  operator const std::string&() const { return derived().get(); }
+
+  /* String Interface */
+  typedef std::string::value_type value_type;
+  typedef std::string::const_reference const_reference;
+  typedef std::string::const_iterator const_iterator;
+  typedef std::string::const_reverse_iterator reverse_const_iterator;
+
+  const_iterator begin() const { return derived().get().begin(); }
+  const_iterator end() const { return derived().get().end(); }
+  reverse_const_iterator rbegin() const { return derived().get().rbegin(); }
+  reverse_const_iterator rend() const { return derived().get().rend(); }
+
+  size_t size() const { return derived().get().size(); }
+  bool empty() const { return derived().get().empty(); }
+
+  const_reference front() const { return derived().get().front(); }
+  const_reference back() const { return derived().get().back(); }
+
+  const char* c_str() const { return derived().get().c_str(); }
+  Derived substr(size_t pos = 0, size_t len = std::string::npos) const {
+    return Derived(derived().get().substr(pos, len));
+  }
+
+ private:
+  const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+// Interned strings (per Tag) with stable addresses and dense indices, assigned in order as each
+// distinct string is first interned. The global table is sharded by hash, with a lock per shard,
+// and fronted by a small per-thread cache so that threads that repeatedly intern the same strings
+// (e.g. parsers) rarely take a lock, let alone contend. Strings are never released.
 template <class Tag>
-class flyweight_string_no_track {
-  typedef typename boost::flyweight<std::string, boost::flyweights::tag<Tag>,
-                                    boost::flyweights::no_tracking> flyweight_type;
+class StringInterner {
+ public:
+  typedef std::pair<const std::string, uint32_t> Entry;
+
+  template <typename I>
+  static const Entry* Intern(I begin, I end) {
+    struct Slot {
+      const Entry* entry = nullptr;
+      size_t hash = 0;
+    };
+    static thread_local std::array<Slot, kCacheSize> cache;
+
+    size_t hash = Hash(begin, end);
+    Slot& slot = cache[hash % kCacheSize];
+    if (slot.entry && slot.hash == hash && Equal(slot.entry->first, begin, end)) return slot.entry;
+
+    slot.entry = Insert(hash, begin, end);
+    slot.hash = hash;
+    return slot.entry;
+  }
+
+  static const Entry* Empty() {
+    static const Entry* empty = Insert(Hash("", ""), "", "");
+    return empty;
+  }
+
+ private:
+  static const size_t kCacheSize = 512, kShards = 64;
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, uint32_t> entries;  // Nodes (i.e. entries) don't move
+  };
+
+  struct Table {
+    std::array<Shard, kShards> shards;
+    std::atomic<uint32_t> next_index{0};
+  };
+
+  static Table& GetTable() {
+    static Table* table = new Table();  // Intentionally leaked, interned strings are never released
+    return *table;
+  }
+
+  template <typename I>
+  static const Entry* Insert(size_t hash, I begin, I end) {
+    Table& table = GetTable();
+    Shard& shard = table.shards[(hash >> 32) % kShards];
+    std::string value(begin, end);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto r = shard.entries.emplace(std::move(value), 0);
+    if (r.second) r.first->second = table.next_index++;
+    return &*r.first;
+  }
+
+  template <typename I>
+  static size_t Hash(I begin, I end) {  // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (; begin != end; ++begin) {
+      hash = (hash ^ static_cast<unsigned char>(*begin)) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+  }
+
+  template <typename I>
+  static bool Equal(const std::string& value, I begin, I end) {
+    return value.size() == static_cast<size_t>(std::distance(begin, end)) &&
+           std::equal(begin, end, value.begin());
+  }
+};
+}  // namespace impl
+
+template <class Tag>
+class flyweight_string_no_track
+    : public impl::flyweight_string_facade<flyweight_string_no_track<Tag> > {
+  typedef impl::StringInterner<Tag> interner;
 
  public:
-  typedef typename flyweight_type::initializer initializer;
+  struct initializer {};  // Retained for compatibility, the interner doesn't need initialization
 
-  flyweight_string_no_track() {}
-  flyweight_string_no_track(char c) : value_(std::to_string(c)) {}
-  flyweight_string_no_track(const std::string& s) : value_(s) {}
-  flyweight_string_no_track(const char* s) : value_(s) {}
+  flyweight_string_no_track() : entry_(interner::Empty()) {}
+  flyweight_string_no_track(char c) : flyweight_string_no_track(std::to_string(c)) {}
+  flyweight_string_no_track(const std::string& s) : entry_(interner::Intern(s.begin(), s.end())) {}
+  flyweight_string_no_track(const char* s) : entry_(interner::Intern(s, s + strlen(s))) {}
   template <typename I>
   flyweight_string_no_track(const boost::iterator_range<I>& r)
-      : value_(r.begin(), r.end()) {}
+      : entry_(interner::Intern(r.begin(), r.end())) {}
   template <typename I>
   flyweight_string_no_track(I begin, I end)
-      : value_(begin, end) {}
+      : entry_(interner::Intern(begin, end)) {}
   flyweight_string_no_track(const flyweight_string_no_track&) = default;
   flyweight_string_no_track(flyweight_string_no_track&&) = default;
 
-  operator const std::string&() const { return value_.get(); }
-  const std::string& get() const { return value_.get(); }
+  const std::string& get() const { return entry_->first; }
 
-  /* String Interface */
-  typedef std::string::value_type value_type;
-  typedef std::string::const_reference const_reference;
-  typedef std::string::const_iterator const_iterator;
-  typedef std::string::const_reverse_iterator reverse_const_iterator;
+  /* Operators */
+  flyweight_string_no_track& operator=(const flyweight_string_no_track& f) = default;
+  flyweight_string_no_track& operator=(flyweight_string_no_track&& f) = default;
+  bool operator==(const flyweight_string_no_track& f) const { return entry_ == f.entry_; }
+  bool operator!=(const flyweight_string_no_track& f) const { return entry_ != f.entry_; }
+  bool operator<(const flyweight_string_no_track& f) const { return get() < f.get(); }
+
+ private:
+  const typename interner::Entry* entry_;
+};
 
-  const_iterator begin() const { return this->get().begin(); }
-  const_iterator end() const { return this->get().end(); }
-  reverse_const_iterator rbegin() const { return this->get().rbegin(); }
-  reverse_const_iterator rend() const { return this->get().rend(); }
+// Flyweight string that is also assigned a small integer index, in order, when each distinct value
+// is first created. Indices are dense (per Tag) and so can be used to index into compact tables.
+template <class Tag>
+class indexed_flyweight_string_no_track
+    : public impl::flyweight_string_facade<indexed_flyweight_string_no_track<Tag> > {
+  typedef impl::StringInterner<Tag> interner;
 
-  size_t size() const { return this->get().size(); }
-  bool empty() const { return this->get().empty(); }
+ public:
+  struct initializer {};  // Retained for compatibility, the interner doesn't need initialization
 
-  const_reference front() const { return this->get().front(); }
-  const_reference back() const { return this->get().back(); }
+  indexed_flyweight_string_no_track() : entry_(interner::Empty()) {}
+  indexed_flyweight_string_no_track(const std::string& s)
+      : entry_(interner::Intern(s.begin(), s.end())) {}
+  indexed_flyweight_string_no_track(const char* s) : entry_(interner::Intern(s, s + strlen(s))) {}
+  template <typename I>
+  indexed_flyweight_string_no_track(const boost::iterator_range<I>& r)
+      : entry_(interner::Intern(r.begin(), r.end())) {}
+  template <typename I>
+  indexed_flyweight_string_no_track(I begin, I end)
+      : entry_(interner::Intern(begin, end)) {}
 
-  const char* c_str() const { return this->get().c_str(); }
-  flyweight_string_no_track substr(size_t pos = 0, size_t len = std::string::npos) const {
-    return flyweight_string_no_track(get().substr(pos, len));
-  }
+  const std::string& get() const { return entry_->first; }
+  uint32_t index() const { return entry_->second; }
 
   /* Operators */
-  flyweight_string_no_track& operator=(const flyweight_string_no_track& f) {
-    value_ = f.value_;
-    return *this;
-  }
-  flyweight_string_no_track& operator=(flyweight_string_no_track&& f) {
-    value_ = f.value_;
-    return *this;
-  }
-  bool operator==(const flyweight_string_no_track& f) const { return value_ == f.value_; }
-  bool operator!=(const flyweight_string_no_track& f) const { return value_ != f.value_; }
-  bool operator<(const flyweight_string_no_track& f) const { return value_ < f.value_; }
+  bool operator==(const indexed_flyweight_string_no_track& f) const { return entry_ == f.entry_; }
+  bool operator!=(const indexed_flyweight_string_no_track& f) const { return entry_ != f.entry_; }
+  bool operator<(const indexed_flyweight_string_no_track& f) const { return get() < f.get(); }
 
  private:
-  flyweight_type value_;
+  const typename interner::Entry* entry_;
 };
 
 template <class Tag>
 std::ostream& operator<<(std::ostream& ostream, const flyweight_string_no_track<Tag>& flyweight) {
   return (ostream << flyweight.get());
 }
+
+template <class Tag>
+std::ostream& operator<<(std::ostream& ostream,
+                         const indexed_flyweight_string_no_track<Tag>& flyweight) {
+  return (ostream << flyweight.get());
+}
 }  // namespace util
 }  // namespace aseq
 
@@ -95,4 +224,11 @@ struct hash<aseq::util::flyweight_string_no_track<T> > {
     return hasher(&k.get());
   }
 };
+
+template <class T>
+struct hash<aseq::util::indexed_flyweight_string_no_track<T> > {
+  std::size_t operator()(const aseq::util::indexed_flyweight_string_no_track<T>& k) const {
+    return k.index();
+  }
+};
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace aseq {
+namespace util {
+
+// Fixed-size pool of worker threads. A pool with zero threads runs tasks inline in Submit, so
+// callers can use the same code path for single- and multi-threaded operation.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threads) : done_(false) {
+    for (size_t i = 0; i < threads; i++) {
+      workers_.emplace_back([this] { Run(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    ready_.notify_all();
+    for (auto& worker : workers_) worker.join();
+  }
+
+  size_t size() const { return workers_.size(); }
+
+  template <typename F>
+  std::future<typename std::result_of<F()>::type> Submit(F&& f) {
+    typedef typename std::result_of<F()>::type result_type;
+
+    auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+    auto result = task->get_future();
+    if (workers_.empty()) {
+      (*task)();
+    } else {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.emplace([task] { (*task)(); });
+      }
+      ready_.notify_one();
+    }
+    return result;
+  }
+
+ private:
+  void Run() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return done_ || !tasks_.empty(); });
+        if (tasks_.empty()) return;  // Only reachable when done_ is set
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+
+  bool done_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::queue<std::function<void()>> tasks_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace util
+}  // namespace aseq
@@ -0,0 +1,334 @@
+#include <cstring>
+
+#include <boost/filesystem.hpp>
+#include <glog/logging.h>
+#include <htslib/bgzf.h>
+#include <zlib.h>
+
+#include "aseq/util/exception.hpp"
+#include "bgzf.hpp"
+
+using namespace aseq::util;
+namespace fs = boost::filesystem;
+
+namespace aseq {
+namespace io {
+namespace impl {
+
+namespace {
+const size_t kBlockHeaderLength = 18;
+const size_t kBlockFooterLength = 8;
+const size_t kBlocksPerThread = 4;
+const size_t kSearchWindow = 1 << 16;
+const int kCompressionLevel = -1;  // zlib default, as used by htslib
+
+// Empty block that marks the end of a BGZF file
+const char kEOFMarker[] =
+    "\037\213\010\4\0\0\0\0\0\377\6\0\102\103\2\0\033\0\3\0\0\0\0\0\0\0\0\0";
+
+inline uint32_t LittleEndian16(const char* p) {
+  auto u = reinterpret_cast<const uint8_t*>(p);
+  return u[0] | (u[1] << 8);
+}
+
+inline uint32_t LittleEndian32(const char* p) {
+  auto u = reinterpret_cast<const uint8_t*>(p);
+  return u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+// Check for gzip magic with the BGZF 'BC' extra subfield (same checks as htslib)
+bool IsBlockHeader(const char* h) {
+  auto u = reinterpret_cast<const uint8_t*>(h);
+  return u[0] == 31 && u[1] == 139 && u[2] == 8 && (u[3] & 4) != 0 && LittleEndian16(h + 10) == 6 &&
+         u[12] == 'B' && u[13] == 'C' && LittleEndian16(h + 14) == 2;
+}
+}
+
+BGZFReader::BGZFReader(const fs::path& path, size_t threads)
+    : file_(hopen(path.c_str(), "r")),
+      pool_(threads > 1 ? threads : 0),
+      window_(threads > 1 ? kBlocksPerThread * threads : 1),
+      read_address_(0),
+      limit_address_(kNoLimit >> 16),
+      read_eof_(false),
+      next_address_(0),
+      offset_(0) {
+  if (!file_) {
+    throw file_parse_error() << error_message("could not open BGZF file for reading");
+  }
+}
+
+BGZFReader::~BGZFReader() {
+  pending_.clear();
+  LOG_IF(WARNING, hclose(file_) != 0) << "error closing BGZF file";
+}
+
+void BGZFReader::Seek(VirtualOffset offset, VirtualOffset limit) {
+  int64_t address = offset >> 16;
+  size_t block_offset = offset & 0xFFFF;
+  limit_address_ = limit >> 16;
+
+  if (!current_ || current_->address != address) {
+    // Reuse blocks already inflated by the read-ahead if possible
+    while (!pending_.empty() && pending_.front().address < address) pending_.pop_front();
+    if (pending_.empty() || pending_.front().address != address) {
+      pending_.clear();
+      if (hseek(file_, address, SEEK_SET) < 0) {
+        throw file_parse_error() << error_message("could not seek in BGZF file");
+      }
+      read_address_ = address;
+      read_eof_ = false;
+    }
+    current_.reset();
+    next_address_ = address;
+    offset_ = 0;
+    if (!Advance() && block_offset == 0) return;  // Seeking to the end of the file
+  }
+  if (!current_ || block_offset > current_->data.size()) {
+    throw file_parse_error() << error_message("invalid BGZF virtual offset");
+  }
+  offset_ = block_offset;
+}
+
+VirtualOffset BGZFReader::Tell() const {
+  if (current_ && offset_ < current_->data.size())
+    return (static_cast<VirtualOffset>(current_->address) << 16) | offset_;
+  else
+    return static_cast<VirtualOffset>(next_address_) << 16;
+}
+
+int64_t BGZFReader::FindBlock(int64_t address, int64_t end) {
+  pending_.clear();
+  current_.reset();
+
+  // Successive windows overlap by a header so that headers spanning windows are detected
+  std::vector<char> window(kSearchWindow + kBlockHeaderLength);
+  for (; address < end; address += kSearchWindow) {
+    if (hseek(file_, address, SEEK_SET) < 0) {
+      throw file_parse_error() << error_message("could not seek in BGZF file");
+    }
+    ssize_t count = hread(file_, window.data(), window.size());
+    if (count < static_cast<ssize_t>(kBlockHeaderLength)) break;
+    for (size_t i = 0; i + kBlockHeaderLength <= static_cast<size_t>(count); i++) {
+      // The magic bytes could occur within compressed data, so also require that the block is
+      // followed by another block (or the end of the file)
+      if (IsBlockHeader(window.data() + i) &&
+          IsBlockAt(address + static_cast<int64_t>(i + LittleEndian16(window.data() + i + 16)) + 1,
+                    end)) {
+        return address + static_cast<int64_t>(i);
+      }
+    }
+  }
+  return end;
+}
+
+bool BGZFReader::IsBlockAt(int64_t address, int64_t end) {
+  if (address == end) return true;
+  char header[kBlockHeaderLength];
+  return address < end && hseek(file_, address, SEEK_SET) >= 0 &&
+         hread(file_, header, kBlockHeaderLength) == static_cast<ssize_t>(kBlockHeaderLength) &&
+         IsBlockHeader(header);
+}
+
+boost::optional<Line> BGZFReader::ReadLine() {
+  if (!current_ || offset_ >= current_->data.size()) {
+    if (!Advance()) return boost::none;
+  }
+
+  const char* begin = current_->data.data() + offset_;
+  const char* end = current_->data.data() + current_->data.size();
+  const char* newline = static_cast<const char*>(memchr(begin, '\n', end - begin));
+  if (newline) {
+    // Common case: the entire line is within a single block
+    offset_ += newline - begin + 1;
+    if (newline > begin && *(newline - 1) == '\r') newline--;
+    return Line(begin, newline);
+  }
+
+  // Line spans multiple blocks
+  spill_.assign(begin, end);
+  offset_ = current_->data.size();
+  while (Advance()) {
+    begin = current_->data.data();
+    end = begin + current_->data.size();
+    newline = static_cast<const char*>(memchr(begin, '\n', end - begin));
+    if (newline) {
+      spill_.append(begin, newline);
+      offset_ = newline - begin + 1;
+      break;
+    }
+    spill_.append(begin, end);
+    offset_ = current_->data.size();
+  }
+  if (!spill_.empty() && spill_.back() == '\r') spill_.pop_back();
+  return Line(spill_.data(), spill_.data() + spill_.size());
+}
+
+void BGZFReader::Inflate(Block& block) {
+  uint32_t length = LittleEndian32(block.compressed.data() + block.size - 4);
+  block.data.resize(length);
+  if (length == 0) return;
+
+  z_stream zs;
+  zs.zalloc = NULL;
+  zs.zfree = NULL;
+  zs.next_in = reinterpret_cast<Bytef*>(block.compressed.data() + kBlockHeaderLength);
+  zs.avail_in = static_cast<uInt>(block.size - kBlockHeaderLength - kBlockFooterLength);
+  zs.next_out = reinterpret_cast<Bytef*>(block.data.data());
+  zs.avail_out = length;
+
+  if (inflateInit2(&zs, -15) != Z_OK) {
+    throw file_parse_error() << error_message("could not initialize BGZF block decompression");
+  }
+  int result = inflate(&zs, Z_FINISH);
+  inflateEnd(&zs);
+  if (result != Z_STREAM_END || zs.total_out != length) {
+    throw file_parse_error() << error_message("corrupt BGZF block");
+  }
+  block.compressed = std::vector<char>();  // Release compressed data
+}
+
+bool BGZFReader::ReadCompressed(Block& block) {
+  char header[kBlockHeaderLength];
+  ssize_t count = hread(file_, header, kBlockHeaderLength);
+  if (count == 0)
+    return false;
+  else if (count != static_cast<ssize_t>(kBlockHeaderLength) || !IsBlockHeader(header)) {
+    throw file_parse_error() << error_message("invalid BGZF block header");
+  }
+
+  block.size = LittleEndian16(header + 16) + 1;
+  if (block.size < kBlockHeaderLength + kBlockFooterLength) {
+    throw file_parse_error() << error_message("invalid BGZF block size");
+  }
+  block.compressed.resize(block.size);
+  memcpy(block.compressed.data(), header, kBlockHeaderLength);
+  count = hread(file_, block.compressed.data() + kBlockHeaderLength,
+                block.size - kBlockHeaderLength);
+  if (count != static_cast<ssize_t>(block.size - kBlockHeaderLength)) {
+    throw file_parse_error() << error_message("truncated BGZF block");
+  }
+  return true;
+}
+
+void BGZFReader::Fill() {
+  while (pending_.size() < window_ && !read_eof_ && read_address_ <= limit_address_) {
+    auto block = std::make_shared<Block>();
+    block->address = read_address_;
+    if (!ReadCompressed(*block)) {
+      read_eof_ = true;
+      break;
+    }
+    read_address_ += block->size;
+    pending_.push_back({block->address, pool_.Submit([block] {
+                          Inflate(*block);
+                          return block;
+                        })});
+  }
+}
+
+bool BGZFReader::Advance() {
+  for (;;) {
+    Fill();
+    if (pending_.empty()) {
+      current_.reset();
+      offset_ = 0;
+      return false;
+    }
+
+    current_ = pending_.front().block.get();
+    pending_.pop_front();
+    next_address_ = current_->address + current_->size;
+    offset_ = 0;
+    if (!current_->data.empty()) return true;  // Skip empty blocks, e.g. the EOF marker
+  }
+}
+
+BGZFWriter::BGZFWriter(const fs::path& path, size_t threads, Callback written)
+    : file_(hopen(path.c_str(), "w")),
+      pool_(threads > 1 ? threads : 0),
+      window_(threads > 1 ? kBlocksPerThread * threads : 1),
+      written_(written),
+      uncompressed_(0),
+      address_(0) {
+  if (!file_) {
+    throw file_write_error() << error_message("could not open BGZF file for writing");
+  }
+  buffer_.reserve(BGZF_BLOCK_SIZE);
+}
+
+BGZFWriter::~BGZFWriter() {
+  if (file_) {
+    try {
+      Close();
+    } catch (std::exception& e) {
+      LOG(ERROR) << e.what();
+    }
+  }
+}
+
+void BGZFWriter::Write(const char* data, size_t length) {
+  while (length > 0) {
+    size_t count = std::min(length, BGZF_BLOCK_SIZE - buffer_.size());
+    buffer_.insert(buffer_.end(), data, data + count);
+    data += count;
+    length -= count;
+    uncompressed_ += count;
+    if (buffer_.size() == BGZF_BLOCK_SIZE) Submit();
+  }
+}
+
+VirtualOffset BGZFWriter::Close() {
+  if (!buffer_.empty()) Submit();
+  while (!pending_.empty()) WriteNext();
+
+  VirtualOffset end = static_cast<VirtualOffset>(address_) << 16;
+
+  hFILE* file = file_;
+  file_ = nullptr;
+  bool error = hwrite(file, kEOFMarker, sizeof(kEOFMarker) - 1) !=
+               static_cast<ssize_t>(sizeof(kEOFMarker) - 1);
+  if (hclose(file) != 0 || error) {
+    throw file_write_error() << error_message("could not close BGZF file");
+  }
+  return end;
+}
+
+void BGZFWriter::Deflate(Block& block) {
+  size_t size = BGZF_MAX_BLOCK_SIZE;
+  block.compressed.resize(size);
+  if (bgzf_compress(block.compressed.data(), &size, block.data.data(), block.data.size(),
+                    kCompressionLevel) != 0) {
+    throw file_write_error() << error_message("could not compress BGZF block");
+  }
+  block.compressed.resize(size);
+}
+
+void BGZFWriter::Submit() {
+  auto block = std::make_shared<Block>();
+  block->begin = uncompressed_ - buffer_.size();
+  block->data.swap(buffer_);
+  buffer_.reserve(BGZF_BLOCK_SIZE);
+
+  pending_.push_back(pool_.Submit([block] {
+    Deflate(*block);
+    return block;
+  }));
+  while (pending_.size() > window_) WriteNext();
+}
+
+void BGZFWriter::WriteNext() {
+  auto block = pending_.front().get();
+  pending_.pop_front();
+
+  auto size = block->compressed.size();
+  if (hwrite(file_, block->compressed.data(), size) != static_cast<ssize_t>(size)) {
+    throw file_write_error() << error_message("could not write BGZF block");
+  }
+  if (written_) written_({address_, size, block->begin, block->data.size()});
+  address_ += size;
+}
+
+}  // namespace impl
+}  // namespace io
+}  // namespace aseq
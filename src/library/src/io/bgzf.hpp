@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <htslib/hfile.h>
+
+#include "aseq/io/line.hpp"
+#include "aseq/util/thread_pool.hpp"
+
+namespace boost {
+namespace filesystem {
+
+class path;
+}
+}
+
+namespace aseq {
+namespace io {
+namespace impl {
+
+// BGZF virtual file offset, i.e. (compressed block address << 16) | offset in uncompressed block
+typedef uint64_t VirtualOffset;
+
+// Reader for BGZF compressed files that inflates blocks ahead of the consumer on a pool of worker
+// threads. Decompressed data is always delivered in file order. With one (or zero) threads blocks
+// are inflated inline, on demand.
+class BGZFReader {
+ public:
+  static const VirtualOffset kNoLimit = std::numeric_limits<VirtualOffset>::max();
+
+  BGZFReader(const boost::filesystem::path& path, size_t threads);
+  ~BGZFReader();
+
+  // Position the reader at offset. Read-ahead will not extend beyond the block containing limit.
+  void Seek(VirtualOffset offset, VirtualOffset limit = kNoLimit);
+  void SetLimit(VirtualOffset limit) { limit_address_ = limit >> 16; }
+
+  VirtualOffset Tell() const;
+
+  // Find the address of the first block that starts at or after address (returning end if there is
+  // none), by scanning for a valid block header. Must be followed by Seek.
+  int64_t FindBlock(int64_t address, int64_t end);
+
+  // Read next line (without the terminating newline). Line is valid until the next call to
+  // ReadLine or Seek.
+  boost::optional<Line> ReadLine();
+
+ private:
+  struct Block {
+    int64_t address;
+    size_t size;  // Compressed size
+    std::vector<char> compressed;
+    std::vector<char> data;
+  };
+  typedef std::shared_ptr<Block> BlockPtr;
+
+  struct Pending {
+    int64_t address;
+    std::future<BlockPtr> block;
+  };
+
+  static void Inflate(Block& block);
+
+  bool IsBlockAt(int64_t address, int64_t end);
+  bool ReadCompressed(Block& block);
+  void Fill();
+  bool Advance();
+
+  hFILE* file_;
+  util::ThreadPool pool_;
+  size_t window_;
+
+  std::deque<Pending> pending_;
+  int64_t read_address_, limit_address_;
+  bool read_eof_;
+
+  BlockPtr current_;
+  int64_t next_address_;
+  size_t offset_;
+  std::string spill_;
+};
+
+// Writer for BGZF compressed files that compresses blocks on a pool of worker threads. Blocks are
+// written in order on the calling thread (in Write or Close) as their compression completes.
+class BGZFWriter {
+ public:
+  // Location of a block in the compressed file, and the uncompressed data it contains
+  struct BlockAddress {
+    int64_t address;
+    size_t size;
+    uint64_t begin;
+    size_t length;
+  };
+  typedef std::function<void(const BlockAddress&)> Callback;
+
+  // Optional callback is invoked in file order, on the calling thread, as each block is written
+  BGZFWriter(const boost::filesystem::path& path, size_t threads, Callback written = Callback());
+  ~BGZFWriter();
+
+  void Write(const char* data, size_t length);
+
+  // Uncompressed offset of the next byte to be written
+  uint64_t Tell() const { return uncompressed_; }
+
+  // Write any remaining data and the EOF marker. Returns virtual offset of the end of the data.
+  VirtualOffset Close();
+
+ private:
+  struct Block {
+    uint64_t begin;
+    std::vector<char> data;
+    std::vector<char> compressed;
+  };
+  typedef std::shared_ptr<Block> BlockPtr;
+
+  static void Deflate(Block& block);
+
+  void Submit();
+  void WriteNext();
+
+  hFILE* file_;
+  util::ThreadPool pool_;
+  size_t window_;
+  Callback written_;
+
+  std::deque<std::future<BlockPtr>> pending_;
+  std::vector<char> buffer_;
+  uint64_t uncompressed_;
+  int64_t address_;
+};
+
+}  // namespace impl
+}  // namespace io
+}  // namespace aseq
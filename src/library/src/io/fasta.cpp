@@ -6,25 +6,116 @@
 #include <fstream>
 #include <algorithm>
 #include <boost/filesystem.hpp>
-#include <boost/utility/string_ref.hpp>
+#include <cppformat/format.h>
+#include <glog/logging.h>
 
 #include "aseq/io/fasta.hpp"
+#include "aseq/util/exception.hpp"
+#include "bgzf.hpp"
 
 namespace aseq {
 namespace io {
 
-FastaSink::FastaSink(const boost::filesystem::path& path, size_t columns)
-    : owned_ostream_(std::make_unique<std::ofstream>(path.native())),
-      ostream_(*owned_ostream_),
-      columns_(80) {}
+namespace fs = boost::filesystem;
+using namespace aseq::util;
+
+namespace {
+// Sequences are written to files in blocks of at least this size
+const size_t kBufferSize = 1 << 20;
+
+void WriteLittleEndian(std::ostream& ostream, uint64_t value) {
+  char bytes[sizeof(value)];
+  for (size_t i = 0; i < sizeof(value); i++) bytes[i] = static_cast<char>(value >> (8 * i));
+  ostream.write(bytes, sizeof(bytes));
+}
+
+std::unique_ptr<std::ofstream> OpenFile(const fs::path& path) {
+  auto file = std::make_unique<std::ofstream>(path.native(), std::ios_base::binary);
+  if (!*file) {
+    throw file_write_error() << error_message(
+        fmt::format("could not open {} for writing", path.native()));
+  }
+  return file;
+}
+}  // anonymous namespace
+
+FastaSink::FastaSink(std::ostream& ostream, size_t columns)
+    : ostream_(&ostream), columns_(columns) {}
+
+FastaSink::FastaSink(const fs::path& path, size_t columns, size_t threads)
+    : columns_(columns), path_(path.native()) {
+  if (path.extension() == ".gz") {
+    // Record the start of each block (after the first) for the .gzi index
+    bgzf_ = std::make_unique<impl::BGZFWriter>(
+        path, threads, [this](const impl::BGZFWriter::BlockAddress& block) {
+          gzi_.emplace_back(block.address + block.size, block.begin + block.length);
+        });
+  } else {
+    owned_ostream_ = OpenFile(path);
+    ostream_ = owned_ostream_.get();
+  }
+  buffer_.reserve(kBufferSize + kBufferSize / 4);
+}
+
+FastaSink::~FastaSink() {
+  if (!closed_) {
+    try {
+      Close();
+    } catch (exception_base& e) {
+      LOG(ERROR) << e.what();
+    }
+  }
+}
 
 FastaSink& FastaSink::PushSequence(const std::string& name, const std::string& sequence) {
-  ostream_ << '>' << name << std::endl;
-  auto sequence_ref = boost::string_ref(sequence);
+  buffer_.push_back('>');
+  buffer_.append(name).push_back('\n');
+  uint64_t offset = written_ + buffer_.size();
   for (size_t i = 0; i < sequence.size(); i += columns_) {
-    ostream_ << sequence_ref.substr(i, std::min(columns_, sequence.size() - i)) << std::endl;
+    buffer_.append(sequence, i, std::min(columns_, sequence.size() - i)).push_back('\n');
+  }
+
+  if (!path_.empty()) {
+    fai_.append(
+        fmt::format("{}\t{}\t{}\t{}\t{}\n", name, sequence.size(), offset, columns_, columns_ + 1));
+  }
+
+  // Streams (which are not owned) are complete after each sequence, files are written in blocks
+  if (!owned_ostream_ && !bgzf_) {
+    WriteBuffer();
+  } else if (buffer_.size() >= kBufferSize) {
+    WriteBuffer();
   }
   return *this;
 }
+
+void FastaSink::WriteBuffer() {
+  if (bgzf_)
+    bgzf_->Write(buffer_.data(), buffer_.size());
+  else
+    ostream_->write(buffer_.data(), buffer_.size());
+  written_ += buffer_.size();
+  buffer_.clear();
+}
+
+void FastaSink::Close() {
+  if (closed_) return;
+  closed_ = true;
+  WriteBuffer();
+  if (bgzf_) {
+    bgzf_->Close();
+    auto gzi = OpenFile(path_ + ".gzi");
+    WriteLittleEndian(*gzi, gzi_.size());
+    for (auto& offsets : gzi_) {
+      WriteLittleEndian(*gzi, offsets.first);
+      WriteLittleEndian(*gzi, offsets.second);
+    }
+  } else {
+    ostream_->flush();
+    if (!*ostream_) throw file_write_error() << error_message("could not write FASTA sequences");
+  }
+
+  if (!path_.empty()) *OpenFile(path_ + ".fai") << fai_;
+}
+}
 }
-}
\ No newline at end of file
@@ -2,24 +2,28 @@
 // Created by Michael Linderman on 12/12/15.
 //
 
+#include <algorithm>
+#include <cstring>
 #include <istream>
 #include <fstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
 #include <cppformat/format.h>
 #include <htslib/hts.h>
 #include <htslib/tbx.h>
-#include <htslib/kstring.h>
-#include <htslib/bgzf.h>
 
 #include "aseq/util/exception.hpp"
 #include "aseq/io/line.hpp"
 #include "aseq/model/region.hpp"
-
-extern "C" {
-
-long hts_utell(htsFile *fp);
-}
+#include "bgzf.hpp"
+#include "numeric.hpp"
+#include "tabix.hpp"
 
 using namespace aseq::util;
 namespace fs = boost::filesystem;
@@ -27,6 +31,26 @@ namespace fs = boost::filesystem;
 namespace aseq {
 namespace io {
 
+void LineBatch::append(const char *begin, const char *end) {
+  auto offset = buffer_.size();
+  buffer_.append(begin, end);
+  for (auto begin = buffer_.data() + offset, end = buffer_.data() + buffer_.size(); begin != end;) {
+    auto newline = static_cast<const char *>(memchr(begin, '\n', end - begin));
+    begin = newline + 1;
+    offsets_.push_back(begin - buffer_.data());
+  }
+}
+
+size_t ASCIILineReaderInterface::ReadNextLines(LineBatch &batch) {
+  size_t count = 0;
+  for (; !batch.full(); count++) {
+    auto line = ReadNextLine();
+    if (!line) break;
+    batch.push_back(*line);
+  }
+  return count;
+}
+
 namespace impl {
 
 class ASCIIStreamLineReader : public ASCIILineReaderInterface {
@@ -52,74 +76,322 @@ class ASCIIStreamLineReader : public ASCIILineReaderInterface {
   std::string line_;
 };
 
-namespace {
-// Simple callback function to read bgzip compressed line
-int TabixReadLine(BGZF *fp, void *tbxv, void *sv, int *tid, int *beg, int *end) {
-  kstring_t *s = (kstring_t *)sv;
-  *tid = 0;
-  *beg = 0;
-  *end = 0;
-  return bgzf_getline(fp, '\n', s);
-}
-}
+// Reader for uncompressed files that maps the entire file into memory and returns lines that point
+// directly into that mapping (and thus remain valid for the lifetime of the reader)
+class MappedLineReader : public ASCIILineReaderInterface {
+ public:
+  MappedLineReader() = delete;
+
+  explicit MappedLineReader(const fs::path &path)
+      : mapping_(std::make_shared<Mapping>(path)), offset_(0), limit_(mapping_->size) {}
+
+  virtual bool IsShardable() const override { return true; }
+
+  virtual FactoryResult MakeShard(size_t shard, size_t num_shards) const override {
+    if (shard >= num_shards) {
+      throw invalid_argument() << error_message("invalid shard");
+    }
+    // Lines belong to the shard containing their first character, so shards after the first start
+    // at the first line beginning at or after their nominal start
+    auto Boundary = [&](size_t s) {
+      size_t boundary = offset_ + (mapping_->size - offset_) * s / num_shards;
+      if (boundary <= offset_ || s == num_shards) return boundary;
+      auto newline = static_cast<const char *>(
+          memchr(mapping_->data + boundary - 1, '\n', mapping_->size - boundary + 1));
+      return newline ? static_cast<size_t>(newline - mapping_->data) + 1 : mapping_->size;
+    };
+    return FactoryResult(new MappedLineReader(mapping_, Boundary(shard), Boundary(shard + 1)));
+  }
+
+  virtual NextResult ReadNextLine() override {
+    if (offset_ >= limit_) return NextResult();
+
+    // memchr is vectorized in most C libraries
+    const char *begin = mapping_->data + offset_, *end = mapping_->data + mapping_->size;
+    auto newline = static_cast<const char *>(memchr(begin, '\n', end - begin));
+    if (!newline) newline = end;
+    offset_ = (newline - mapping_->data) + 1;
+    return NextResult(boost::make_iterator_range(begin, newline));
+  }
+
+  virtual size_t ReadNextLines(LineBatch &batch) override {
+    // Find a run of complete lines and copy them into the batch at once
+    size_t count = 0;
+    const char *begin = mapping_->data + offset_, *end = mapping_->data + mapping_->size,
+               *limit = mapping_->data + limit_, *next = begin;
+    for (; next < limit && !batch.full(batch.size() + count, batch.bytes() + (next - begin));
+         count++) {
+      auto newline = static_cast<const char *>(memchr(next, '\n', end - next));
+      if (!newline) {
+        // Final line without trailing newline
+        batch.append(begin, next);
+        batch.push_back(boost::make_iterator_range(next, end));
+        offset_ = mapping_->size;
+        return count + 1;
+      }
+      next = newline + 1;
+    }
+    batch.append(begin, next);
+    offset_ = next - mapping_->data;
+    return count;
+  }
+
+ private:
+  // Read-only mapping of the file, shared by all of the shards
+  struct Mapping {
+    explicit Mapping(const fs::path &path) : data(nullptr), size(0) {
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        throw file_parse_error() << error_message("could not open file for reading");
+      }
+      struct stat info;
+      if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = info.st_size;
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+          posix_madvise(mapped, size, POSIX_MADV_SEQUENTIAL);
+          data = static_cast<const char *>(mapped);
+        }
+      }
+      close(fd);
+      if (size > 0 && !data) {
+        throw file_parse_error() << error_message("could not map file for reading");
+      }
+    }
+
+    ~Mapping() {
+      if (data) munmap(const_cast<char *>(data), size);
+    }
+
+    const char *data;
+    size_t size;
+  };
+
+  MappedLineReader(const std::shared_ptr<Mapping> &mapping, size_t offset, size_t limit)
+      : mapping_(mapping), offset_(offset), limit_(limit) {}
+
+  std::shared_ptr<Mapping> mapping_;
+  size_t offset_, limit_;  // Lines starting before limit_ are read
+};
 
 class TabixLineReader : public ASCIILineReaderInterface {
  public:
   TabixLineReader() = delete;
 
-  explicit TabixLineReader(const fs::path &path)
-      : file_(nullptr, &hts_close),
-        index_(nullptr, &tbx_destroy),
-        iter_(nullptr, &hts_itr_destroy),
-        line_({}) {
-    file_.reset(hts_open(path.c_str(), "r"));
-    if (!file_) {
-      throw file_parse_error() << error_message("could not open tabix file for reading");
-    }
-    index_.reset(tbx_index_load(path.c_str()));
-    if (!index_) {
-      throw file_parse_error() << error_message("Could not open .tbi index");
+  TabixLineReader(const fs::path &path, size_t threads)
+      : path_(path), reader_(path, threads), index_(nullptr, &tbx_destroy), chunk_(0) {
+    // The index is optional, without it the file can only be read sequentially (or in shards)
+    if (fs::exists(path.native() + ".tbi") || fs::exists(path.native() + ".csi")) {
+      index_.reset(tbx_index_load(path.c_str()));
+      if (!index_) {
+        throw file_parse_error() << error_message("Could not open .tbi index");
+      }
     }
-
-    // Create synthetic iterator pointing to the start of the file
-    iter_.reset((hts_itr_t *)calloc(1, sizeof(hts_itr_t)));
-    iter_->read_rest = 1;
-    iter_->curr_off = hts_utell(file_.get());
-    iter_->readrec = TabixReadLine;
   }
 
-  ~TabixLineReader() { free(ks_release(&line_)); }
-
-  virtual bool IsIndexed() const override { return true; }
+  virtual bool IsIndexed() const override { return index_ != nullptr; }
 
   virtual void SetRegion(model::Contig contig, model::Pos pos, model::Pos end) override {
-    // Create iterator
+    if (!index_) throw indexed_access_not_supported();
     int tid = tbx_name2id(index_.get(), contig.c_str());
     if (tid < 0) {
       throw invalid_argument() << error_message(
           fmt::format("contig '{}' not found in index", contig));
     }
-    iter_.reset(
-        tbx_itr_queryi(index_.get(), tid, static_cast<int>(pos - 1), static_cast<int>(end)));
+    SetTargets({{tid, static_cast<int>(pos - 1), static_cast<int>(end)}});
+  }
+
+  virtual void SetRegions(const model::Regions &regions) override {
+    if (!index_) throw indexed_access_not_supported();
+    std::vector<Interval> targets;
+    targets.reserve(regions.size());
+    for (auto &region : regions) {
+      // Contigs absent from the index can't have any overlapping lines
+      int tid = tbx_name2id(index_.get(), region.contig().c_str());
+      if (tid >= 0) {
+        targets.push_back(
+            {tid, static_cast<int>(region.pos() - 1), static_cast<int>(region.end())});
+      }
+    }
+    SetTargets(std::move(targets));
+  }
+
+  virtual bool IsShardable() const override { return !region_; }
+
+  // Shards decompress blocks inline since the shards themselves are expected to run in parallel
+  virtual FactoryResult MakeShard(size_t shard, size_t num_shards) const override {
+    if (shard >= num_shards) {
+      throw invalid_argument() << error_message("invalid shard");
+    }
+    if (region_) throw sharding_not_supported();
+    return FactoryResult(new TabixLineReader(path_, reader_.Tell(), shard, num_shards));
   }
 
   virtual NextResult ReadNextLine() override {
-    // If we have a live iterator, use that to read from the file
-    if (iter_ && tbx_itr_next(file_.get(), index_.get(), iter_.get(), &line_) >= 0) {
-      return NextResult(boost::make_iterator_range(line_.s, line_.s + line_.l));
-    } else if (iter_) {
-      iter_.reset(nullptr);
-      return NextResult();
+    if (region_) return ReadNextRegionLine();
+    return (reader_.Tell() <= end_) ? reader_.ReadLine() : NextResult();
+  }
+
+  virtual size_t ReadNextLines(LineBatch &batch) override {
+    size_t count = 0;
+    if (region_) {
+      for (; !batch.full(); count++) {
+        auto line = ReadNextRegionLine();
+        if (!line) break;
+        batch.push_back(*line);
+      }
     } else {
-      return NextResult();
+      for (; !batch.full() && reader_.Tell() <= end_; count++) {
+        auto line = reader_.ReadLine();
+        if (!line) break;
+        batch.push_back(*line);
+      }
     }
+    return count;
   }
 
  private:
-  std::unique_ptr<htsFile, decltype(&hts_close)> file_;
+  struct Interval {
+    int tid, beg, end;
+  };
+
+  // Shard k reads the lines starting in (B_k, B_k+1], where the boundaries are first aligned to
+  // the next block in the compressed file. The first shard also includes the line at its start.
+  TabixLineReader(const fs::path &path, VirtualOffset start, size_t shard, size_t num_shards)
+      : path_(path), reader_(path, 1), index_(nullptr, &tbx_destroy), chunk_(0) {
+    int64_t address = start >> 16, size = static_cast<int64_t>(fs::file_size(path));
+    auto Boundary = [&](size_t s) {
+      int64_t nominal =
+          address + (size - address) * static_cast<int64_t>(s) / static_cast<int64_t>(num_shards);
+      return std::max(static_cast<VirtualOffset>(reader_.FindBlock(nominal, size)) << 16, start);
+    };
+
+    if (shard + 1 < num_shards) end_ = Boundary(shard + 1);
+    if (shard == 0) {
+      reader_.Seek(start);
+    } else {
+      reader_.Seek(Boundary(shard));
+      reader_.ReadLine();  // Partial line (or line at boundary) belongs to the previous shard
+    }
+  }
+
+  NextResult ReadNextRegionLine() {
+    while (chunk_ < chunks_.size()) {
+      if (reader_.Tell() >= chunks_[chunk_].v) {
+        // Move to the next chunk, only seeking if the chunks are not adjacent
+        if (++chunk_ == chunks_.size()) break;
+        if (reader_.Tell() != chunks_[chunk_].u)
+          reader_.Seek(chunks_[chunk_].u, chunks_[chunk_].v);
+        else
+          reader_.SetLimit(chunks_[chunk_].v);
+        continue;
+      }
+
+      auto line = reader_.ReadLine();
+      if (!line) break;
+
+      Interval intv;
+      if (!ParseInterval(*line, intv)) {
+        throw file_parse_error() << error_message("could not parse interval for indexed line");
+      }
+
+      // Lines are sorted by contig and start so we can skip targets that end before this line
+      while (target_ < targets_.size() && (targets_[target_].tid < intv.tid ||
+                                           (targets_[target_].tid == intv.tid &&
+                                            targets_[target_].end <= intv.beg))) {
+        ++target_;
+      }
+      if (target_ == targets_.size()) break;  // Past all of the targets, no need to proceed
+
+      for (size_t t = target_; t < targets_.size() && targets_[t].tid == intv.tid &&
+                               targets_[t].beg < intv.end;
+           ++t) {
+        if (targets_[t].end > intv.beg) return line;
+      }
+    }
+
+    chunks_.clear();
+    return NextResult();
+  }
+
+  void SetTargets(std::vector<Interval> &&targets) {
+    // Sort and merge overlapping (or adjacent) targets
+    std::sort(targets.begin(), targets.end(), [](const Interval &a, const Interval &b) {
+      return a.tid < b.tid || (a.tid == b.tid && a.beg < b.beg);
+    });
+    targets_.clear();
+    for (auto &target : targets) {
+      if (!targets_.empty() && targets_.back().tid == target.tid &&
+          target.beg <= targets_.back().end) {
+        targets_.back().end = std::max(targets_.back().end, target.end);
+      } else {
+        targets_.push_back(target);
+      }
+    }
+
+    // Extract the chunks of the file that could overlap the targets, we read the chunks directly
+    // so that decompression can be performed ahead of parsing by the BGZF reader
+    chunks_.clear();
+    for (auto &target : targets_) {
+      std::unique_ptr<hts_itr_t, decltype(&hts_itr_destroy)> iter(
+          tbx_itr_queryi(index_.get(), target.tid, target.beg, target.end), &hts_itr_destroy);
+      if (!iter) {
+        throw invalid_argument() << error_message("invalid region");
+      }
+      chunks_.insert(chunks_.end(), iter->off, iter->off + iter->n_off);
+    }
+
+    // Coalesce chunks that overlap or are separated by less than a block so that each block is
+    // read (and decompressed) once. Any lines in the gaps are filtered by the target test.
+    std::sort(chunks_.begin(), chunks_.end(),
+              [](const hts_pair64_t &a, const hts_pair64_t &b) { return a.u < b.u; });
+    size_t merged = 0;
+    for (size_t i = 1; i < chunks_.size(); i++) {
+      if ((chunks_[i].u >> 16) <= (chunks_[merged].v >> 16) + kCoalesceDistance) {
+        chunks_[merged].v = std::max(chunks_[merged].v, chunks_[i].v);
+      } else {
+        chunks_[++merged] = chunks_[i];
+      }
+    }
+    if (!chunks_.empty()) chunks_.resize(merged + 1);
+
+    chunk_ = 0;
+    target_ = 0;
+    region_ = true;
+    if (!chunks_.empty()) reader_.Seek(chunks_.front().u, chunks_.front().v);
+  }
+
+  bool ParseInterval(const Line &line, Interval &intv) {
+    TabixInterval parsed;
+    if (!ParseTabixInterval(index_->conf, line, parsed)) return false;
+    intv.beg = parsed.beg;
+    intv.end = parsed.end;
+
+    // Cache the contig id since successive lines are typically on the same contig
+    if (!boost::equals(parsed.contig, contig_)) {
+      contig_.assign(parsed.contig.begin(), parsed.contig.end());
+      contig_tid_ = tbx_name2id(index_.get(), contig_.c_str());
+    }
+    intv.tid = contig_tid_;
+    return true;
+  }
+
+  fs::path path_;
+  BGZFReader reader_;
   std::unique_ptr<tbx_t, decltype(&tbx_destroy)> index_;
-  std::unique_ptr<hts_itr_t, decltype(&hts_itr_destroy)> iter_;
-  kstring_t line_;
+  VirtualOffset end_ = BGZFReader::kNoLimit;  // Lines starting after end_ are in later shards
+
+  // Maximum distance (in compressed bytes) between chunks that will be read through
+  static const uint64_t kCoalesceDistance = 1 << 16;
+
+  bool region_ = false;
+  std::vector<Interval> targets_;
+  size_t target_;
+  std::vector<hts_pair64_t> chunks_;
+  size_t chunk_;
+
+  std::string contig_;
+  int contig_tid_ = -1;
 };
 
 }  // impl namespace
@@ -130,14 +402,58 @@ ASCIILineReaderInterface::FactoryResult ASCIILineReaderInterface::MakeLineReader
 }
 
 ASCIILineReaderInterface::FactoryResult ASCIILineReaderInterface::MakeLineReader(
-    const fs::path &path) {
+    const fs::path &path, size_t threads) {
   if (!fs::exists(path)) {  // Catch a common error case
     throw file_parse_error() << error_message("input file does not exist");
   }
   if (path.extension() == ".gz")
-    return std::make_unique<impl::TabixLineReader>(path);
+    return std::make_unique<impl::TabixLineReader>(path, threads);
+  else if (fs::is_regular_file(path))
+    return std::make_unique<impl::MappedLineReader>(path);
   else
     return std::make_unique<impl::ASCIIStreamLineReader>(path);
 }
+
+model::Regions ReadBEDRegions(ASCIILineReaderInterface &reader) {
+  model::Regions regions;
+  while (auto line = reader.ReadNextLine()) {
+    if (line->empty() || boost::starts_with(*line, "#") || boost::starts_with(*line, "track") ||
+        boost::starts_with(*line, "browser"))
+      continue;
+
+    const char *b = line->begin(), *e = line->end();
+    auto NextField = [&]() {
+      auto field_end = static_cast<const char *>(memchr(b, '\t', e - b));
+      return field_end ? field_end : e;
+    };
+    auto ParseCoordinate = [&](const char *field_end) {
+      model::Pos value;
+      if (b == e || !impl::ParseInteger(b, field_end, value) || b != field_end || value < 0) {
+        throw file_parse_error() << error_message(
+            fmt::format("invalid BED coordinate in line: {}", std::string(line->begin(), e)));
+      }
+      return value;
+    };
+
+    const char *chrom_end = NextField();
+    if (chrom_end == e) {
+      throw file_parse_error() << error_message("BED file must have at least three columns");
+    }
+    model::Contig contig(std::string(b, chrom_end));
+    b = chrom_end + 1;
+    model::Pos start = ParseCoordinate(NextField());
+    if (b == e) {
+      throw file_parse_error() << error_message("BED file must have at least three columns");
+    }
+    b++;
+    model::Pos end = ParseCoordinate(NextField());
+    if (end < start) {
+      throw file_parse_error() << error_message(
+          fmt::format("BED region ends before it starts: {}", std::string(line->begin(), e)));
+    }
+    regions.emplace_back(contig, start + 1, end);
+  }
+  return regions;
+}
 }  // io namespace
 }  // aseq namespace
\ No newline at end of file
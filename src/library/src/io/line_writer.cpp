@@ -2,18 +2,24 @@
 // Created by Michael Linderman on 12/16/15.
 //
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
 #include <ostream>
-#include <fstream>
+#include <thread>
 
 #include <boost/filesystem.hpp>
 #include <glog/logging.h>
 #include <cppformat/format.h>
-#include <htslib/hts.h>
-#include <htslib/bgzf.h>
 #include <htslib/tbx.h>
 
 #include "aseq/util/exception.hpp"
 #include "aseq/io/line.hpp"
+#include "bgzf.hpp"
+#include "tabix.hpp"
 
 using namespace aseq::util;
 namespace fs = boost::filesystem;
@@ -29,52 +35,234 @@ class ASCIIStreamLineWriter : public ASCIILineWriterInterface {
 
   explicit ASCIIStreamLineWriter(std::ostream &ostream) : ostream_(ostream) {}
 
-  explicit ASCIIStreamLineWriter(const fs::path &path)
-      : owned_ostream_(std::make_unique<std::ofstream>(path.native())), ostream_(*owned_ostream_) {}
-
-  virtual void Write(const Line &line) { ostream_ << line; }
+  virtual void Write(const Line &line) { ostream_.write(line.begin(), line.size()); }
 
  private:
-  std::unique_ptr<std::ostream> owned_ostream_;
   std::ostream &ostream_;
 };
 
-class BGZipLineWriter : public ASCIILineWriterInterface {
+// Lines are collected into large blocks that are each written with a single write, instead of a
+// write per line. Blocks written to a file descriptor are double-buffered: a full block is written
+// on a background thread while the next block is filled. Blocks written to a stream are written
+// synchronously through its stream buffer, so that they are ordered with any other output to the
+// stream (and respect redirection of the stream buffer).
+class ASCIIBufferedLineWriter : public ASCIILineWriterInterface {
  public:
-  BGZipLineWriter() = delete;
+  static const size_t kBlockSize = 4 << 20;
+
+  ASCIIBufferedLineWriter() = delete;
+
+  explicit ASCIIBufferedLineWriter(std::ostream &ostream) : ostream_(&ostream) { Start(); }
 
-  BGZipLineWriter(const fs::path &path, FileFormat format)
-      : file_(nullptr, &hts_close), format_(format) {
-    file_.reset(hts_open(path.c_str(), "wz"));
-    if (!file_) {
-      throw file_write_error() << error_message("could not open tabix file for writing");
+  // Write directly to file descriptor fd, closing it on destruction if owned
+  ASCIIBufferedLineWriter(int fd, bool owned) : fd_(fd), owned_(owned) { Start(); }
+
+  ~ASCIIBufferedLineWriter() {
+    try {
+      Flush();
+    } catch (std::exception &e) {
+      LOG(ERROR) << e.what();
+    }
+    if (thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      changed_.notify_all();
+      thread_.join();
     }
+    if (owned_) ::close(fd_);
   }
-  ~BGZipLineWriter() {
-    tbx_conf_t const *conf = nullptr;
-    switch (format_) {
+
+  virtual void Write(const Line &line) override {
+    buffer_.append(line.begin(), line.end());
+    Commit();
+  }
+
+  virtual std::string *buffer() override { return &buffer_; }
+
+  virtual void Commit() override {
+    if (buffer_.size() >= kBlockSize) Submit();
+  }
+
+  virtual void Flush() override {
+    Submit();
+    if (ostream_) {
+      bool good = ostream_->good();  // Only report errors once
+      if (!ostream_->flush() && good) {
+        throw file_write_error() << error_message("could not write to output stream");
+      }
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return !writing_; });
+    RethrowError();
+  }
+
+ private:
+  void Start() {
+    // Reserve room for the line that fills the block
+    buffer_.reserve(kBlockSize + kBlockSize / 4);
+    if (!ostream_) {
+      block_.reserve(kBlockSize + kBlockSize / 4);
+      thread_ = std::thread([this] { Run(); });
+    }
+  }
+
+  // Write the buffer to the stream, or hand it off to be written after the previous block has been
+  // written to the file descriptor
+  void Submit() {
+    if (buffer_.empty()) return;
+    if (ostream_) {
+      WriteBlock(buffer_.data(), buffer_.size());
+      buffer_.clear();
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this] { return !writing_; });
+      RethrowError();
+      std::swap(buffer_, block_);
+      writing_ = true;
+    }
+    changed_.notify_all();
+    buffer_.clear();  // Retains the capacity of the previous block
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      changed_.wait(lock, [this] { return stop_ || writing_; });
+      if (!writing_) return;  // Only reachable when stop_ is set
+
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        WriteBlock(block_.data(), block_.size());
+      } catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+
+      if (error && !error_) error_ = error;  // Report the first error
+      writing_ = false;
+      changed_.notify_all();
+    }
+  }
+
+  void WriteBlock(const char *data, size_t size) {
+    if (ostream_) {
+      auto count = static_cast<std::streamsize>(size);
+      if (ostream_->rdbuf()->sputn(data, count) != count) {
+        ostream_->setstate(std::ios_base::badbit);
+        throw file_write_error() << error_message("could not write to output stream");
+      }
+      return;
+    }
+    while (size > 0) {
+      auto written = ::write(fd_, data, size);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        throw file_write_error() << error_message(
+            fmt::format("could not write to output file: {}", strerror(errno)));
+      }
+      data += written;
+      size -= written;
+    }
+  }
+
+  // Must be invoked with the mutex held
+  void RethrowError() {
+    if (error_) {
+      auto error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+  std::ostream *ostream_ = nullptr;
+  int fd_ = -1;
+  bool owned_ = false;
+
+  std::string buffer_;  // Filled by the caller
+  std::string block_;   // Written in the background
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool stop_ = false, writing_ = false;
+  std::exception_ptr error_;
+  std::thread thread_;
+};
+
+class BGZipLineWriter : public ASCIILineWriterInterface {
+ public:
+  BGZipLineWriter() = delete;
+
+  BGZipLineWriter(const fs::path &path, FileFormat format, size_t threads) : path_(path) {
+    switch (format) {
       default:
         break;
       case FileFormat::VCF4_1:
       case FileFormat::VCF4_2:
-        conf = &tbx_conf_vcf;
+        index_ = std::make_unique<TabixIndexBuilder>(tbx_conf_vcf);
     }
-    if (conf) {
-      fs::path path(file_->fn);
-      file_.reset(nullptr);  // Force closure of file
-      if (!fs::exists(path) || tbx_index_build(path.c_str(), 0, conf) != 0) {
-        throw file_write_error() << error_message("could not generate tabix index");
-      }
+
+    // Build the index as blocks are written (instead of re-reading the file after it is closed)
+    BGZFWriter::Callback written;
+    if (index_) {
+      written = [this](const BGZFWriter::BlockAddress &block) { index_->Resolve(block); };
+    }
+    file_ = std::make_unique<BGZFWriter>(path, threads, written);
+  }
+
+  ~BGZipLineWriter() {
+    try {
+      Close();
+    } catch (std::exception &e) {
+      LOG(ERROR) << e.what();
     }
   }
 
   virtual void Write(const Line &line) {
-    bgzf_write(file_->fp.bgzf, line.begin(), line.end() - line.begin());
+    if (index_) IndexLines(line);
+    file_->Write(line.begin(), line.size());
+  }
+
+  virtual void Close() override {
+    if (closed_) return;
+    closed_ = true;  // Only attempt to close once, even if closing fails
+    if (index_ && !partial_.empty()) {
+      index_->Push(boost::make_iterator_range(partial_.data(), partial_.data() + partial_.size()),
+                   file_->Tell());
+    }
+    auto end = file_->Close();
+    if (index_) index_->Save(path_, end);
   }
 
  private:
-  std::unique_ptr<htsFile, decltype(&hts_close)> file_;
-  FileFormat format_;
+  void IndexLines(const Line &line) {
+    uint64_t offset = file_->Tell();
+    auto begin = line.begin();
+    while (auto newline = static_cast<const char *>(memchr(begin, '\n', line.end() - begin))) {
+      auto end = offset + (newline - line.begin()) + 1;
+      if (partial_.empty()) {
+        index_->Push(boost::make_iterator_range(begin, newline), end);
+      } else {
+        partial_.append(begin, newline);
+        index_->Push(boost::make_iterator_range(partial_.data(), partial_.data() + partial_.size()),
+                     end);
+        partial_.clear();
+      }
+      begin = newline + 1;
+    }
+    partial_.append(begin, line.end());
+  }
+
+  fs::path path_;
+  std::unique_ptr<TabixIndexBuilder> index_;
+  std::unique_ptr<BGZFWriter> file_;
+  std::string partial_;
+  bool closed_ = false;
 };
 
 }  // namespace impl
@@ -84,14 +272,25 @@ ASCIILineWriterInterface::FactoryResult ASCIILineWriterInterface::MakeLineWriter
   return FactoryResult(new impl::ASCIIStreamLineWriter(ostream));
 }
 
+ASCIILineWriterInterface::FactoryResult ASCIILineWriterInterface::MakeBufferedLineWriter(
+    std::ostream &ostream) {
+  return std::make_unique<impl::ASCIIBufferedLineWriter>(ostream);
+}
+
 ASCIILineWriterInterface::FactoryResult ASCIILineWriterInterface::MakeLineWriter(
-    const fs::path &path, FileFormat format) {
+    const fs::path &path, FileFormat format, size_t threads) {
   LOG_IF(INFO, fs::exists(path)) << fmt::format("Overwriting existing file {}", path.native());
 
-  if (path.extension() == ".gz")
-    return std::make_unique<impl::BGZipLineWriter>(path, format);
-  else
-    return std::make_unique<impl::ASCIIStreamLineWriter>(path);
+  if (path.extension() == ".gz") {
+    return std::make_unique<impl::BGZipLineWriter>(path, format, threads);
+  } else {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+      throw file_write_error() << error_message(
+          fmt::format("could not open {} for writing: {}", path.native(), strerror(errno)));
+    }
+    return std::make_unique<impl::ASCIIBufferedLineWriter>(fd, true);
+  }
 }
 }  // namespace io
 }  // namespace aseq
\ No newline at end of file
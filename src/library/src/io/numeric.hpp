@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace aseq {
+namespace io {
+namespace impl {
+
+// Fast parsers for the numeric VCF fields (POS, QUAL, and Integer and Float attributes). Each
+// parser consumes the longest valid prefix of [begin, end), advancing begin, and returns false
+// (leaving begin unchanged) if there isn't a valid number at begin.
+
+namespace numeric {
+
+// Exact (bitwise) comparison of floats, e.g. to check that a formatted value round-trips
+inline bool SameFloat(float a, float b) { return memcmp(&a, &b, sizeof(float)) == 0; }
+
+inline bool IsDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// SWAR (SIMD within a register) conversion of 8 ASCII digits at once, e.g. for POS values
+inline bool IsEightDigits(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return (((v & 0xF0F0F0F0F0F0F0F0) | (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+          0x3333333333333333);
+}
+
+inline uint64_t ParseEightDigits(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  v -= 0x3030303030303030;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+       (((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >>
+      32;
+  return v;
+}
+#else
+inline bool IsEightDigits(const char*) { return false; }
+inline uint64_t ParseEightDigits(const char*) { return 0; }
+#endif
+
+// Accumulate up to max digits (19 digits can't overflow), returning the number of digits consumed
+inline size_t ParseDigits(const char*& p, const char* end, uint64_t& value, ptrdiff_t max = 19) {
+  const char* begin = p;
+  while (end - p >= 8 && p - begin <= max - 8 && IsEightDigits(p)) {
+    value = value * 100000000 + ParseEightDigits(p);
+    p += 8;
+  }
+  while (p != end && p - begin < max && IsDigit(*p)) {
+    value = value * 10 + static_cast<uint64_t>(*p - '0');
+    ++p;
+  }
+  return static_cast<size_t>(p - begin);
+}
+
+// Exactly representable powers of 10
+const double kPowersOf10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                              1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                              1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Pairs of ASCII digits "00" to "99", to format two digits at a time
+const char kDigitPairs[] =
+    "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546"
+    "4748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293"
+    "949596979899";
+
+// Write the digits of value ending at end (i.e. right-to-left), returning the first digit
+inline char* FormatDigits(char* end, uint64_t value) {
+  while (value >= 100) {
+    auto pair = kDigitPairs + (value % 100) * 2;
+    value /= 100;
+    *--end = pair[1];
+    *--end = pair[0];
+  }
+  if (value >= 10) {
+    auto pair = kDigitPairs + value * 2;
+    *--end = pair[1];
+    *--end = pair[0];
+  } else {
+    *--end = static_cast<char>('0' + value);
+  }
+  return end;
+}
+}  // namespace numeric
+
+template <typename T>
+bool ParseInteger(const char*& begin, const char* end, T& value) {
+  const char* p = begin;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  uint64_t magnitude = 0;
+  size_t digits = numeric::ParseDigits(p, end, magnitude);
+  if (digits == 0 || (p != end && numeric::IsDigit(*p))) return false;  // Empty or overflow
+
+  typedef std::numeric_limits<T> limits;
+  if (negative) {
+    if (magnitude > static_cast<uint64_t>(limits::max()) + 1) return false;
+    value = static_cast<T>(-static_cast<int64_t>(magnitude));
+  } else {
+    if (magnitude > static_cast<uint64_t>(limits::max())) return false;
+    value = static_cast<T>(magnitude);
+  }
+  begin = p;
+  return true;
+}
+
+inline bool ParseFloat(const char*& begin, const char* end, float& value) {
+  using numeric::IsDigit;
+
+  const char* p = begin;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  auto digits = numeric::ParseDigits(p, end, mantissa);
+  bool exact = p == end || !IsDigit(*p);
+  while (p != end && IsDigit(*p)) {  // Digits beyond the precision of the mantissa
+    ++exponent;
+    ++p;
+  }
+  if (p != end && *p == '.') {
+    ++p;
+    const char* fraction = p;
+    if (exact) {
+      numeric::ParseDigits(p, end, mantissa, 19 - static_cast<ptrdiff_t>(digits));
+      exponent -= static_cast<int>(p - fraction);
+      exact = p == end || !IsDigit(*p);
+    }
+    while (p != end && IsDigit(*p)) ++p;
+    digits += static_cast<size_t>(p - fraction);
+  }
+  if (digits == 0) return false;
+
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    const char* e = p + 1;
+    int explicit_exponent = 0;
+    if (ParseInteger(e, end, explicit_exponent)) {
+      exponent += explicit_exponent;
+      p = e;
+    }
+  }
+
+  if (exact && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+    // Fast path, the result of a single operation on exact values is correctly rounded
+    double v = static_cast<double>(mantissa);
+    v = (exponent < 0) ? v / numeric::kPowersOf10[-exponent] : v * numeric::kPowersOf10[exponent];
+    value = static_cast<float>(negative ? -v : v);
+  } else {
+    value = std::strtof(std::string(begin, p).c_str(), nullptr);
+  }
+  begin = p;
+  return true;
+}
+
+// Fast formatters for the numeric VCF fields that append the value to a (reused) buffer
+
+template <typename T>
+void AppendInteger(std::string& buffer, T value) {
+  char digits[24], *end = digits + sizeof(digits);
+  char* begin;
+  if (value < 0) {
+    begin = numeric::FormatDigits(end, -static_cast<uint64_t>(value));
+    *--begin = '-';
+  } else {
+    begin = numeric::FormatDigits(end, static_cast<uint64_t>(value));
+  }
+  buffer.append(begin, end);
+}
+
+// Floats are written with the fewest digits that parse to the same value, with at least one
+// fractional digit in fixed notation, e.g. 100.0 or 0.25, and in scientific notation if very large
+// or small or more than 3 fractional digits are required, e.g. 1e+30
+inline void AppendFloat(std::string& buffer, float value) {
+  if (std::isnan(value)) {
+    buffer.append("nan");
+    return;
+  }
+  if (std::signbit(value)) buffer.push_back('-');
+  float magnitude = std::fabs(value);
+  if (std::isinf(magnitude)) {
+    buffer.append("inf");
+    return;
+  }
+
+  // Fast path, the values with a short fixed representation that round-trips through ParseFloat
+  if (magnitude < 1e9f) {
+    for (int places = 1; places <= 3; places++) {
+      double scale = numeric::kPowersOf10[places];
+      double scaled = std::nearbyint(magnitude * scale);
+      if (numeric::SameFloat(static_cast<float>(scaled / scale), magnitude)) {
+        char digits[24], *end = digits + sizeof(digits);
+        char* begin = numeric::FormatDigits(end, static_cast<uint64_t>(scaled));
+        while (end - begin <= places) *--begin = '0';  // Leading zero, e.g. 0.25
+        buffer.append(begin, end - places);
+        buffer.push_back('.');
+        buffer.append(end - places, end);
+        return;
+      }
+    }
+  }
+
+  char digits[32];
+  for (int precision = 6;; precision++) {  // 9 significant digits always round-trips
+    snprintf(digits, sizeof(digits), "%.*g", precision, magnitude);
+    if (precision == std::numeric_limits<float>::max_digits10 ||
+        numeric::SameFloat(std::strtof(digits, nullptr), magnitude))
+      break;
+  }
+  buffer.append(digits);
+}
+
+}  // namespace impl
+}  // namespace io
+}  // namespace aseq
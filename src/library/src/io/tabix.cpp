@@ -0,0 +1,155 @@
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <cppformat/format.h>
+
+#include "aseq/util/exception.hpp"
+#include "tabix.hpp"
+
+using namespace aseq::util;
+namespace fs = boost::filesystem;
+
+namespace aseq {
+namespace io {
+namespace impl {
+
+namespace {
+const int kMinShift = 14;
+const int kLevels = 5;
+
+bool ParseInt(const char* begin, const char* end, int& value) {
+  if (begin == end) return false;
+  value = 0;
+  for (; begin != end && isdigit(*begin); ++begin) value = value * 10 + (*begin - '0');
+  return true;
+}
+
+void PackInt32(std::vector<uint8_t>& buffer, uint32_t value) {
+  for (int i = 0; i < 4; i++) buffer.push_back((value >> (8 * i)) & 0xFF);
+}
+}
+
+bool ParseTabixInterval(const tbx_conf_t& conf, const Line& line, TabixInterval& intv) {
+  intv.contig = Line();
+  intv.beg = intv.end = -1;
+
+  int id = 1;
+  for (const char *b = line.begin(), *i = line.begin(); i <= line.end(); ++i) {
+    if (i != line.end() && *i != '\t') continue;
+    if (id == conf.sc) {
+      intv.contig = Line(b, i);
+    } else if (id == conf.bc) {
+      if (!ParseInt(b, i, intv.beg)) return false;
+      intv.end = intv.beg;
+      if (!(conf.preset & TBX_UCSC))
+        --intv.beg;
+      else
+        ++intv.end;
+      intv.beg = std::max(intv.beg, 0);
+      intv.end = std::max(intv.end, 1);
+    } else if ((conf.preset & 0xffff) == TBX_GENERIC && id == conf.ec) {
+      if (!ParseInt(b, i, intv.end)) return false;
+    } else if ((conf.preset & 0xffff) == TBX_VCF) {
+      if (id == 4 && b < i) {
+        intv.end = intv.beg + static_cast<int>(i - b);
+      } else if (id == 8) {
+        static const char kEnd[] = "END=";
+        for (auto s = std::search(b, i, kEnd, kEnd + 4); s != i;
+             s = std::search(s + 1, i, kEnd, kEnd + 4)) {
+          if (s == b || *(s - 1) == ';') {
+            ParseInt(s + 4, i, intv.end);
+            break;
+          }
+        }
+      }
+    }
+    b = i + 1;
+    ++id;
+  }
+  return !intv.contig.empty() && intv.beg >= 0 && intv.end >= 0;
+}
+
+TabixIndexBuilder::TabixIndexBuilder(const tbx_conf_t& conf)
+    : conf_(conf), index_(nullptr), lines_(0), last_offset_(0) {}
+
+TabixIndexBuilder::~TabixIndexBuilder() {
+  if (index_) hts_idx_destroy(index_);
+}
+
+void TabixIndexBuilder::Push(const Line& line, uint64_t end) {
+  ++lines_;
+  if (lines_ <= conf_.line_skip || (!line.empty() && line.front() == conf_.meta_char)) {
+    pending_.push_back({-1, 0, 0, end});
+    return;
+  }
+
+  TabixInterval intv;
+  if (!ParseTabixInterval(conf_, line, intv)) {
+    throw file_write_error() << error_message(
+        fmt::format("could not parse interval for indexing at line {}", lines_));
+  }
+  auto contig = boost::copy_range<std::string>(intv.contig);
+  auto tid = tids_.emplace(contig, contigs_.size());
+  if (tid.second) contigs_.push_back(contig);
+
+  pending_.push_back({tid.first->second, intv.beg, intv.end, end});
+}
+
+void TabixIndexBuilder::Resolve(const BGZFWriter::BlockAddress& block) {
+  uint64_t block_end = block.begin + block.length;
+  while (!pending_.empty() && pending_.front().offset <= block_end) {
+    auto& entry = pending_.front();
+    // A line ending at the end of a block is reported as the start of the next block, as in htslib
+    VirtualOffset offset =
+        (entry.offset < block_end)
+            ? (static_cast<VirtualOffset>(block.address) << 16) | (entry.offset - block.begin)
+            : static_cast<VirtualOffset>(block.address + block.size) << 16;
+    Add(entry, offset);
+    pending_.pop_front();
+  }
+}
+
+void TabixIndexBuilder::Add(const Entry& entry, VirtualOffset offset) {
+  if (entry.tid < 0) {
+    last_offset_ = offset;
+    return;
+  }
+  if (!index_) {
+    index_ = hts_idx_init(0, HTS_FMT_TBI, last_offset_, kMinShift, kLevels);
+  }
+  if (hts_idx_push(index_, entry.tid, entry.beg, entry.end, offset, 1) < 0) {
+    throw file_write_error() << error_message("could not index unsorted file");
+  }
+}
+
+void TabixIndexBuilder::Save(const fs::path& path, VirtualOffset end) {
+  if (!pending_.empty()) {
+    throw file_write_error() << error_message("index lines not written to file");
+  }
+  if (!index_) {  // Empty file
+    index_ = hts_idx_init(0, HTS_FMT_TBI, last_offset_, kMinShift, kLevels);
+  }
+  hts_idx_finish(index_, end);
+
+  // Tabix meta-data is the configuration followed by the null-terminated contig names (see
+  // tbx_set_meta, which isn't exported by htslib)
+  std::vector<uint8_t> meta;
+  size_t names_length = 0;
+  for (auto& contig : contigs_) names_length += contig.size() + 1;
+  for (int32_t value : {conf_.preset, conf_.sc, conf_.bc, conf_.ec, conf_.meta_char,
+                        conf_.line_skip, static_cast<int32_t>(names_length)}) {
+    PackInt32(meta, value);
+  }
+  for (auto& contig : contigs_) {
+    meta.insert(meta.end(), contig.c_str(), contig.c_str() + contig.size() + 1);
+  }
+  hts_idx_set_meta(index_, static_cast<int>(meta.size()), meta.data(), 1);
+
+  if (hts_idx_save(index_, path.c_str(), HTS_FMT_TBI) != 0) {
+    throw file_write_error() << error_message("could not write tabix index");
+  }
+}
+
+}  // namespace impl
+}  // namespace io
+}  // namespace aseq
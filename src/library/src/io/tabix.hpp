@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <htslib/hts.h>
+#include <htslib/tbx.h>
+
+#include "aseq/io/line.hpp"
+#include "bgzf.hpp"
+
+namespace boost {
+namespace filesystem {
+
+class path;
+}
+}
+
+namespace aseq {
+namespace io {
+namespace impl {
+
+// Genomic interval for an indexed line (as 0-based, half-open coordinates). The contig is a
+// sub-range of that line.
+struct TabixInterval {
+  Line contig;
+  int beg, end;
+};
+
+// Port of tbx_parse1 (which is not exported by htslib) for the generic and VCF presets
+bool ParseTabixInterval(const tbx_conf_t& conf, const Line& line, TabixInterval& intv);
+
+// Build a tabix index incrementally as lines are written, instead of re-reading the file after it
+// is closed. Since the compressed address of a line isn't known until its block is compressed,
+// lines are recorded with their uncompressed offset and added to the index once resolved.
+class TabixIndexBuilder {
+ public:
+  explicit TabixIndexBuilder(const tbx_conf_t& conf);
+  ~TabixIndexBuilder();
+
+  // Add line (without newline) whose end, including the newline, is at the uncompressed offset
+  void Push(const Line& line, uint64_t end);
+
+  // Resolve virtual offsets for pushed lines once the block containing them has been written
+  void Resolve(const BGZFWriter::BlockAddress& block);
+
+  // Save index alongside path (i.e. path.tbi), end is the virtual offset of the end of the data
+  void Save(const boost::filesystem::path& path, VirtualOffset end);
+
+ private:
+  struct Entry {
+    int tid, beg, end;  // tid of -1 indicates a header line
+    uint64_t offset;
+  };
+
+  void Add(const Entry& entry, VirtualOffset offset);
+
+  tbx_conf_t conf_;
+  hts_idx_t* index_;
+  int64_t lines_;
+  VirtualOffset last_offset_;
+
+  std::deque<Entry> pending_;
+
+  std::unordered_map<std::string, int> tids_;
+  std::vector<std::string> contigs_;
+};
+
+}  // namespace impl
+}  // namespace io
+}  // namespace aseq
@@ -54,10 +54,15 @@ class VCFMergeSource : public VariantMergeSourceInterface {
                      std::back_inserter(merged_samples));
       header_.SetSamples(merged_samples.begin(), merged_samples.end());
     }
+    {  // Map the contig IDs of each source onto the merged contig dictionary
+      for (auto &entry : header1.contigs())
+        contig_ids1_.push_back(header_.contigs().Find(entry.contig));
+      for (auto &entry : header2.contigs())
+        contig_ids2_.push_back(header_.contigs().Find(entry.contig));
+    }
 
     // Initialize initial variants
-    variant1_ = source1_->NextVariant();
-    variant2_ = source2_->NextVariant();
+    NextVariants();
   }
 
   FileFormat file_format() const override { return header_.file_format(); }
@@ -70,69 +75,107 @@ class VCFMergeSource : public VariantMergeSourceInterface {
     source2_->SetRegion(contig, pos, end);
 
     // Need to reinitialize variants after setting region
-    variant1_ = source1_->NextVariant();
-    variant2_ = source2_->NextVariant();
+    NextVariants();
+  }
+
+  virtual void SetRegions(const model::Regions &regions) override {
+    source1_->SetRegions(regions);
+    source2_->SetRegions(regions);
+
+    // Need to reinitialize variants after setting regions
+    NextVariants();
   }
 
   virtual NextResult NextVariant() override {
-    if (variant1_ && !variant2_) {
-      return ModifyAndGetNext(variant1_, source1_, source1_label_, source2only_samples_);
-    } else if (!variant1_ && variant2_) {
-      return ModifyAndGetNext(variant2_, source2_, source2_label_, source1only_samples_);
-    } else if (variant1_ && variant2_) {
+    model::VariantContext variant;
+    return NextVariant(variant) ? NextResult(std::move(variant)) : NextResult();
+  }
+
+  virtual bool NextVariant(model::VariantContext &result) override {
+    // The result is swapped with the pending variant, and the caller's context is then reused for
+    // the next variant from that source
+    if (has_variant1_ && !has_variant2_) {
+      return ModifyAndGetNext(result, variant1_, has_variant1_, source1_, source1_label_,
+                              source2only_samples_);
+    } else if (!has_variant1_ && has_variant2_) {
+      return ModifyAndGetNext(result, variant2_, has_variant2_, source2_, source2_label_,
+                              source1only_samples_);
+    } else if (has_variant1_ && has_variant2_) {
       model::CompareVariants cmp;
       using result_type = model::CompareVariants::result_type;
-      switch (cmp(*variant1_, *variant2_)) {
+      switch (cmp(variant1_, variant2_)) {
         default:
           throw util::invalid_argument()
               << util::error_message("Merging multi-allelic variants is not supported");
         case result_type::EQUAL: {
-          model::VariantContext result = std::move(*variant1_);
+          std::swap(result, variant1_);
 
           {  // Set merged QUAL as the lesser of the defined QUALs
-            const auto &qual2 = variant2_->qual();
+            const auto &qual2 = variant2_.qual();
             if (qual2 && (!result.qual() || qual2 < result.qual())) result.SetQual(qual2);
           }
           // TODO: Merge FILT
 
-          MergeINFOAttributes(result.attributes(), std::move(variant2_->attributes()));
+          MergeINFOAttributes(result.attributes(), std::move(variant2_.attributes()));
           result.SetAttribute(source_key_, merged_label_);
 
-          result.MergeGenotypes(variant2_->genotypes());
+          result.MergeGenotypes(variant2_.genotypes());
 
-          variant1_ = source1_->NextVariant();
-          variant2_ = source2_->NextVariant();
-          return NextResult(std::move(result));
+          NextVariants();
+          return true;
         }
         case result_type::BEFORE:
-          return ModifyAndGetNext(variant1_, source1_, source1_label_, source2only_samples_);
+          return ModifyAndGetNext(result, variant1_, has_variant1_, source1_, source1_label_,
+                                  source2only_samples_);
         case result_type::AFTER:
-          return ModifyAndGetNext(variant2_, source2_, source2_label_, source1only_samples_);
+          return ModifyAndGetNext(result, variant2_, has_variant2_, source2_, source2_label_,
+                                  source1only_samples_);
       }
     } else
-      return NextResult();
+      return false;
   }
 
   static FactoryResult MakeMergeVariantSource(FactoryResult &&source1, FactoryResult &&source2);
 
  private:
   VariantSourceInterface::FactoryResult source1_, source2_;
-  NextResult variant1_, variant2_;
+  model::VariantContext variant1_, variant2_;
+  bool has_variant1_ = false, has_variant2_ = false;
   VCFHeader header_;
   std::vector<model::Sample> source1only_samples_, source2only_samples_;
+  std::vector<model::ContigID> contig_ids1_, contig_ids2_;  // Source to merged contig IDs
 
-  NextResult ModifyAndGetNext(NextResult &variant, VariantSourceInterface::FactoryResult &source,
-                              const SourceLabel &label,
-                              const std::vector<model::Sample> &no_call_samples) {
-    model::VariantContext result = std::move(*variant);
-    variant = source->NextVariant();
+  void NextVariants() {
+    has_variant1_ = ReadVariant(source1_, variant1_);
+    has_variant2_ = ReadVariant(source2_, variant2_);
+  }
+
+  bool ReadVariant(VariantSourceInterface::FactoryResult &source, model::VariantContext &variant) {
+    if (!source->NextVariant(variant)) return false;
+    // Variants are compared with their contig IDs, so they need to be in the merged dictionary
+    auto &contig_ids = (&source == &source1_) ? contig_ids1_ : contig_ids2_;
+    auto id = variant.contig_id();
+    if (id != model::kUnknownContigID && static_cast<size_t>(id) < contig_ids.size()) {
+      variant.set_contig_id(contig_ids[id]);
+    } else {
+      // The source didn't assign an ID (e.g. its header has no contig lines), look up by name
+      variant.set_contig_id(header_.contigs().Find(variant.contig()));
+    }
+    return true;
+  }
+
+  bool ModifyAndGetNext(model::VariantContext &result, model::VariantContext &variant,
+                        bool &has_variant, VariantSourceInterface::FactoryResult &source,
+                        const SourceLabel &label,
+                        const std::vector<model::Sample> &no_call_samples) {
+    std::swap(result, variant);
+    has_variant = ReadVariant(source, variant);
 
     result.SetAttribute(source_key_, label);
     for (auto &s : no_call_samples) {  // Add "no call" samples (from other source)
       result.AddGenotype(s, model::Genotype::kNone);
     }
-
-    return NextResult(std::move(result));
+    return true;
   }
 
   void MergeINFOAttributes(util::Attributes &dst, util::Attributes &&src) {
@@ -18,21 +18,21 @@ namespace io {
 namespace impl {
 
 VariantSinkInterface::FactoryResult MakeVariantSink(
-    FileFormat format, ASCIILineWriterInterface::FactoryResult&& writer) {
+    FileFormat format, ASCIILineWriterInterface::FactoryResult&& writer, size_t threads = 1) {
   switch (format) {
     default:
       LOG(INFO) << "UNKNOWN or unsupported file format specified, defaulting to VCF 4.2 output";
-      return MakeVariantSink(FileFormat::VCF4_2, std::move(writer));
+      return MakeVariantSink(FileFormat::VCF4_2, std::move(writer), threads);
     case FileFormat::VCF4_1:
     case FileFormat::VCF4_2:
       VCFHeader header(format);
-      return std::make_unique<VCFSink>(header, std::move(writer));
+      return std::make_unique<VCFSink>(header, std::move(writer), threads);
   }
 }
 
 VariantSinkInterface::FactoryResult MakeVariantSink(
     const VariantSourceInterface& source, ASCIILineWriterInterface::FactoryResult&& writer,
-    bool sites_only = false) {
+    bool sites_only = false, size_t threads = 1) {
   switch (source.file_format()) {
     default:
       throw file_write_error() << error_message("unsupported variant sink file format");
@@ -42,36 +42,39 @@ VariantSinkInterface::FactoryResult MakeVariantSink(
       if (sites_only) {
         VCFHeader new_header = vcf_header;
         new_header.SetSitesOnly();
-        return std::make_unique<VCFSink>(new_header, std::move(writer));
+        return std::make_unique<VCFSink>(new_header, std::move(writer), threads);
       } else
-        return std::make_unique<VCFSink>(vcf_header, std::move(writer));
+        return std::make_unique<VCFSink>(vcf_header, std::move(writer), threads);
   }
 }
 
 }  // impl namespace
 
 VariantSinkInterface::FactoryResult VariantSinkInterface::MakeVariantSink(FileFormat format,
-                                                                          std::ostream& ostream) {
-  auto writer = ASCIILineWriterInterface::MakeLineWriter(ostream);
-  return impl::MakeVariantSink(format, std::move(writer));
+                                                                          std::ostream& ostream,
+                                                                          size_t threads) {
+  auto writer = ASCIILineWriterInterface::MakeBufferedLineWriter(ostream);
+  return impl::MakeVariantSink(format, std::move(writer), threads);
 }
 
 VariantSinkInterface::FactoryResult VariantSinkInterface::MakeVariantSink(FileFormat format,
-                                                                          const fs::path& path) {
-  auto writer = ASCIILineWriterInterface::MakeLineWriter(path, format);
-  return impl::MakeVariantSink(format, std::move(writer));
+                                                                          const fs::path& path,
+                                                                          size_t threads) {
+  auto writer = ASCIILineWriterInterface::MakeLineWriter(path, format, threads);
+  return impl::MakeVariantSink(format, std::move(writer), threads);
 }
 
 VariantSinkInterface::FactoryResult VariantSinkInterface::MakeVariantSink(
-    const VariantSourceInterface& source, std::ostream& ostream, bool sites_only) {
-  auto writer = ASCIILineWriterInterface::MakeLineWriter(ostream);
-  return impl::MakeVariantSink(source, std::move(writer), sites_only);
+    const VariantSourceInterface& source, std::ostream& ostream, bool sites_only, size_t threads) {
+  auto writer = ASCIILineWriterInterface::MakeBufferedLineWriter(ostream);
+  return impl::MakeVariantSink(source, std::move(writer), sites_only, threads);
 }
 
 VariantSinkInterface::FactoryResult VariantSinkInterface::MakeVariantSink(
-    const VariantSourceInterface& source, const boost::filesystem::path& path, bool sites_only) {
-  auto writer = ASCIILineWriterInterface::MakeLineWriter(path, source.file_format());
-  return impl::MakeVariantSink(source, std::move(writer), sites_only);
+    const VariantSourceInterface& source, const boost::filesystem::path& path, bool sites_only,
+    size_t threads) {
+  auto writer = ASCIILineWriterInterface::MakeLineWriter(path, source.file_format(), threads);
+  return impl::MakeVariantSink(source, std::move(writer), sites_only, threads);
 }
 
 }  // io namespace
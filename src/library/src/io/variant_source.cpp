@@ -32,19 +32,26 @@ FileFormat DetectSourceType(const ASCIILineReaderInterface::FactoryResult& reade
 }
 
 VariantSourceInterface::FactoryResult VariantSourcePicker(
-    ASCIILineReaderInterface::FactoryResult reader) {
+    ASCIILineReaderInterface::FactoryResult reader, size_t threads = 1) {
   FileFormat type = DetectSourceType(reader);
   switch (type) {
     default:
       throw file_parse_error() << error_message("unable to determine or unsupported file type");
     case FileFormat::VCF4_1:
     case FileFormat::VCF4_2:
-      return std::make_unique<VCFSource>(type, std::move(reader));
+      return std::make_unique<VCFSource>(type, std::move(reader), threads);
   }
 }
 
 }  // anonymous namespace
 
+bool VariantSourceInterface::NextVariant(model::VariantContext& variant) {
+  auto next = NextVariant();
+  if (!next) return false;
+  variant = std::move(*next);
+  return true;
+}
+
 VariantSourceInterface::FactoryResult VariantSourceInterface::MakeVariantSource(
     std::istream& istream) {
   auto reader = ASCIILineReaderInterface::MakeLineReader(istream);
@@ -52,9 +59,9 @@ VariantSourceInterface::FactoryResult VariantSourceInterface::MakeVariantSource(
 }
 
 VariantSourceInterface::FactoryResult VariantSourceInterface::MakeVariantSource(
-    const boost::filesystem::path& path) {
+    const boost::filesystem::path& path, size_t threads) {
   if (path == "-") return MakeVariantSource(std::cin);
-  return VariantSourcePicker(ASCIILineReaderInterface::MakeLineReader(path));
+  return VariantSourcePicker(ASCIILineReaderInterface::MakeLineReader(path, threads), threads);
 }
 
 }  // io namespace
@@ -40,13 +40,36 @@ VCFHeader &VCFHeader::AddFields(const VCFHeader &other) {
 
 #undef FIELD_COPY
 
+  // Contigs only in other are ordered after the existing contigs
+  for (auto& entry : other.contigs()) contigs_.Add(entry.contig, entry.length);
+
   return *this;
 }
 
+std::pair<VCFHeader::Field &, bool> VCFHeader::Fields::emplace(const key_type &key,
+                                                                const Field &field) {
+  auto r = index_.emplace(key, fields_.size());
+  if (r.second) fields_.push_back(field);
+  return std::pair<Field &, bool>(fields_[r.first->second], r.second);
+}
+
+VCFHeader::Field &VCFHeader::Fields::operator[](const key_type &key) {
+  return emplace(key, Field(key)).first;
+}
+
+const VCFHeader::Field &VCFHeader::Fields::at(const key_type &key) const {
+  return fields_[index_.at(key)];
+}
+
+VCFHeader::Fields::const_iterator VCFHeader::Fields::find(const key_type &key) const {
+  auto i = index_.find(key);
+  return i == index_.end() ? fields_.end() : fields_.begin() + i->second;
+}
+
 std::pair<const VCFHeader::Field &, bool> VCFHeader::AddField(VCFHeader::Fields &fields,
                                                               const VCFHeader::Field &field) {
   auto r = fields.emplace(field.id_, field);
-  return std::make_pair(r.first->second, r.second);
+  return std::pair<const Field &, bool>(r.first, r.second);
 }
 
 bool VCFHeader::HasField(const Fields &fields, const Fields::key_type &key) {
@@ -2,6 +2,7 @@
 // Created by Michael Linderman on 12/16/15.
 //
 #define BOOST_SPIRIT_USE_PHOENIX_V3 1
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/fusion/include/adapt_struct.hpp>
 #include <boost/fusion/include/std_pair.hpp>
 #include <boost/preprocessor/seq/for_each_i.hpp>
@@ -10,10 +11,22 @@
 #include <boost/spirit/include/phoenix.hpp>
 #include <boost/spirit/repository/include/karma_confix.hpp>
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
 #include <cppformat/format.h>
 #include <glog/logging.h>
 
 #include "aseq/io/vcf.hpp"
+#include "aseq/util/thread_pool.hpp"
+#include "numeric.hpp"
 #include "vcf_io.def"
 
 namespace km = boost::spirit::karma;
@@ -32,99 +45,8 @@ aseq::io::VCFHeader::Field,
 )
 
 #define ENUM_THEN_STRING(r, data, elem) (BOOST_PP_TUPLE_ELEM(2, 0, elem), BOOST_PP_TUPLE_ELEM(2, 1,elem))
-
-typedef fusion::vector<
-aseq::model::Contig const &,
-aseq::model::Pos,
-aseq::model::VariantContext::IDs const &,
-aseq::model::Allele const &,
-aseq::model::VariantContext::Alleles const &,
-aseq::model::VariantContext::Qual const &,
-aseq::model::VariantContext::Filters const &,
-aseq::util::Attributes const &
-> VariantContext2VCF;
-
 // clang-format on
 
-namespace boost {
-namespace spirit {
-namespace traits {
-
-namespace {
-
-template <typename Transformed>
-struct transform_hold_any {
-  typedef Transformed const &type;
-  static type pre(aseq::util::Attributes::mapped_type const &val) {
-    return aseq::util::any_cast<Transformed>(val);
-  }
-};
-}
-
-#define TRANSFORM(type)                                                                   \
-  template <>                                                                             \
-  struct transform_attribute<aseq::util::Attributes::mapped_type const, type, km::domain> \
-      : transform_hold_any<type> {};
-
-TRANSFORM(aseq::util::Attributes::Integer)
-TRANSFORM(aseq::util::Attributes::Integers)
-TRANSFORM(aseq::util::Attributes::Float)
-TRANSFORM(aseq::util::Attributes::Floats)
-TRANSFORM(aseq::util::Attributes::Character)
-TRANSFORM(aseq::util::Attributes::Characters)
-TRANSFORM(aseq::util::Attributes::Strings)
-TRANSFORM(aseq::model::VariantContext::Filters)
-
-#undef TRANSFORM
-
-template <>
-struct transform_attribute<aseq::model::VariantContext const, VariantContext2VCF, km::domain> {
-  typedef VariantContext2VCF type;
-  static type pre(aseq::model::VariantContext const &val) {
-    return type(val.contig(), val.pos(), val.ids(), val.ref(), val.alts(), val.qual(),
-                val.filters(), val.attributes());
-  }
-};
-template <>
-struct transform_attribute<aseq::model::Genotype::Alleles const, aseq::model::impl::PhasedIndices,
-                           km::domain> {
-  typedef aseq::model::impl::PhasedIndices const &type;
-  static type pre(aseq::model::Genotype::Alleles const &val) { return val.get(); }
-};
-
-template <>
-struct is_container<aseq::model::impl::PhasedIndices> : mpl::true_ {};
-
-template <>
-struct container_value<aseq::model::impl::PhasedIndices> {
-  typedef aseq::model::impl::PhasedIndices::Indices::value_type type;
-};
-
-template <>
-struct container_iterator<aseq::model::impl::PhasedIndices const> {
-  typedef aseq::model::impl::PhasedIndices::Indices::const_iterator type;
-};
-
-template <>
-struct begin_container<aseq::model::impl::PhasedIndices const> {
-  static aseq::model::impl::PhasedIndices::Indices::const_iterator call(
-      aseq::model::impl::PhasedIndices const &d) {
-    return d.indices_.begin();
-  }
-};
-
-template <>
-struct end_container<aseq::model::impl::PhasedIndices const> {
-  static aseq::model::impl::PhasedIndices::Indices::const_iterator call(
-      aseq::model::impl::PhasedIndices const &d) {
-    return d.indices_.end();
-  }
-};
-
-}  // namespace traits
-}  // namespace spirit
-}  // namespace boost
-
 namespace aseq {
 namespace io {
 namespace impl {
@@ -172,196 +94,483 @@ struct VCFHeaderGenerator {
   km::symbols<VCFHeader::Field::Number, const char *> field_number_;
 };
 
-template <typename Iterator>
-class VCFVariantGenerator : public VCFVariantGeneratorInterface {
+// Formatter that writes records directly into a reusable buffer according to an output plan
+// compiled from the header once, i.e. the writer for each INFO and FORMAT field, the FORMAT column
+// and the genotype for each header sample
+class VCFRecordFormatter : public VCFVariantGeneratorInterface {
  public:
-  VCFVariantGenerator() = delete;
-  VCFVariantGenerator(VCFHeader &header) : header_(header) {
-    using namespace km::labels;
-    using util::Attributes;
+  VCFRecordFormatter() = delete;
+  VCFRecordFormatter(const VCFHeader &header) : samples_(header.samples()) {
+    size_t position = 0;
+    for (auto &f : header.INFOValues()) {
+      SetWriter(info_writers_, f.id_, WriterFor(f));
+      if (f.id_.index() >= info_positions_.size())
+        info_positions_.resize(f.id_.index() + 1, size_t(kUndeclared));
+      info_positions_[f.id_.index()] = position++;
+    }
+
+    if (!samples_.empty()) {
+      // Write the FORMAT fields in the order they are declared in the header (GT is always first)
+      for (auto &f : header.FORMATValues()) {
+        if (f.id_ != VCFHeader::FORMAT::GT) format_fields_.emplace_back(f.id_, WriterFor(f));
+      }
+      format_column_ = "\tGT";
+      for (auto &f : format_fields_) format_column_.append(":").append(f.first.get());
 
-    for (auto f : header_.INFOValues()) {
-      info_keys_.emplace(f, GetGenerator(f));
+      genotype_indices_.resize(samples_.size());
+      for (size_t s = 0; s < samples_.size(); s++) genotype_indices_[s] = s;
     }
 
-    // clang-format off
-    auto sep = km::lit('\t');
-    auto missing = km::lit('.');
-
-    variant_  = variant_fixed_fields_(_val);
-    variant_fixed_fields_ =
-      chrom_                 << sep <<
-      pos_                   << sep <<
-      (id_        | missing) << sep <<
-      allele_                << sep <<
-      alt_(_r1)              << sep <<
-      (km::float_ | missing) << sep <<
-      (filter_    | missing) << sep <<
-      (info_      | missing);
-
-    chrom_  = km::string;
-    pos_    = km::int_generator<model::Pos,10,false>();
-    alt_    %= (
-      (allele_ % ',')
-      | missing
-    );
-
-    id_     = km::string % ';';
-    filter_ = km::string % ';';
-    info_   = info_entry_ % ';';
-
-    auto get_info_rule = phx::bind(&VCFVariantGenerator::KeyToRule, this, phx::ref(info_keys_), phx::at_c<0>(_val));
-    info_entry_ %= km::eps[_a = get_info_rule] <<
-            km::string << (km::eps(!_a) | (km::lit('=') << km::lazy(*_a)));
-
-    genotype_strings_.add
-            (model::Genotype::kNone, ".")
-            (model::Genotype::kNoCallNoCall, "./.")
-            (model::Genotype::kRefRef, "0/0")
-            (model::Genotype::kRefAlt, "0/1")
-            (model::Genotype::kAltAlt, "1|1")
-            (model::Genotype::kRefAltP, "0|1")
-            (model::Genotype::kAltRefP, "1|0")
-            ;
-
-
-    genotype_ = genotype_strings_ | genotype_alleles_(phx::bind(&AllelesToSep, _val)) | missing;
-    genotype_alleles_ =  genotype_allele_ % km::lit(_r1);
-    genotype_allele_  = km::int_;
-
-    auto is_val_empty = phx::bind(&util::Attributes::mapped_type::empty, phx::at_c<1>(_val));
-    sample_entry_ %= km::omit[km::int_] <<
-            km::lit(':') << (missing[_pass = is_val_empty] | km::lazy(*phx::at_c<0>(_val)));
-
-    allele_ = km::string;
-
-    // For unclear reasons, passing a single character to list generator, e.g. % ',',
-    // results in an unpredictable character being generated
-    integer_value_    = km::attr_cast<Attributes::mapped_type const &, Attributes::Integer>(km::int_);
-    integers_value_   = km::attr_cast<Attributes::mapped_type const &, Attributes::Integers>(km::int_ % ",");
-    float_value_      = km::attr_cast<Attributes::mapped_type const &, Attributes::Float>(km::float_);
-    floats_value_     = km::attr_cast<Attributes::mapped_type const &, Attributes::Floats>(km::float_ % ",");
-    character_value_  = km::attr_cast<Attributes::mapped_type const &, Attributes::Character>(km::char_);
-    characters_value_ = km::attr_cast<Attributes::mapped_type const &, Attributes::Characters>(km::char_ % ",");
-    string_value_     = km::stream;
-    strings_value_    = km::attr_cast<Attributes::mapped_type const &, Attributes::Strings>(km::string % ",");
-    filters_value_    = km::attr_cast<Attributes::mapped_type const &, model::VariantContext::Filters>(km::string % ';');
-    // clang-format on
+    using model::Genotype;
+    genotype_strings_ = {{Genotype::kNone, "."},      {Genotype::kNoCallNoCall, "./."},
+                         {Genotype::kRefRef, "0/0"},  {Genotype::kRefAlt, "0/1"},
+                         {Genotype::kAltAlt, "1|1"},  {Genotype::kRefAltP, "0|1"},
+                         {Genotype::kAltRefP, "1|0"}};
+  }
+
+  // Format the record, with a trailing newline, into the formatter's buffer
+  const std::string &FormatLine(const model::VariantContext &cxt) {
+    buffer_.clear();
+    Format(cxt, buffer_);
+    buffer_.push_back('\n');
+    return buffer_;
   }
 
-  bool Generate(Iterator &itr, const model::VariantContext &cxt) {
-    if (!km::generate(itr, variant_, cxt)) {
-      throw util::file_write_error();
+  void Format(const model::VariantContext &cxt, std::string &buffer) {
+    if (cxt.HasCleanRecord() && RecordCompatible(cxt)) {
+      // Unmodified variants are written as they were read
+      auto &record = cxt.source_record();
+      buffer.append(record.data(), record.size());
+      return;
     }
-    if (header_.NumSamples() > 0) {
-      std::vector<std::pair<util::Attributes::key_type, AttributeRule const *> > format_keys;
-
-      km::generate(itr, km::lit("\tGT"));
-      for (auto &f : header_.FORMATValues()) {
-        if (f.id_ != VCFHeader::FORMAT::GT) {
-          km::generate(itr, km::lit(":") << km::string, f.id_);
-          format_keys.emplace_back(f, GetGenerator(f));
-        }
+
+    buffer.append(cxt.contig().get()).push_back('\t');
+    AppendInteger(buffer, cxt.pos());
+    buffer.push_back('\t');
+    AppendList(buffer, cxt.ids(), ';', [](std::string &b, const std::string &id) { b.append(id); });
+    buffer.push_back('\t');
+    buffer.append(cxt.ref().data(), cxt.ref().size()).push_back('\t');
+    AppendList(buffer, cxt.alts(), ',', [](std::string &b, const model::Allele &allele) {
+      b.append(allele.data(), allele.size());
+    });
+    buffer.push_back('\t');
+    if (cxt.HasQual())
+      AppendFloat(buffer, *cxt.qual());
+    else
+      buffer.push_back('.');
+    buffer.push_back('\t');
+    AppendList(buffer, cxt.filters(), ';', AppendFilter);
+    buffer.push_back('\t');
+    // The attributes are stored in key index order, which depends on the order the keys were first
+    // used, so write the INFO fields in header order followed by any undeclared fields by name
+    info_.clear();
+    for (auto &a : cxt.attributes()) info_.push_back(&a);
+    std::sort(info_.begin(), info_.end(),
+              [this](const Attributes::value_type *l, const Attributes::value_type *r) {
+                size_t lp = InfoPosition(l->first), rp = InfoPosition(r->first);
+                return lp != rp ? lp < rp : l->first.get() < r->first.get();
+              });
+    AppendList(buffer, info_, ';',
+               [this](std::string &b, const Attributes::value_type *a) { AppendInfo(b, *a); });
+
+    if (samples_.empty()) return;
+    buffer.append(format_column_);
+    const auto &genotypes = cxt.genotypes();
+    for (size_t s = 0; s < samples_.size(); s++) {
+      buffer.push_back('\t');
+      const model::Genotype *gt = FindGenotype(cxt, genotypes, s);
+      if (!gt) {
+        buffer.push_back('.');
+        for (size_t f = 0; f < format_fields_.size(); f++) buffer.append(":.");
+        continue;
       }
 
-      for (size_t s = 0; s < header_.NumSamples(); s++) {
-        // TODO: Specify the OR here directly
-        const model::Genotype &gt = cxt.GetGenotypeOrNoCall(header_.sample(s));
-        km::generate(itr, km::lit('\t') << genotype_, gt.alleles());
-        for (auto &f : format_keys) {
-          km::generate(itr, sample_entry_, f.second,
-                       gt.GetAttributeOr(f.first, util::Attributes::mapped_type()));
-        }
+      AppendGenotype(buffer, gt->alleles());
+      auto &attrs = gt->attributes();
+      for (auto &f : format_fields_) {
+        buffer.push_back(':');
+        auto a = attrs.find(f.first);
+        if (a != attrs.end() && !a->second.empty())
+          AppendValue(buffer, f.second, a->second);
+        else
+          buffer.push_back('.');
       }
     }
-    return true;
   }
 
  private:
-  typedef km::rule<Iterator, util::Attributes::mapped_type const &()> AttributeRule;
-  typedef std::unordered_map<util::Attributes::key_type, AttributeRule const *> KeyToRuleMap;
-
-  const AttributeRule *KeyToRule(KeyToRuleMap &map, const util::Attributes::key_type &key) {
-    auto i = map.find(key);
-    if (i == map.end()) {
-      LOG(INFO) << fmt::format("Treating attribute {} as STRING", key);
-      std::tie(i, std::ignore) = map.emplace(key, &string_value_);
-    }
-    return i->second;
-  }
+  using Attributes = util::Attributes;
 
-  const AttributeRule *GetGenerator(const VCFHeader::Field &field) {
-#define TORULE(TYPE, SCALAR, VECTOR) \
-  case VCFHeader::Field::Type::TYPE: \
-    return (field.IsScalar()) ? SCALAR : VECTOR
+  enum class FieldWriter : uint8_t { UNKNOWN, VALUE, FLAG, FILTERS };
+  typedef std::pair<Attributes::key_type, FieldWriter> FormatField;
 
+  static FieldWriter WriterFor(const VCFHeader::Field &field) {
     switch (field.type_) {
-      default:
-        throw util::file_write_error()
-            << util::error_message(fmt::format("unsupported attribute type for {}", field));
       case VCFHeader::Field::Type::FLAG:
-        return nullptr;
+        return FieldWriter::FLAG;
       case VCFHeader::Field::Type::FILTER:
-        return &filters_value_;
-        TORULE(INTEGER, &integer_value_, &integers_value_);
-        TORULE(FLOAT, &float_value_, &floats_value_);
-        TORULE(CHARACTER, &character_value_, &characters_value_);
-        TORULE(STRING, &string_value_, &strings_value_);
+        return FieldWriter::FILTERS;
+      default:
+        return FieldWriter::VALUE;
     }
-#undef TORULE
   }
 
-  static char AllelesToSep(const model::Genotype::Alleles &alleles) {
-    return alleles.get().phased_ ? '|' : '/';
+  static void SetWriter(std::vector<FieldWriter> &writers, const Attributes::key_type &key,
+                        FieldWriter writer) {
+    if (key.index() >= writers.size()) writers.resize(key.index() + 1, FieldWriter::UNKNOWN);
+    writers[key.index()] = writer;
   }
 
-  km::rule<Iterator, model::VariantContext const &()> variant_;
-  km::rule<Iterator, VariantContext2VCF(const model::VariantContext &)> variant_fixed_fields_;
+  size_t InfoPosition(const Attributes::key_type &key) const {
+    return key.index() < info_positions_.size() ? info_positions_[key.index()] : kUndeclared;
+  }
 
-  km::rule<Iterator, model::Contig> chrom_;
-  km::rule<Iterator, model::Pos()> pos_;
-  km::rule<Iterator, model::VariantContext::Alleles const &(const model::VariantContext &)> alt_;
+  FieldWriter InfoWriter(const Attributes::key_type &key) {
+    if (key.index() < info_writers_.size() && info_writers_[key.index()] != FieldWriter::UNKNOWN)
+      return info_writers_[key.index()];
+    LOG(INFO) << fmt::format("Treating attribute {} as STRING", key);
+    SetWriter(info_writers_, key, FieldWriter::VALUE);
+    return FieldWriter::VALUE;
+  }
 
-  km::rule<Iterator, model::VariantContext::IDs const &()> id_;
-  km::rule<Iterator, model::VariantContext::Filters const &()> filter_;
-  km::rule<Iterator, util::Attributes const &()> info_;
-  km::rule<Iterator, util::Attributes::value_type const &(), km::locals<AttributeRule const *> >
-      info_entry_;
+  void AppendInfo(std::string &buffer, const Attributes::value_type &attr) {
+    buffer.append(attr.first.get());
+    auto writer = InfoWriter(attr.first);
+    if (writer != FieldWriter::FLAG) {
+      buffer.push_back('=');
+      AppendValue(buffer, writer, attr.second);
+    }
+  }
 
-  km::rule<Iterator, model::Genotype::Alleles const &()> genotype_;
-  km::rule<Iterator, model::impl::PhasedIndices const &(char)> genotype_alleles_;
-  km::rule<Iterator, model::AlleleIndex const &()> genotype_allele_;
-  km::symbols<model::Genotype::Alleles, const char *,
-              std::unordered_map<model::Genotype::Alleles, const char *> >
-      genotype_strings_;
+  template <typename Container, typename F>
+  static void AppendList(std::string &buffer, const Container &values, char sep, F append) {
+    if (values.empty()) {
+      buffer.push_back('.');
+      return;
+    }
+    auto i = values.begin();
+    append(buffer, *i);
+    for (++i; i != values.end(); ++i) {
+      buffer.push_back(sep);
+      append(buffer, *i);
+    }
+  }
 
-  km::rule<Iterator, fusion::vector<AttributeRule const *, util::Attributes::mapped_type const &> >
-      sample_entry_;
+  static void AppendFilter(std::string &buffer, const model::VariantContext::Filter &filter) {
+    buffer.append(filter.get());
+  }
 
-  km::rule<Iterator, model::Allele> allele_;
-  AttributeRule integer_value_, integers_value_, float_value_, floats_value_, character_value_,
-      characters_value_, string_value_, strings_value_, filters_value_;
+  template <typename Container>
+  static void AppendValues(std::string &buffer, const Container &values) {
+    for (auto i = values.begin(); i != values.end(); ++i) {
+      if (i != values.begin()) buffer.push_back(',');
+      AppendScalar(buffer, *i);
+    }
+  }
 
-  KeyToRuleMap info_keys_;
+  static void AppendScalar(std::string &buffer, Attributes::Integer value) {
+    AppendInteger(buffer, value);
+  }
+  static void AppendScalar(std::string &buffer, Attributes::Float value) {
+    AppendFloat(buffer, value);
+  }
+  static void AppendScalar(std::string &buffer, Attributes::Character value) {
+    buffer.push_back(value);
+  }
+  static void AppendScalar(std::string &buffer, const Attributes::String &value) {
+    buffer.append(value);
+  }
 
-  VCFHeader &header_;
-};
+  void AppendValue(std::string &buffer, FieldWriter writer, const Attributes::mapped_type &value) {
+    switch (value.type()) {
+      case util::AttributeType::EMPTY:
+        return;
+      case util::AttributeType::INTEGER:
+        return AppendScalar(buffer, value.cast<Attributes::Integer>());
+      case util::AttributeType::FLOAT:
+        return AppendScalar(buffer, value.cast<Attributes::Float>());
+      case util::AttributeType::CHARACTER:
+        return AppendScalar(buffer, value.cast<Attributes::Character>());
+      case util::AttributeType::STRING:
+        return AppendScalar(buffer, value.cast<Attributes::String>());
+      case util::AttributeType::INTEGERS:
+        return AppendValues(buffer, value.cast<Attributes::Integers>());
+      case util::AttributeType::FLOATS:
+        return AppendValues(buffer, value.cast<Attributes::Floats>());
+      case util::AttributeType::CHARACTERS:
+        return AppendValues(buffer, value.cast<Attributes::Characters>());
+      case util::AttributeType::STRINGS:
+        return AppendValues(buffer, value.cast<Attributes::Strings>());
+      default:
+        break;
+    }
 
-typedef VCFVariantGenerator<std::back_insert_iterator<std::string> > Generator;
+    auto filters = value.get_if<model::VariantContext::Filters>();
+    if (writer == FieldWriter::FILTERS && filters) {
+      AppendList(buffer, *filters, ';', AppendFilter);
+    } else {  // Uncommon types are written with their stream operator
+      stream_.str(std::string());
+      stream_ << value;
+      buffer.append(stream_.str());
+    }
+  }
 
-std::string GenerateVCFVariant(VCFHeader &header, const model::VariantContext &context) {
-  std::string line;
-  auto itr = std::back_inserter(line);
+  void AppendGenotype(std::string &buffer, const model::Genotype::Alleles &alleles) {
+    for (auto &g : genotype_strings_) {
+      if (alleles == g.first) {
+        buffer.append(g.second);
+        return;
+      }
+    }
+    auto &indices = alleles.get().indices_;
+    AppendList(buffer, indices, alleles.get().phased_ ? '|' : '/',
+               [](std::string &b, model::AlleleIndex index) {
+                 if (index == model::VariantContext::kNoCallIdx)
+                   b.push_back('.');
+                 else
+                   AppendInteger(b, index);
+               });
+  }
 
-  VCFVariantGenerator<decltype(itr)> gen(header);
-  gen.Generate(itr, context);
+  // The source record can be written in place of the context if it has the same sample columns
+  // and only FORMAT fields defined in the header (i.e. the output is consistent with the header).
+  // Records from the same source share their samples, and commonly their FORMAT, so both checks
+  // are cached.
+  bool RecordCompatible(const model::VariantContext &cxt) {
+    auto &samples = cxt.source_samples();
+    if (samples.get() != checked_samples_) {
+      checked_samples_ = samples.get();
+      samples_compatible_ = *samples == samples_;
+    }
+    if (!samples_compatible_) return false;
+    if (samples_.empty()) return true;
+
+    // FORMAT is the ninth column
+    auto &record = cxt.source_record();
+    const char *b = record.data(), *e = b + record.size();
+    for (int tabs = 0; tabs < 8 && b != e; ++b) {
+      if (*b == '\t') tabs++;
+    }
+    auto format_end = static_cast<const char *>(memchr(b, '\t', e - b));
+    if (!format_end) format_end = e;
+    if (!boost::equals(boost::make_iterator_range(b, format_end), checked_format_)) {
+      checked_format_.assign(b, format_end);
+      format_compatible_ = true;
+      for (const char *k = b; k < format_end;) {
+        auto colon = static_cast<const char *>(memchr(k, ':', format_end - k));
+        if (!colon) colon = format_end;
+        auto key = boost::make_iterator_range(k, colon);
+        format_compatible_ &=
+            boost::equals(key, VCFHeader::FORMAT::GT.id_.get()) ||
+            std::any_of(format_fields_.begin(), format_fields_.end(),
+                        [&](const FormatField &f) { return boost::equals(key, f.first.get()); });
+        k = colon + 1;
+      }
+    }
+    return format_compatible_;
+  }
+
+  // Genotypes are commonly in the same order as the header samples (or in the same order as the
+  // previous record), so check the previous position of the sample before searching
+  const model::Genotype *FindGenotype(const model::VariantContext &cxt,
+                                      const model::VariantContext::Genotypes &genotypes,
+                                      size_t s) {
+    size_t &index = genotype_indices_[s];
+    if (index < genotypes.size() && genotypes[index].sample() == samples_[s])
+      return &genotypes[index];
+    auto gt = cxt.FindGenotype(samples_[s]);
+    if (gt) index = gt - genotypes.data();
+    return gt;
+  }
 
+  VCFHeader::Samples samples_;
+  std::vector<FieldWriter> info_writers_;  // Indexed by key index
+  static const size_t kUndeclared = std::numeric_limits<size_t>::max();
+  std::vector<size_t> info_positions_;  // Position in the header, indexed by key index
+  std::vector<const Attributes::value_type *> info_;
+  std::string format_column_;
+  std::vector<FormatField> format_fields_;
+  std::vector<size_t> genotype_indices_;  // Position of each sample in the previous record
+  std::vector<std::pair<model::Genotype::Alleles, const char *> > genotype_strings_;
+
+  const VCFHeader::Samples *checked_samples_ = nullptr;
+  bool samples_compatible_ = false;
+  std::string checked_format_;
+  bool format_compatible_ = false;
+
+  std::string buffer_;
+  std::ostringstream stream_;
+};
+
+std::string GenerateVCFVariant(VCFHeader &header, const model::VariantContext &context) {
+  std::string line;
+  VCFRecordFormatter(header).Format(context, line);
   return line;
 }
 
 }  // namespace impl
 
-VCFSink::VCFSink(const VCFHeader &header, Writer &&writer)
+// Pushed variants are collected into batches that are formatted on a pool of workers, each with
+// its own formatter (since formatters cache per-record state). The formatted batches are written
+// in push order by a dedicated thread through a bounded queue.
+class VCFSink::Pipeline {
+ public:
+  Pipeline(const VCFHeader &header, ASCIILineWriterInterface &writer, size_t threads)
+      : writer_(writer), capacity_(kBatchesPerThread * threads), pool_(threads) {
+    for (size_t i = 0; i < threads; i++) {
+      formatters_.push_back(std::make_unique<impl::VCFRecordFormatter>(header));
+    }
+    pending_.reserve(kVariantsPerBatch);
+    thread_ = std::thread([this] { Write(); });
+  }
+
+  ~Pipeline() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+
+  void Push(model::VariantContext &&cxt) {
+    pending_.emplace_back(std::move(cxt));
+    if (pending_.size() == kVariantsPerBatch) Submit();
+  }
+
+  void Push(std::string &&line) {
+    pending_.emplace_back(std::move(line));
+    if (pending_.size() == kVariantsPerBatch) Submit();
+  }
+
+  void Flush() {
+    Submit();
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return queue_.empty() && !writing_; });
+    RethrowError();
+  }
+
+ private:
+  static const size_t kBatchesPerThread = 2, kVariantsPerBatch = 64;
+
+  // Variants are retained, or formatted by the caller (with a trailing newline) if pushed by
+  // reference
+  struct Entry {
+    Entry(model::VariantContext &&cxt) : variant(std::move(cxt)) {}
+    Entry(std::string &&l) : line(std::move(l)) {}
+
+    model::VariantContext variant;
+    std::string line;
+  };
+  typedef std::vector<Entry> Batch;
+
+  void Submit() {
+    if (pending_.empty()) return;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [this] { return error_ || queue_.size() < capacity_; });
+      RethrowError();
+    }
+
+    auto batch = std::make_shared<Batch>(std::move(pending_));
+    pending_ = Batch();
+    pending_.reserve(kVariantsPerBatch);
+    auto formatted = pool_.Submit([this, batch] { return Format(*batch); });
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(formatted));
+    }
+    changed_.notify_all();
+  }
+
+  std::string Format(const Batch &batch) {
+    // There are as many formatters as threads in the pool so one is always available
+    std::unique_ptr<impl::VCFRecordFormatter> formatter;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      formatter = std::move(formatters_.back());
+      formatters_.pop_back();
+    }
+
+    std::string lines;
+    std::exception_ptr error;
+    try {
+      for (auto &entry : batch) {
+        if (!entry.line.empty()) {
+          lines.append(entry.line);
+        } else {
+          formatter->Format(entry.variant, lines);
+          lines.push_back('\n');
+        }
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      formatters_.push_back(std::move(formatter));
+    }
+    if (error) std::rethrow_exception(error);
+    return lines;
+  }
+
+  void Write() {
+    for (;;) {
+      std::future<std::string> next;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) return;  // Only reachable when stop_ is set
+        next = std::move(queue_.front());
+        queue_.pop_front();
+        writing_ = true;
+      }
+      changed_.notify_all();
+
+      std::exception_ptr error;
+      try {
+        writer_.Write(next.get());
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        writing_ = false;
+        if (error && !error_) error_ = error;  // Report the first error
+      }
+      changed_.notify_all();
+    }
+  }
+
+  // Must be invoked with the mutex held
+  void RethrowError() {
+    if (error_) {
+      auto error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+  ASCIILineWriterInterface &writer_;
+  size_t capacity_;
+  Batch pending_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool stop_ = false, writing_ = false;
+  std::exception_ptr error_;
+  std::deque<std::future<std::string>> queue_;
+  std::vector<std::unique_ptr<impl::VCFRecordFormatter>> formatters_;
+
+  util::ThreadPool pool_;
+  std::thread thread_;
+};
+
+void VCFSink::PipelineDeleter::operator()(VCFSink::Pipeline *p) { delete p; }
+
+VCFSink::VCFSink(const VCFHeader &header, Writer &&writer, size_t threads)
     : header_(header), writer_(std::move(writer)) {
   std::string line;
   auto itr = std::back_inserter(line);
@@ -378,23 +587,64 @@ VCFSink::VCFSink(const VCFHeader &header, Writer &&writer)
   FIELDS(FILTER, gen.id_and_desc_field_);
 #undef FIELDS
 
+  for (auto &entry : header_.contigs()) {
+    km::generate(itr, km::lit("##contig=<ID=") << km::stream, entry.contig);
+    if (entry.length > 0) km::generate(itr, km::lit(",length=") << km::long_long, entry.length);
+    km::generate(itr, km::lit('>') << km::eol);
+  }
+
   km::generate(itr, gen.required_columns_, header_.samples_);
 
   writer_->Write(line);
 
-  // Create the variant generator for subsequent use
-  generator_ = std::make_unique<impl::Generator>(header_);
+  // Compile the record formatter for subsequent use
+  generator_ = std::make_unique<impl::VCFRecordFormatter>(header_);
+  if (threads > 1) pipeline_.reset(new Pipeline(header_, *writer_, threads));
+}
+
+VCFSink::~VCFSink() {
+  try {
+    Flush();
+  } catch (std::exception &e) {
+    LOG(ERROR) << "Failed to write variants: " << e.what();
+  }
 }
 
 void VCFSink::PushVariant(const model::VariantContext &cxt) {
-  std::string line;
-  {
-    auto itr = std::back_inserter(line);
-    auto &gen = static_cast<impl::Generator &>(*generator_);
-    gen.Generate(itr, cxt);
-    km::generate(itr, km::eol);
+  auto &formatter = static_cast<impl::VCFRecordFormatter &>(*generator_);
+  if (pipeline_) {
+    pipeline_->Push(std::string(formatter.FormatLine(cxt)));
+  } else if (auto buffer = writer_->buffer()) {
+    // Format directly into the writer's buffer, discarding any partial record if formatting fails
+    size_t size = buffer->size();
+    try {
+      formatter.Format(cxt, *buffer);
+    } catch (...) {
+      buffer->resize(size);
+      throw;
+    }
+    buffer->push_back('\n');
+    writer_->Commit();
+  } else {
+    writer_->Write(formatter.FormatLine(cxt));
   }
-  writer_->Write(line);
+}
+
+void VCFSink::PushVariant(model::VariantContext &&cxt) {
+  if (pipeline_)
+    pipeline_->Push(std::move(cxt));
+  else
+    PushVariant(static_cast<const model::VariantContext &>(cxt));
+}
+
+void VCFSink::Flush() {
+  if (pipeline_) pipeline_->Flush();
+  writer_->Flush();
+}
+
+void VCFSink::Close() {
+  if (pipeline_) pipeline_->Flush();
+  writer_->Close();
 }
 
 }  // namespace io
@@ -2,6 +2,12 @@
 // Created by Michael Linderman on 12/13/15.
 //
 
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
@@ -14,6 +20,8 @@
 #include "aseq/io/vcf.hpp"
 #include "aseq/model/variant_context.hpp"
 #include "aseq/util/exception.hpp"
+#include "aseq/util/thread_pool.hpp"
+#include "numeric.hpp"
 
 namespace x3 = boost::spirit::x3;
 
@@ -78,6 +86,7 @@ namespace io {
 namespace impl {
 
 using model::VariantContext;
+using util::Attributes;
 static model::Genotype::Alleles::initializer genotype_alleles_init;
 
 // Helper values and macros for parsing VCF fields
@@ -99,16 +108,23 @@ bool IsDefined(const Iterator& begin, const Iterator& end) {
   return IsDefined(boost::make_iterator_range(begin, end));
 }
 
+// Unlike boost::split, splits into the existing container (preserving its allocator)
 template <typename Sequence, typename Range, typename Predicate>
 Sequence& SplitOptionalRange(Sequence& container, const Range& input, Predicate predicate) {
-  return !IsDefined(input) ? container : boost::split(container, input, predicate);
+  container.clear();
+  if (IsDefined(input)) {
+    boost::split_iterator<typename Range::const_iterator> i(input, boost::token_finder(predicate)),
+        end;
+    for (; i != end; ++i) container.emplace_back(i->begin(), i->end());
+  }
+  return container;
 }
 
 // Boost Spirit X3 infrastructure
 namespace parser {
 
 // "as" directive needed to parse into underlying type of attribute, but then convert
-// that typed attribute into the generic "any" used as the attribute mapped type
+// that typed attribute into the generic AttributeValue used as the attribute mapped type
 template <typename Subject, typename T>
 struct as_directive : x3::unary_parser<Subject, as_directive<Subject, T> > {
   typedef x3::unary_parser<Subject, as_directive<Subject, T> > base_type;
@@ -154,6 +170,14 @@ x3::rule<class field_attributes, VCFHeader::Field> const field_attributes =
 x3::rule<class filter_or_alt_attributes, VCFHeader::Field> const filter_or_alt_attributes =
     "VCF header field with ID and description attributes";
 
+// ##contig line, only the ID and length attributes are retained
+struct ContigField {
+  std::string id_;
+  model::Pos length_ = 0;
+};
+x3::rule<class contig_attributes, ContigField> const contig_attributes =
+    "VCF header contig attributes";
+
 struct header_tag {};
 auto SetFormat = [](auto& ctx) {
   VCFHeader& header = x3::get<header_tag>(ctx);
@@ -172,6 +196,18 @@ FIELD_ADD(FORMAT)
 
 #undef FIELD_ADD
 
+auto AddContig = [](auto& ctx) {
+  VCFHeader& header = x3::get<header_tag>(ctx);
+  if (x3::_attr(ctx).id_.empty()) {
+    throw util::file_parse_error() << util::error_message("##contig line without an ID");
+  }
+  header.AddContig(x3::_attr(ctx).id_, x3::_attr(ctx).length_);
+};
+auto SetContigID = [](auto& ctx) {
+  x3::_val(ctx).id_.assign(x3::_attr(ctx).begin(), x3::_attr(ctx).end());
+};
+auto SetContigLength = [](auto& ctx) { x3::_val(ctx).length_ = x3::_attr(ctx); };
+
 const x3::symbols<FileFormat> kFileFormats{{"VCFv4.1", FileFormat::VCF4_1},
                                            {"VCFv4.2", FileFormat::VCF4_2}};
 
@@ -197,10 +233,19 @@ auto const field_attributes_def =
 auto const filter_or_alt_attributes_def =
     lit('=') > x3::confix('<','>')[id > x3::attr(0) > x3::attr(VCFHeader::Field::Type::FLAG) > ',' > desc];
 
+auto const contig_attribute = x3::omit[
+    (lit("ID=") > x3::raw[+(char_ - ',' - '>')])[SetContigID]
+    | (lit("length=") > x3::long_long)[SetContigLength]
+    | (+(char_ - '=' - ',' - '>') > '='
+       > (x3::confix('"','"')[*(char_ - '"')] | *(char_ - ',' - '>')))
+];
+auto const contig_attributes_def = lit('=') > x3::confix('<','>')[contig_attribute % ','];
+
 auto const header_field_def = (
     (lit("INFO") > field_attributes)[AddINFOField]
     | (lit("FORMAT") > field_attributes)[AddFORMATField]
     | (lit("FILTER") > filter_or_alt_attributes)[AddFILTERField]
+    | (lit("contig") > contig_attributes)[AddContig]
     | ((+x3::alnum) > '=' > (*(char_ - x3::eol)))
 );
 
@@ -267,7 +312,8 @@ auto const genotype_allele_def = x3::rule<class genotype_allele, int> {}
     %= x3::lit('.')[missing_allele] | x3::int_;
 // clang-format on
 
-BOOST_SPIRIT_DEFINE(header_line, header_field, field_attributes, filter_or_alt_attributes);
+BOOST_SPIRIT_DEFINE(header_line, header_field, field_attributes, filter_or_alt_attributes,
+                    contig_attributes);
 BOOST_SPIRIT_DEFINE(pos, qual);
 BOOST_SPIRIT_DEFINE(integer_value, integers_value, float_value, floats_value, char_value,
                     chars_value);
@@ -339,15 +385,91 @@ struct StringsAttributeParser : public AttributeParser<Iterator> {
     }                                                                                       \
   };
 
-PARSER(IntegerAttributeParser, parser::integer_value);
-PARSER(IntegersAttributeParser, parser::integers_value);
-PARSER(FloatAttributeParser, parser::float_value);
-PARSER(FloatsAttributeParser, parser::floats_value);
 PARSER(CharacterAttributeParser, parser::char_value);
 PARSER(CharactersAttributeParser, parser::chars_value);
 PARSER(GenotypeAttributeParser, parser::genotype_value);
 #undef PARSER
 
+// Numeric values are parsed directly into typed storage with the hand-written parsers in
+// numeric.hpp, instead of Spirit, with the missing value handled inline
+template <typename T, typename Iterator, typename F>
+bool ParseNumericValue(Iterator begin, const Iterator& end, Attributes::mapped_type& value,
+                       F parse) {
+  if (begin == end) return false;
+  const char *b = &*begin, *e = b + (end - begin);
+  if (e - b == 1 && *b == '.') return true;  // Missing value
+
+  T v;
+  if (!parse(b, e, v) || b != e) return false;
+  value = v;
+  return true;
+}
+
+template <typename T, typename Iterator, typename F>
+bool ParseNumericValues(Iterator begin, const Iterator& end, Attributes::mapped_type& value,
+                        F parse) {
+  if (begin == end) return false;
+  const char *b = &*begin, *e = b + (end - begin);
+
+  Attributes::mapped_type::Vector<T> values;  // Common short vectors are stored inline
+  bool missing = false;
+  for (;;) {
+    if (*b == '.' && (b + 1 == e || *(b + 1) == ',')) {
+      missing = true;
+      ++b;
+    } else {
+      T v;
+      if (!parse(b, e, v)) return false;
+      values.push_back(v);
+    }
+    if (b == e) break;
+    if (*b != ',' || ++b == e) return false;
+  }
+
+  // As with the missing value, a vector of missing values is omitted. Missing values within a
+  // vector aren't supported.
+  if (missing) return values.empty();
+  value = std::move(values);
+  return true;
+}
+
+template <typename Iterator>
+struct IntegerAttributeParser : public AttributeParser<Iterator> {
+  IntegerAttributeParser(const Attributes::key_type key) : AttributeParser<Iterator>(key) {}
+  bool Parse(Iterator begin, const Iterator& end, Attributes::mapped_type& value) const {
+    return ParseNumericValue<Attributes::Integer>(begin, end, value,
+                                                  impl::ParseInteger<Attributes::Integer>);
+  }
+};
+
+template <typename Iterator>
+struct IntegersAttributeParser : public AttributeParser<Iterator> {
+  IntegersAttributeParser(const Attributes::key_type key) : AttributeParser<Iterator>(key) {}
+  bool Parse(Iterator begin, const Iterator& end, Attributes::mapped_type& value) const {
+    return ParseNumericValues<Attributes::Integer>(begin, end, value,
+                                                   impl::ParseInteger<Attributes::Integer>);
+  }
+};
+
+// Uncommon representations, e.g. "nan", fall back to the Spirit parsers
+template <typename Iterator>
+struct FloatAttributeParser : public AttributeParser<Iterator> {
+  FloatAttributeParser(const Attributes::key_type key) : AttributeParser<Iterator>(key) {}
+  bool Parse(Iterator begin, const Iterator& end, Attributes::mapped_type& value) const {
+    return ParseNumericValue<Attributes::Float>(begin, end, value, impl::ParseFloat) ||
+           (x3::parse(begin, end, parser::float_value, value) && begin == end);
+  }
+};
+
+template <typename Iterator>
+struct FloatsAttributeParser : public AttributeParser<Iterator> {
+  FloatsAttributeParser(const Attributes::key_type key) : AttributeParser<Iterator>(key) {}
+  bool Parse(Iterator begin, const Iterator& end, Attributes::mapped_type& value) const {
+    return ParseNumericValues<Attributes::Float>(begin, end, value, impl::ParseFloat) ||
+           (x3::parse(begin, end, parser::floats_value, value) && begin == end);
+  }
+};
+
 template <typename Iterator>
 struct FilterAttributeParser : public AttributeParser<Iterator> {
   FilterAttributeParser(const Attributes::key_type key) : AttributeParser<Iterator>(key) {}
@@ -372,6 +494,323 @@ void ParseRange(const Range& range, const Parser& parser, Attribute& attr) {
   }
 };
 
+// Samples to be decoded, i.e. all of the samples in the header or a projected subset, and their
+// corresponding sample columns
+struct VCFSampleColumns {
+  explicit VCFSampleColumns(const VCFHeader& header) : samples(header.samples()) {
+    for (size_t i = 0; i < samples.size(); i++) {
+      columns.push_back(i);
+      index.emplace(samples[i], i);
+    }
+    num_columns = samples.size();
+  }
+
+  VCFSampleColumns(const VCFHeader& header, const std::vector<model::Sample>& subset)
+      : samples(subset), num_columns(header.NumSamples()) {
+    for (auto& sample : subset) {
+      auto i = std::find(header.samples().begin(), header.samples().end(), sample);
+      if (i == header.samples().end()) {
+        throw util::no_such_sample() << util::error_message(
+            fmt::format("sample {} not found in header", sample));
+      }
+      index.emplace(sample, columns.size());
+      columns.push_back(i - header.samples().begin());
+    }
+  }
+
+  VCFHeader::Samples samples;
+  std::vector<size_t> columns;
+  size_t num_columns;
+  model::SampleIndex index;
+};
+
+// Decoder for the sample columns of a particular FORMAT layout
+class VCFSampleDecoder {
+ public:
+  typedef parser::AttributeParser<const char*> AttributeParser;
+  typedef std::vector<std::shared_ptr<const AttributeParser> > Format;  // nullptr to skip field
+
+  explicit VCFSampleDecoder(Format&& format) : format_(std::move(format)) {}
+  virtual ~VCFSampleDecoder() {}
+
+  // Decode the sample column [begin, end) into attributes and GT alleles
+  virtual void Decode(const char* begin, const char* end, Attributes& attr,
+                      model::Genotype::Alleles& alleles) const = 0;
+
+  // Position of the FORMAT field key in the layout, or -1 if it isn't decoded as an attribute
+  int FieldIndex(const Attributes::key_type& key) const {
+    if (key == VCFHeader::FORMAT::GT) return -1;
+    for (size_t i = 0; i < format_.size(); i++) {
+      if (format_[i] && format_[i]->key_ == key) return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+  // Decode just the field-th field of the sample column [begin, end) (empty if omitted)
+  void DecodeField(const char* begin, const char* end, size_t field,
+                   Attributes::mapped_type& value) const {
+    for (size_t i = 0; i < field; i++) {
+      auto colon = static_cast<const char*>(memchr(begin, ':', end - begin));
+      if (!colon) return;  // Trailing fields can be omitted
+      begin = colon + 1;
+    }
+    auto colon = static_cast<const char*>(memchr(begin, ':', end - begin));
+    if (!format_[field]->Parse(begin, colon ? colon : end, value)) {
+      throw util::file_parse_error() << util::error_message(
+          fmt::format("failed to parse value for attribute {}", format_[field]->key_));
+    }
+  }
+
+ protected:
+  Format format_;
+};
+
+// Generic decoder that splits the column on ':' and parses each field with its attribute parser
+class GenericSampleDecoder : public VCFSampleDecoder {
+ public:
+  // If format is truncated (i.e. projected) extra sample fields are ignored
+  GenericSampleDecoder(Format&& format, bool truncated)
+      : VCFSampleDecoder(std::move(format)), truncated_(truncated) {}
+
+  void Decode(const char* begin, const char* end, Attributes& attr,
+              model::Genotype::Alleles& alleles) const override {
+    static const auto kSplitEnd = boost::split_iterator<const char*>();
+    auto column = boost::make_iterator_range(begin, end);
+
+    attr.reserve(format_.size());
+    auto f = boost::make_split_iterator(column, kFormatFinder);
+    for (auto p = format_.begin(); p != format_.end() && f != kSplitEnd; ++p, ++f) {
+      if (*p) (*p)->Parse(f->begin(), f->end(), attr);
+    }
+    if (f != kSplitEnd && !truncated_) {
+      throw util::file_parse_error()
+          << util::error_message("more attributes than specified in FORMAT");
+    }
+
+    // Get and remove GT from attributes if present
+    auto gt = attr.find(VCFHeader::FORMAT::GT);
+    if (gt != attr.end()) {
+      alleles = Attributes::at<model::Genotype::Alleles>(gt);
+      attr.erase(gt);
+    }
+  }
+
+ private:
+  bool truncated_;
+};
+
+// Fields for FusedSampleDecoder, each decodes a single value [begin, end) directly (i.e. without
+// virtual dispatch) if the header definition Matches the field
+namespace fused {
+
+inline void ThrowParseError(const Attributes::key_type& key) {
+  throw util::file_parse_error()
+      << util::error_message(fmt::format("failed to parse value for attribute {}", key));
+}
+
+struct GT {
+  static bool Matches(const VCFHeader::Field& field) {
+    return field.type_ == VCFHeader::Field::Type::GENOTYPE;
+  }
+  static void Decode(const Attributes::key_type& key, const char* begin, const char* end,
+                     Attributes&, model::Genotype::Alleles& alleles) {
+    Attributes::mapped_type value;
+    if (!x3::parse(begin, end, parser::genotype_value, value) || begin != end)
+      ThrowParseError(key);
+    alleles = value.cast<model::Genotype::Alleles>();
+  }
+};
+
+template <typename T, bool Scalar>
+struct IntegerField {
+  static bool Matches(const VCFHeader::Field& field) {
+    return field.type_ == VCFHeader::Field::Type::INTEGER && field.IsScalar() == Scalar;
+  }
+  static void Decode(const Attributes::key_type& key, const char* begin, const char* end,
+                     Attributes& attr, model::Genotype::Alleles&) {
+    Attributes::mapped_type value;
+    bool parsed = Scalar ? parser::ParseNumericValue<T>(begin, end, value, ParseInteger<T>)
+                         : parser::ParseNumericValues<T>(begin, end, value, ParseInteger<T>);
+    if (!parsed) ThrowParseError(key);
+    if (!value.empty()) attr.emplace(key, std::move(value));
+  }
+};
+
+struct String {
+  static bool Matches(const VCFHeader::Field& field) {
+    return field.type_ == VCFHeader::Field::Type::STRING && field.IsScalar();
+  }
+  static void Decode(const Attributes::key_type& key, const char* begin, const char* end,
+                     Attributes& attr, model::Genotype::Alleles&) {
+    if (IsDefined(begin, end)) attr.emplace(key, Attributes::String(begin, end));
+  }
+};
+
+typedef IntegerField<Attributes::Integer, true> Integer;
+typedef IntegerField<Attributes::Integer, false> Integers;
+}  // namespace fused
+
+// Decoder specialized at compile-time for a common FORMAT layout that scans each sample column in
+// a single pass, e.g. FusedSampleDecoder<GT, Integer, Integer, Integers> for GT:GQ:DP:HQ
+template <typename... Fields>
+class FusedSampleDecoder : public VCFSampleDecoder {
+ public:
+  typedef std::array<Attributes::key_type, sizeof...(Fields)> Keys;
+
+  FusedSampleDecoder(Format&& format, const Keys& keys)
+      : VCFSampleDecoder(std::move(format)), keys_(keys) {}
+
+  // Create decoder if the header definitions of the FORMAT keys match the fields (else nullptr)
+  static std::shared_ptr<const VCFSampleDecoder> Make(Format format,
+                                                       const VCFHeader::Fields& fields) {
+    Keys keys;
+    for (size_t i = 0; i < keys.size(); i++) keys[i] = format[i]->key_;
+    if (!Matches(std::index_sequence_for<Fields...>(), keys, fields)) return nullptr;
+    return std::make_shared<FusedSampleDecoder>(std::move(format), keys);
+  }
+
+  void Decode(const char* begin, const char* end, Attributes& attr,
+              model::Genotype::Alleles& alleles) const override {
+    const char *p = begin, *e = end;
+    attr.reserve(sizeof...(Fields));
+    bool more = true;
+    DecodeFields(std::index_sequence_for<Fields...>(), p, e, more, attr, alleles);
+    if (more) {
+      throw util::file_parse_error()
+          << util::error_message("more attributes than specified in FORMAT");
+    }
+  }
+
+ private:
+  template <size_t... I>
+  static bool Matches(std::index_sequence<I...>, const Keys& keys,
+                      const VCFHeader::Fields& fields) {
+    for (bool matches : {Fields::Matches(fields.at(keys[I]))...}) {
+      if (!matches) return false;
+    }
+    return true;
+  }
+
+  template <size_t... I>
+  void DecodeFields(std::index_sequence<I...>, const char*& p, const char* e, bool& more,
+                    Attributes& attr, model::Genotype::Alleles& alleles) const {
+    // Braced initializer lists are evaluated in order, i.e. in the order of the FORMAT fields
+    (void)std::initializer_list<int>{
+        (DecodeField<Fields>(keys_[I], p, e, more, attr, alleles), 0)...};
+  }
+
+  // Fields can be omitted at the end of a sample column, indicated by more being false
+  template <typename Field>
+  static void DecodeField(const Attributes::key_type& key, const char*& p, const char* e,
+                          bool& more, Attributes& attr, model::Genotype::Alleles& alleles) {
+    if (!more) return;
+    auto colon = static_cast<const char*>(memchr(p, ':', e - p));
+    Field::Decode(key, p, colon ? colon : e, attr, alleles);
+    if (colon) {
+      p = colon + 1;
+    } else {
+      p = e;
+      more = false;
+    }
+  }
+
+  Keys keys_;
+};
+
+// Sample columns of a VCF line, retained as raw bytes (plus the column offsets) and decoded on the
+// first access to the genotypes so that site-level workloads don't pay for genotype parsing. The
+// raw bytes, and the per-sample attributes, are allocated from the variant's arena (if any).
+class VCFGenotypeDecoder : public model::impl::GenotypeDecoder {
+ public:
+  typedef std::shared_ptr<const VCFSampleColumns> Samples;
+  typedef std::shared_ptr<const VCFSampleDecoder> Layout;
+
+  explicit VCFGenotypeDecoder(const std::shared_ptr<util::Arena>& arena)
+      : raw_(arena),
+        offsets_(arena),
+        attr_arena_(arena ? arena : std::make_shared<util::Arena>()) {}
+
+  // Retain the sample columns [begin, end) for decoding with layout. Decoders are reused for
+  // subsequent records, retaining the capacity of their buffers.
+  void Assign(const Samples& samples, const Layout& layout, const char* begin, const char* end) {
+    if (layout_) {
+      // The attributes of previously decoded genotypes are allocated from the arena, so it can only
+      // be reused if those genotypes (and the record, for a per-record arena) no longer exist
+      if (attr_arena_.use_count() == 1)
+        attr_arena_->Reset();
+      else
+        attr_arena_ = std::make_shared<util::Arena>();
+    }
+    samples_ = samples;
+    layout_ = layout;
+    raw_.assign(begin, end);
+
+    // Find the start of each sample column (with a sentinel column after the end)
+    size_t columns = samples_->num_columns;
+    offsets_.clear();
+    offsets_.reserve(columns + 1);
+    offsets_.push_back(0);
+    for (const char *i = raw_.data(), *e = raw_.data() + raw_.size();;) {
+      auto tab = static_cast<const char*>(memchr(i, '\t', e - i));
+      if (!tab) break;
+      if (offsets_.size() == columns) {
+        throw util::file_parse_error()
+            << util::error_message("more samples than specified in header");
+      }
+      i = tab + 1;
+      offsets_.push_back(static_cast<uint32_t>(i - raw_.data()));
+    }
+    if (offsets_.size() != columns) {
+      throw util::file_parse_error() << util::error_message(
+          fmt::format("expected {} sample entries, found {}", columns, offsets_.size()));
+    }
+    offsets_.push_back(static_cast<uint32_t>(raw_.size() + 1));
+  }
+
+  size_t NumGenotypes() const override { return samples_->samples.size(); }
+
+  void Decode(VariantContext::Genotypes& genotypes) const override {
+    using util::Attributes;
+    using model::Genotype;
+
+    genotypes.reserve(genotypes.size() + samples_->samples.size());
+    for (size_t g = 0; g < samples_->samples.size(); g++) {
+      size_t c = samples_->columns[g];
+      Attributes sample_attr{Attributes::allocator_type(attr_arena_)};
+      Genotype::Alleles alleles;
+      layout_->Decode(raw_.data() + offsets_[c], raw_.data() + offsets_[c + 1] - 1, sample_attr,
+                      alleles);
+
+      genotypes.emplace_back(samples_->samples[g], alleles, std::move(sample_attr));
+    }
+  }
+
+  void DecodeColumn(const util::Attributes::key_type& key,
+                    std::vector<util::Attributes::mapped_type>& column) const override {
+    column.clear();
+    column.resize(samples_->samples.size());
+    int field = layout_->FieldIndex(key);
+    if (field < 0) return;
+    for (size_t g = 0; g < samples_->samples.size(); g++) {
+      size_t c = samples_->columns[g];
+      layout_->DecodeField(raw_.data() + offsets_[c], raw_.data() + offsets_[c + 1] - 1, field,
+                           column[g]);
+    }
+  }
+
+  std::shared_ptr<const model::SampleIndex> sample_index() const override {
+    // Aliases the sample columns, which are shared by all of the records
+    return std::shared_ptr<const model::SampleIndex>(samples_, &samples_->index);
+  }
+
+ private:
+  Samples samples_;
+  Layout layout_;
+  std::vector<char, util::ArenaAllocator<char> > raw_;
+  std::vector<uint32_t, util::ArenaAllocator<uint32_t> > offsets_;
+  std::shared_ptr<util::Arena> attr_arena_;
+};
+
 template <typename Line>
 class VCFVariantParser {
   typedef typename Line::const_iterator Iterator;
@@ -379,18 +818,63 @@ class VCFVariantParser {
   using Attributes = util::Attributes;
 
  public:
-  VCFVariantParser(VCFHeader& header) : header_(header) {
+  VCFVariantParser(VCFHeader& header)
+      : header_(header),
+        samples_(std::make_shared<VCFSampleColumns>(header)),
+        header_samples_(std::make_shared<const VCFHeader::Samples>(header.samples())),
+        record_samples_(header_samples_) {
     // "Missing" INFO field
     info_keys_.emplace(".", std::make_unique<AttributeParser>("."));
     for (auto f : header.INFOValues()) {
-      info_keys_.emplace(f, GetParser(f));
+      info_keys_.emplace(f, GetParser<Iterator>(f));
     }
     for (auto f : header.FORMATValues()) {
-      format_keys_.emplace(f, GetParser(f));
+      format_keys_.emplace(f, GetParser<const char*>(f));
     }
   }
 
+  // Only parse the projected INFO and FORMAT fields and decode the projected samples
+  void SetProjection(const VariantProjection& projection) {
+    auto Keys = [](const boost::optional<std::vector<Attributes::key_type> >& keys,
+                   const Attributes::key_type& required) {
+      boost::optional<std::vector<std::string> > strings;
+      if (keys) {
+        strings.emplace(keys->begin(), keys->end());
+        if (std::find(keys->begin(), keys->end(), required) == keys->end())
+          strings->push_back(required);
+      }
+      return strings;
+    };
+    info_projection_ = Keys(projection.info, VCFHeader::INFO::END);
+    format_projection_ = Keys(projection.format, VCFHeader::FORMAT::GT);
+    if (projection.samples)
+      samples_ = std::make_shared<VCFSampleColumns>(header_, *projection.samples);
+    else
+      samples_ = std::make_shared<VCFSampleColumns>(header_);
+    layouts_.clear();
+    // Projected variants are missing fields present in the line, so it can't stand in for them
+    if (projection.info || projection.format || projection.samples)
+      record_samples_.reset();
+    else
+      record_samples_ = header_samples_;
+  }
+
   VariantContext ParseVCFVariant(const Line& line) {
+    // The variant's containers (and the raw sample columns and retained line) are allocated from a
+    // per-record arena, sized so that most records need just one block, instead of from the heap
+    size_t arena_size = 3 * boost::size(line);
+    if (arena_size < util::Arena::kDefaultBlockSize) arena_size = util::Arena::kDefaultBlockSize;
+    auto arena = std::make_shared<util::Arena>(arena_size);
+
+    VariantContext cxt;
+    cxt.SetArena(arena);
+    ParseVCFVariant(line, cxt, arena);
+    return cxt;
+  }
+
+  // Refill cxt with the variant, reusing its storage (including its genotype decoder, if any)
+  void ParseVCFVariant(const Line& line, VariantContext& cxt,
+                       const std::shared_ptr<util::Arena>& arena = nullptr) {
     using util::file_parse_error;
     using util::error_message;
     using model::Genotype;
@@ -410,103 +894,187 @@ class VCFVariantParser {
     model::Contig chrom(fields[0]);
 
     model::Pos pos, end;
-    ParseRange(fields[1], parser::pos, pos);
+    {
+      const char *b = &*fields[1].begin(), *e = b + fields[1].size();
+      if (fields[1].empty() || !ParseInteger(b, e, pos) || b != e) {
+        throw file_parse_error() << error_message("failed to parse POS");
+      }
+    }
 
     model::Allele ref(fields[3]);  // TODO: Validate alleles
-    VariantContext::Alleles alt;
-    SplitOptionalRange(alt, fields[4], kCommaSplitter);
+    SplitOptionalRange(alt_, fields[4], kCommaSplitter);
+
+    // Release the decoder before resetting the context, which destroys any existing genotypes
+    auto decoder = cxt.ReleaseGenotypeDecoder();
+    cxt.Reset(chrom, pos, pos + ref.size() - 1, ref, alt_.begin(), alt_.end());
+    if (chrom != contig_) {  // Records are typically sorted, so cache the most recent contig
+      contig_ = chrom;
+      contig_id_ = header_.contigs().Find(chrom);
+    }
+    cxt.set_contig_id(contig_id_);
 
-    // INFO field
-    util::Attributes info;
+    // INFO field (the context is marked clean once the source record is set)
+    Attributes& info = cxt.attributes();
+    info.reserve(std::count(fields[7].begin(), fields[7].end(), ';') + 1);
     for (auto i = boost::make_split_iterator(fields[7], kInfoFinder); i != kSplitEnd; ++i) {
       auto equals = boost::find(*i, kEqualsFinder);
+      if (info_projection_ && !Projected(*info_projection_, i->begin(), equals.begin())) continue;
       Attributes::key_type key(i->begin(), equals.begin());
 
       // Look up attribute key and parse value with returned parser, detect if flag (or valued)
       // in case the attribute is not yet defined
-      auto& parser = FindOrAddParser(info_keys_, key, header_.INFO(), equals.begin() == i->end());
+      auto& parser = *FindOrAddParser(info_keys_, key, header_.INFO(), equals.begin() == i->end());
       parser.Parse(equals.end(), i->end(), info);
     }
 
     // Fix up variant end based on INFO fields (if present)
-    end = info.at_or<util::Attributes::Integer>(VCFHeader::INFO::END, pos + ref.size() - 1);
-
-    VariantContext cxt(chrom, pos, end, ref, alt.begin(), alt.end());
-
-    cxt.attrs_ = std::move(info);  // Set INFO attributes
+    end = info.at_or<util::Attributes::Integer>(VCFHeader::INFO::END, cxt.end());
+    if (end != cxt.end()) {
+      static_cast<model::HasRegion&>(cxt) = model::HasRegion(chrom, pos, end, contig_id_);
+    }
 
     // Context fields (ID, QUAL, FILTER)
-    SplitOptionalRange(cxt.ids_, fields[2], kSemicolonSplitter);
-    ParseRange(fields[5], parser::qual, cxt.qual_);
-    SplitOptionalRange(cxt.filters_, fields[6], kSemicolonSplitter);
+    SplitOptionalRange(cxt.ids(), fields[2], kSemicolonSplitter);
+    if (IsDefined(fields[5])) {
+      const char *b = &*fields[5].begin(), *e = b + fields[5].size();
+      float qual;
+      if (!fields[5].empty() && ParseFloat(b, e, qual) && b == e) {
+        cxt.SetQual(qual);
+      } else {
+        model::VariantContext::Qual uncommon_qual;  // Uncommon representations, e.g. "nan"
+        ParseRange(fields[5], parser::qual, uncommon_qual);
+        cxt.SetQual(uncommon_qual);
+      }
+    }
+    SplitOptionalRange(cxt.filters(), fields[6], kSemicolonSplitter);
 
-    // FORMAT and genotypes (if present)
+    // FORMAT and genotypes (if present), genotypes are decoded on demand
     if (header_.NumSamples() > 0) {
       if (fields_itr == kSplitEnd) {
         throw file_parse_error() << error_message("missing FORMAT field");
       }
 
-      // Parse FORMAT field
-      std::vector<const AttributeParser*> format;
-      for (auto f = boost::make_split_iterator(*fields_itr, kFormatFinder); f != kSplitEnd; ++f) {
-        format.push_back(&FindOrAddParser(format_keys_, *f, header_.FORMAT()));
+      // Most files use only a few FORMAT layouts, so cache the decoder for each
+      format_.assign(fields_itr->begin(), fields_itr->end());
+      auto layout = layouts_.find(format_);
+      if (layout == layouts_.end()) {
+        std::tie(layout, std::ignore) = layouts_.emplace(format_, MakeLayout(*fields_itr));
       }
-      ++fields_itr;
 
-      // Parse individual sample entries
-      for (size_t g = 0; g < header_.NumSamples(); g++, ++fields_itr) {
-        if (fields_itr == kSplitEnd) {
-          throw file_parse_error() << error_message(
-              fmt::format("expected {} sample entries, found {}", header_.NumSamples(), g));
-        }
+      auto samples = fields_itr->end();
+      if (samples == line.end()) {
+        throw file_parse_error() << error_message(
+            fmt::format("expected {} sample entries, found 0", header_.NumSamples()));
+      }
+      ++samples;  // Skip tab after FORMAT
 
-        Attributes sample_attr;
+      auto* vcf_decoder = dynamic_cast<Decoder*>(decoder.get());
+      if (!vcf_decoder) {
+        decoder = std::make_unique<Decoder>(arena);
+        vcf_decoder = static_cast<Decoder*>(decoder.get());
+      }
+      vcf_decoder->Assign(samples_, layout->second, &*samples, &*samples + (line.end() - samples));
+      cxt.SetGenotypeDecoder(std::move(decoder));
+    }
 
-        auto f = boost::make_split_iterator(*fields_itr, kFormatFinder);
-        for (auto p = format.begin(); p != format.end() && f != kSplitEnd; ++p, ++f) {
-          auto& parser = *(*p);
-          parser.Parse(f->begin(), f->end(), sample_attr);
-        }
-        if (f != kSplitEnd) {
-          throw file_parse_error() << error_message("more attributes than specified in FORMAT");
-        }
+    // Retain the line so that unmodified variants can be written without reformatting
+    if (record_samples_) {
+      const char* b = &*line.begin();
+      cxt.SetSourceRecord(b, b + boost::size(line), record_samples_);
+    }
+  }
 
-        Genotype::Alleles alleles;
-        {  // Get and remove GT from attributes if present
-          auto gt = sample_attr.find(VCFHeader::FORMAT::GT);
-          if (gt != sample_attr.end()) {
-            alleles = Attributes::at<Genotype::Alleles>(gt);
-            sample_attr.erase(gt);
-          }
-        }
+ private:
+  typedef VCFGenotypeDecoder Decoder;
+  typedef GenericSampleDecoder GenericDecoder;
+
+  typename Decoder::Layout MakeLayout(const boost::iterator_range<Iterator>& field) {
+    static const auto kSplitEnd = boost::split_iterator<Iterator>();
 
-        cxt.AddGenotype(header_.sample(g), alleles, std::move(sample_attr));
+    typename GenericDecoder::Format format;
+    bool truncated = false;
+    for (auto f = boost::make_split_iterator(field, kFormatFinder); f != kSplitEnd; ++f) {
+      if (format_projection_ && !Projected(*format_projection_, f->begin(), f->end())) {
+        format.push_back(nullptr);
+      } else {
+        format.push_back(FindOrAddParser(format_keys_, *f, header_.FORMAT()));
       }
-      if (fields_itr != kSplitEnd) {
-        throw file_parse_error() << error_message("more samples than specified in header");
+    }
+    if (format_projection_) {
+      // Don't split sample entries beyond the last requested field
+      while (!format.empty() && !format.back()) {
+        format.pop_back();
+        truncated = true;
       }
     }
 
-    return cxt;
+    if (!truncated && std::all_of(format.begin(), format.end(), [](auto& p) { return p; })) {
+      auto fused = MakeFusedLayout(field, format);
+      if (fused) return fused;
+    }
+    return std::make_shared<GenericDecoder>(std::move(format), truncated);
   }
 
- private:
-  VCFHeader& header_;
+  // Specialized decoders for common layouts (if the header definitions match the expected types)
+  typename Decoder::Layout MakeFusedLayout(const boost::iterator_range<Iterator>& field,
+                                           const typename GenericDecoder::Format& format) {
+#define LAYOUT(STRING, ...)                        \
+  if (boost::equals(field, STRING)) {              \
+    typedef FusedSampleDecoder<__VA_ARGS__> Fused; \
+    return Fused::Make(format, header_.FORMAT());  \
+  }
 
-  typedef std::unordered_map<Attributes::key_type, std::unique_ptr<AttributeParser> > AttrTypes;
-  AttrTypes info_keys_, format_keys_;
+    using namespace fused;
+    LAYOUT("GT", GT);
+    LAYOUT("GT:GQ", GT, Integer);
+    LAYOUT("GT:DP:GQ", GT, Integer, Integer);
+    LAYOUT("GT:GQ:DP:HQ", GT, Integer, Integer, Integers);
+    LAYOUT("GT:AD:DP:GQ:PL", GT, Integers, Integer, Integer, Integers);
+    LAYOUT("GT:AD:DP:GQ:PGT:PID:PL", GT, Integers, Integer, Integer, String, String, Integers);
+    return nullptr;
+#undef LAYOUT
+  }
 
-  static typename AttrTypes::mapped_type GetParser(const VCFHeader::Field& field) {
+  static bool Projected(const std::vector<std::string>& keys, Iterator begin, Iterator end) {
+    auto key = boost::make_iterator_range(begin, end);
+    return std::any_of(keys.begin(), keys.end(),
+                       [&](const std::string& k) { return boost::equals(key, k); });
+  }
+
+  VCFHeader& header_;
+  typename Decoder::Samples samples_;
+  boost::optional<std::vector<std::string> > info_projection_, format_projection_;
+  const VariantContext::RecordSamples header_samples_;
+  VariantContext::RecordSamples record_samples_;  // Null if lines aren't retained
+
+  // Samples are decoded from a copy of the line, so FORMAT parsers always operate on const char*
+  template <typename It>
+  using AttrTypes = std::unordered_map<Attributes::key_type,
+                                       std::shared_ptr<const parser::AttributeParser<It> > >;
+  AttrTypes<Iterator> info_keys_;
+  AttrTypes<const char*> format_keys_;
+  std::unordered_map<std::string, typename Decoder::Layout> layouts_;
+
+  // Scratch storage reused across records
+  VariantContext::Alleles alt_;
+  std::string format_;
+
+  // Most recent contig and its ID in the header's contig dictionary
+  model::Contig contig_;
+  model::ContigID contig_id_ = model::kUnknownContigID;
+
+  template <typename It>
+  static typename AttrTypes<It>::mapped_type GetParser(const VCFHeader::Field& field) {
 #define CASE1(TYPE, PARSER)          \
   case VCFHeader::Field::Type::TYPE: \
-    return std::make_unique<parser::PARSER<Iterator> >(field);
-
-#define CASE2(TYPE, SCALAR, VECTOR)                              \
-  case VCFHeader::Field::Type::TYPE:                             \
-    if (field.IsScalar()) {                                      \
-      return std::make_unique<parser::SCALAR<Iterator> >(field); \
-    } else {                                                     \
-      return std::make_unique<parser::VECTOR<Iterator> >(field); \
+    return std::make_unique<parser::PARSER<It> >(field);
+
+#define CASE2(TYPE, SCALAR, VECTOR)                        \
+  case VCFHeader::Field::Type::TYPE:                       \
+    if (field.IsScalar()) {                                \
+      return std::make_unique<parser::SCALAR<It> >(field); \
+    } else {                                               \
+      return std::make_unique<parser::VECTOR<It> >(field); \
     }
 
     switch (field.type_) {
@@ -525,9 +1093,12 @@ class VCFVariantParser {
 #undef CASE1
   }
 
-  const AttributeParser& FindOrAddParser(AttrTypes& keys, util::Attributes::key_type key,
-                                         VCFHeader::Fields& fields, bool as_flag = false) {
-    typename AttrTypes::const_iterator i = keys.find(key);
+  template <typename It>
+  const typename AttrTypes<It>::mapped_type& FindOrAddParser(AttrTypes<It>& keys,
+                                                             util::Attributes::key_type key,
+                                                             VCFHeader::Fields& fields,
+                                                             bool as_flag = false) {
+    typename AttrTypes<It>::const_iterator i = keys.find(key);
     if (i == keys.end()) {
       VCFHeader::Field field(key, "Auto-generated");
       if (as_flag) {
@@ -538,9 +1109,9 @@ class VCFVariantParser {
         field.type_ = VCFHeader::Field::Type::STRING;
       }
       VCFHeader::AddField(fields, field);
-      std::tie(i, std::ignore) = keys.emplace(key, GetParser(field));
+      std::tie(i, std::ignore) = keys.emplace(key, GetParser<It>(field));
     }
-    return *(i->second);
+    return i->second;
   }
 };
 
@@ -553,8 +1124,158 @@ VariantContext ParseVCFVariantLine(const std::string& line, VCFHeader& header) {
 
 void VCFSource::ParserDeleter::operator()(VCFSource::Parser* p) { delete p; }
 
-VCFSource::VCFSource(FileFormat format, VCFSource::Reader&& reader)
-    : header_(format), reader_(std::forward<Reader>(reader)) {
+// Batches of lines are read on a dedicated thread and parsed on a pool of workers. Each worker has
+// its own parser and copy of the header, since parsers add undefined attributes to their header as
+// they are encountered. Parsed batches are returned in file order through a bounded queue.
+class VCFSource::Pipeline {
+ public:
+  Pipeline(const VCFHeader& header, const VariantProjection& projection,
+           ASCIILineReaderInterface& reader, size_t threads)
+      : reader_(reader), capacity_(kBatchesPerThread * threads), pool_(threads) {
+    for (size_t i = 0; i < threads; i++) {
+      workers_.push_back(std::make_unique<Worker>(header, projection));
+    }
+    thread_ = std::thread([this] { Read(); });
+  }
+
+  ~Pipeline() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+  }
+
+  // Fields added by the workers are merged into header
+  NextResult Next(VCFHeader& header) {
+    while (variant_ == parsed_.variants.size()) {
+      if (parsed_.error) {
+        // Report errors after the variants that preceded the error in the batch
+        auto error = parsed_.error;
+        parsed_.error = nullptr;
+        std::rethrow_exception(error);
+      }
+
+      std::future<Parsed> next;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return done_ || !queue_.empty(); });
+        if (queue_.empty()) return NextResult();
+        next = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      changed_.notify_all();
+
+      parsed_ = next.get();
+      variant_ = 0;
+      if (parsed_.header) {
+        for (auto& field : parsed_.header->INFOValues()) header.AddINFOField(field);
+        for (auto& field : parsed_.header->FORMATValues()) header.AddFORMATField(field);
+      }
+    }
+    return NextResult(std::move(parsed_.variants[variant_++]));
+  }
+
+ private:
+  static const size_t kBatchesPerThread = 2;
+
+  struct Worker {
+    Worker(const VCFHeader& h, const VariantProjection& projection) : header(h), parser(header) {
+      parser.SetProjection(projection);
+    }
+
+    VCFHeader header;
+    Parser parser;
+  };
+
+  struct Parsed {
+    std::vector<model::VariantContext> variants;
+    std::exception_ptr error;
+    std::unique_ptr<VCFHeader> header;  // Worker header if fields were added while parsing
+  };
+
+  void Read() {
+    try {
+      for (;;) {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          changed_.wait(lock, [this] { return stop_ || queue_.size() < capacity_; });
+          if (stop_) break;
+        }
+
+        auto batch = std::make_shared<LineBatch>();
+        if (reader_.ReadNextLines(*batch) == 0) break;
+        auto parsed = pool_.Submit([this, batch] { return Parse(*batch); });
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          queue_.push_back(std::move(parsed));
+        }
+        changed_.notify_all();
+      }
+    } catch (...) {
+      // Report read errors in order, i.e. after all of the preceding variants
+      std::promise<Parsed> error;
+      error.set_exception(std::current_exception());
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(error.get_future());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    changed_.notify_all();
+  }
+
+  Parsed Parse(const LineBatch& batch) {
+    // There are as many workers as threads in the pool so one is always available
+    std::unique_ptr<Worker> worker;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      worker = std::move(workers_.back());
+      workers_.pop_back();
+    }
+
+    Parsed parsed;
+    auto info = worker->header.INFO().size(), format = worker->header.FORMAT().size();
+    try {
+      parsed.variants.reserve(batch.size());
+      for (size_t i = 0; i < batch.size(); i++) {
+        parsed.variants.push_back(worker->parser.ParseVCFVariant(batch[i]));
+      }
+    } catch (...) {
+      parsed.error = std::current_exception();
+    }
+    if (worker->header.INFO().size() != info || worker->header.FORMAT().size() != format) {
+      parsed.header = std::make_unique<VCFHeader>(worker->header);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    workers_.push_back(std::move(worker));
+    return parsed;
+  }
+
+  ASCIILineReaderInterface& reader_;
+  size_t capacity_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool stop_ = false, done_ = false;
+  std::deque<std::future<Parsed>> queue_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  Parsed parsed_;
+  size_t variant_ = 0;
+
+  util::ThreadPool pool_;
+  std::thread thread_;
+};
+
+void VCFSource::PipelineDeleter::operator()(VCFSource::Pipeline* p) { delete p; }
+
+VCFSource::VCFSource(FileFormat format, VCFSource::Reader&& reader, size_t threads)
+    : header_(format), reader_(std::forward<Reader>(reader)), threads_(threads) {
   using util::file_parse_error;
 
   auto line_parser =
@@ -589,17 +1310,76 @@ VCFSource::VCFSource(FileFormat format, VCFSource::Reader&& reader)
   parser_.reset(new impl::VCFVariantParser<Line>(header_));
 }
 
+VCFSource::VCFSource(const VCFHeader& header, VCFSource::Reader&& reader)
+    : header_(header), reader_(std::forward<Reader>(reader)) {
+  parser_.reset(new impl::VCFVariantParser<Line>(header_));
+}
+
 FileFormat VCFSource::file_format() const { return header_.file_format(); }
 
+VariantSourceInterface::FactoryResult VCFSource::MakeShard(size_t shard, size_t num_shards) const {
+  if (!batch_.empty() || pipeline_) {
+    throw util::sharding_not_supported()
+        << util::error_message("VCF source must be sharded before reading variants");
+  }
+  // Each shard gets a copy of the header since undefined attributes are added to the header as they
+  // are encountered
+  std::unique_ptr<VCFSource> source(new VCFSource(header_, reader_->MakeShard(shard, num_shards)));
+  source->SetProjection(projection_);
+  return source;
+}
+
+void VCFSource::SetProjection(const VariantProjection& projection) {
+  if (pipeline_) {
+    // Batches already in the pipeline have been parsed with the previous projection
+    throw util::invalid_argument()
+        << util::error_message("projection must be set before reading variants");
+  }
+  parser_->SetProjection(projection);
+  projection_ = projection;
+}
+
 void VCFSource::SetRegion(model::Contig contig, model::Pos pos, model::Pos end) {
+  pipeline_.reset();
   reader_->SetRegion(contig, pos, end);
+  batch_.clear();
+  batch_line_ = 0;
+}
+
+void VCFSource::SetRegions(const model::Regions &regions) {
+  pipeline_.reset();
+  reader_->SetRegions(regions);
+  batch_.clear();
+  batch_line_ = 0;
 }
 
 VariantSourceInterface::NextResult VCFSource::NextVariant() {
-  if (auto line = reader_->ReadNextLine())
-    return NextResult(parser_->ParseVCFVariant(*line));
-  else
-    return NextResult();
+  if (threads_ > 1) {
+    if (!pipeline_) pipeline_.reset(new Pipeline(header_, projection_, *reader_, threads_));
+    return pipeline_->Next(header_);
+  }
+
+  if (batch_line_ == batch_.size()) {
+    batch_.clear();
+    batch_line_ = 0;
+    if (reader_->ReadNextLines(batch_) == 0) return NextResult();
+  }
+  return NextResult(parser_->ParseVCFVariant(batch_[batch_line_++]));
+}
+
+bool VCFSource::NextVariant(model::VariantContext& variant) {
+  if (threads_ > 1) {
+    // Variants are parsed by the workers ahead of time, so can't be parsed into variant
+    return VariantSourceInterface::NextVariant(variant);
+  }
+
+  if (batch_line_ == batch_.size()) {
+    batch_.clear();
+    batch_line_ = 0;
+    if (reader_->ReadNextLines(batch_) == 0) return false;
+  }
+  parser_->ParseVCFVariant(batch_[batch_line_++], variant);
+  return true;
 }
 }  // namespace io
 }  // namespace aseq
\ No newline at end of file
@@ -2,12 +2,16 @@
 // Created by Michael Linderman on 12/16/15.
 //
 
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+
 #include "aseq/model/allele.hpp"
 
 namespace aseq {
 namespace model {
 
-static Allele::initializer allele_init;
+constexpr size_t Allele::kMaxInlineSize;
 
 const Allele Allele::A("A"), Allele::G("G"), Allele::C("C"), Allele::T("T"), Allele::N("N");
 const Allele Allele::MISSING(".");
@@ -16,7 +20,13 @@ const Allele Allele::NON_REF("<NON_REF>");
 bool Allele::IsSymbolic() const { return (front() == '<') && (back() == '>'); }
 
 Allele Allele::SubAllele(size_t pos, size_t len) const {
-  return Allele(substr(pos, len));
+  if (pos > size()) throw std::out_of_range("Allele::SubAllele");
+  auto b = begin() + pos;
+  return Allele(b, b + std::min(len, size() - pos));
+}
+
+std::ostream& operator<<(std::ostream& os, const Allele& allele) {
+  return os.write(allele.data(), allele.size());
 }
 
 }  // namespace model
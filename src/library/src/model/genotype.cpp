@@ -52,14 +52,7 @@ const Genotype::Alleles Genotype::kNone,
     Genotype::kRefAltP(true, VariantContext::kRefIdx, VariantContext::kFirstAltIdx),
     Genotype::kAltRefP(true, VariantContext::kFirstAltIdx, VariantContext::kRefIdx);
 
-Genotype::Genotype(const VariantContext& variant, const Sample& sample, const Alleles& alleles,
-                   util::Attributes&& attr)
-    : HasAttributes(std::move(attr)), variant_(&variant), sample_(sample), alleles_(alleles) {}
-
-Genotype::Genotype(const VariantContext& variant, Genotype&& other)
-    : util::HasAttributes(other),
-      variant_(&variant),
-      sample_(std::move(other.sample_)),
-      alleles_(std::move(other.alleles_)) {}
+Genotype::Genotype(const Sample& sample, const Alleles& alleles, util::Attributes&& attr)
+    : HasAttributes(std::move(attr)), sample_(sample), alleles_(alleles) {}
 }
 }
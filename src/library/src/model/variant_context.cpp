@@ -10,6 +10,8 @@ namespace model {
 constexpr AlleleIndex VariantContext::kNoCallIdx, VariantContext::kNonRefIdx,
     VariantContext::kRefIdx, VariantContext::kFirstAltIdx;
 
+VariantContext::VariantContext() : HasRegion(Contig(), 0, 0) {}
+
 VariantContext::VariantContext(const Contig &contig, int64_t pos, const Allele &ref)
     : VariantContext(contig, pos, ref, {}) {}
 
@@ -27,39 +29,51 @@ VariantContext::VariantContext(const Contig &contig, Pos pos, Pos end, const All
   // TODO: Validate data
 }
 
-VariantContext::VariantContext(VariantContext &&other)
-    : util::HasAttributes(other),
+VariantContext::VariantContext(const Contig &contig, Pos pos, Pos end, const Allele &ref,
+                               Alleles &&alts)
+    : HasRegion(contig, pos, end), ref_(ref), alts_(std::move(alts)) {}
+
+VariantContext::VariantContext(VariantContext &&other) noexcept
+    : util::HasAttributes(std::move(other)),
       HasRegion(other),
       ids_(std::move(other.ids_)),
       qual_(std::move(other.qual_)),
       filters_(std::move(other.filters_)),
+      flags_(other.flags_),
       ref_(std::move(other.ref_)),
-      alts_(std::move(other.alts_))
-{
-  genotypes_.reserve(other.genotypes_.size());
-  for (Genotype &g : other.genotypes_) {
-    genotypes_.emplace_back(*this, std::move(g));
-  }
-}
-
-VariantContext &VariantContext::operator=(VariantContext &&rhs) {
+      alts_(std::move(other.alts_)),
+      genotypes_(std::move(other.genotypes_)),
+      decoder_(std::move(other.decoder_)),
+      decoded_(other.decoded_.load()),
+      sample_index_(std::move(other.sample_index_)),
+      record_(std::move(other.record_)),
+      record_samples_(std::move(other.record_samples_)),
+      dirty_(other.dirty_)
+{}
+
+VariantContext &VariantContext::operator=(VariantContext &&rhs) noexcept {
   this->HasRegion::operator=(std::move(rhs));
   this->util::HasAttributes::operator=(std::move(rhs));
   ids_ = std::move(rhs.ids_);
   qual_ = std::move(rhs.qual_);
   filters_ = std::move(rhs.filters_);
+  flags_ = rhs.flags_;
   ref_ = std::move(rhs.ref_);
   alts_ = std::move(rhs.alts_);
-  genotypes_.clear();
-  for (Genotype &g : rhs.genotypes_) {
-    genotypes_.emplace_back(*this, std::move(g));
-  }
+  genotypes_ = std::move(rhs.genotypes_);
+  decoder_ = std::move(rhs.decoder_);
+  decoded_ = rhs.decoded_.load();
+  sample_index_ = std::move(rhs.sample_index_);
+  record_ = std::move(rhs.record_);
+  record_samples_ = std::move(rhs.record_samples_);
+  dirty_ = rhs.dirty_;
   return *this;
 }
 
 VariantContext::VariantContext(VariantContext &&context, const Allele &ref)
     : VariantContext(std::move(context)) {
   ref_ = ref;
+  dirty_ = true;
 }
 
 VariantContext &VariantContext::SetFlag(VariantContext::Flags flags) {
@@ -72,26 +86,110 @@ bool VariantContext::IsPASSing() const {
   return filters_.size() == 1 && filters_.front() == kPASS;
 }
 
-const Genotype &VariantContext::GetGenotype(const Sample &sample) const {
-  // TODO: Sort genotypes for quicker access
+void VariantContext::SetGenotypeDecoder(std::unique_ptr<impl::GenotypeDecoder> &&decoder) {
+  genotypes_.clear();
+  decoder_ = std::move(decoder);
+  decoded_ = false;
+  sample_index_ = decoder_ ? decoder_->sample_index() : nullptr;
+}
+
+std::unique_ptr<impl::GenotypeDecoder> VariantContext::ReleaseGenotypeDecoder() {
+  if (decoder_ && !decoded_) {
+    // The sample index describes the genotypes the decoder would have produced
+    genotypes_.clear();
+    sample_index_.reset();
+  }
+  decoded_ = false;
+  return std::move(decoder_);
+}
+
+namespace {
+template <typename Container>
+void Rebind(Container &container, const std::shared_ptr<util::Arena> &arena) {
+  if (container.get_allocator().arena() == arena) return;
+  Container rebound(std::make_move_iterator(container.begin()),
+                    std::make_move_iterator(container.end()),
+                    typename Container::allocator_type(arena));
+  container = std::move(rebound);
+}
+}  // namespace
+
+void VariantContext::SetArena(const std::shared_ptr<util::Arena> &arena) {
+  Rebind(ids_, arena);
+  Rebind(filters_, arena);
+  Rebind(alts_, arena);
+  if (attrs_.get_allocator().arena() != arena) {
+    util::Attributes attrs{util::Attributes::allocator_type(arena)};
+    attrs.insert(std::make_move_iterator(attrs_.begin()), std::make_move_iterator(attrs_.end()));
+    attrs_ = std::move(attrs);
+  }
+  Rebind(genotypes_, arena);
+  Rebind(record_, arena);
+}
+
+bool VariantContext::FindGenotypeIndex(const Sample &sample, size_t &index) const {
+  if (sample_index_) {
+    auto i = sample_index_->find(sample);
+    if (i == sample_index_->end()) return false;
+    index = i->second;
+    return true;
+  }
+  DecodeGenotypes();
   auto r = std::find_if(genotypes_.begin(), genotypes_.end(),
                         [&](const Genotype &g) { return g.sample() == sample; });
-  if (r == genotypes_.end()) throw util::no_such_sample();
-  return *r;
+  if (r == genotypes_.end()) return false;
+  index = r - genotypes_.begin();
+  return true;
+}
+
+size_t VariantContext::GenotypeIndex(const Sample &sample) const {
+  size_t index;
+  if (!FindGenotypeIndex(sample, index)) throw util::no_such_sample();
+  return index;
+}
+
+const Genotype &VariantContext::GetGenotype(const Sample &sample) const {
+  size_t index = GenotypeIndex(sample);
+  DecodeGenotypes();
+  return genotypes_[index];
 }
 
 Genotype VariantContext::GetGenotypeOrNoCall(const Sample &sample) const {
-  // TODO: Sort genotypes for quicker access
-  auto r = std::find_if(genotypes_.begin(), genotypes_.end(),
-                        [&](const Genotype &g) { return g.sample() == sample; });
-  return (r == genotypes_.end()) ? Genotype(*this, sample, Genotype::kNone, {}) : *r;
+  size_t index;
+  if (!FindGenotypeIndex(sample, index)) return Genotype(sample, Genotype::kNone);
+  DecodeGenotypes();
+  return genotypes_[index];
+}
+
+const Genotype *VariantContext::FindGenotype(const Sample &sample) const {
+  size_t index;
+  if (!FindGenotypeIndex(sample, index)) return nullptr;
+  DecodeGenotypes();
+  return &genotypes_[index];
+}
+
+void VariantContext::GetFormatColumn(const util::Attributes::key_type &key,
+                                     FormatColumn &column) const {
+  if (decoder_ && !decoded_) {
+    decoder_->DecodeColumn(key, column);
+    return;
+  }
+  column.clear();
+  column.resize(genotypes_.size());
+  for (size_t i = 0; i < genotypes_.size(); i++) {
+    auto &attr = genotypes_[i].attributes();
+    auto value = attr.find(key);
+    if (value != attr.end()) column[i] = value->second;
+  }
 }
 
 void VariantContext::MergeGenotypes(Genotypes &&genotypes) {
+  MarkDirty();
+  DecodeGenotypes();
+  sample_index_.reset();
   // Append genotypes and remove duplicates
-  for (auto &gt : genotypes) {
-    genotypes_.emplace_back(*this, std::move(gt));
-  }
+  genotypes_.insert(genotypes_.end(), std::make_move_iterator(genotypes.begin()),
+                    std::make_move_iterator(genotypes.end()));
   // stable sort preferences original genotypes from the same sample
   // TODO: preference call in new genotypes over NO_CALL in original genotypes
   std::stable_sort(genotypes_.begin(), genotypes_.end(),
@@ -109,11 +207,24 @@ std::ostream &operator<<(std::ostream &os, const VariantContext &vc) {
 
 CompareVariants::result_type CompareVariants::operator()(const VariantContext &left,
                                                          const VariantContext &right) const {
-  if (left.contig_ != right.contig_) {
+  bool left_known = left.contig_id_ != kUnknownContigID,
+       right_known = right.contig_id_ != kUnknownContigID;
+  if (left_known != right_known) {
+    // Contigs in the dictionary precede those that aren't so that the ordering is consistent
+    return left_known ? result_type::BEFORE : result_type::AFTER;
+  } else if (left_known) {
+    // Contigs are in dictionary (i.e. genome) order, compare contig and position as a single key
+    auto left_key = left.ContigPosKey(), right_key = right.ContigPosKey();
+    if (left_key != right_key)
+      return (left_key < right_key) ? result_type::BEFORE : result_type::AFTER;
+  } else if (left.contig_ != right.contig_) {
+    // Fall back to lexicographic order for contigs that aren't in a dictionary
     return (left.contig_ < right.contig_) ? result_type::BEFORE : result_type::AFTER;
   } else if (left.pos_ != right.pos_) {
     return (left.pos_ < right.pos_) ? result_type::BEFORE : result_type::AFTER;
-  } else if (left.end_ != right.end_) {
+  }
+
+  if (left.end_ != right.end_) {
     return (left.end_ < right.end_) ? result_type::BEFORE : result_type::AFTER;
   } else if (left.alts_ != right.alts_) {
     // Check for different kinds of overlap (including partial overlap)
@@ -0,0 +1,83 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "aseq/io/vcf.hpp"
+#include "aseq/model/variant_context.hpp"
+
+using namespace aseq::io;
+using namespace aseq::model;
+
+// Count heap allocations. The global allocation functions are replaced for the whole executable,
+// which is why these tests are built separately from aseqlib-test.
+namespace {
+std::atomic<size_t> allocations_g(0);
+}
+
+void* operator new(std::size_t size) {
+  allocations_g.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Records (and their genotypes) are allocated from a per-record arena so the number of heap
+// allocations per record shouldn't grow with the number of samples
+TEST(VCFSourceAllocationTest, BoundsAllocationsPerRecord) {
+  const int kSamples = 50, kVariants = 200;
+
+  std::stringstream content;
+  content << "##fileformat=VCFv4.2\n"
+          << "##INFO=<ID=AC,Number=A,Type=Integer,Description=\"Allele count\">\n"
+          << "##INFO=<ID=AN,Number=1,Type=Integer,Description=\"Total alleles\">\n"
+          << "##INFO=<ID=DP,Number=1,Type=Integer,Description=\"Total depth\">\n"
+          << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+          << "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"Allelic depths\">\n"
+          << "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Depth\">\n"
+          << "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"Genotype quality\">\n"
+          << "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"Likelihoods\">\n"
+          << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT";
+  for (int s = 0; s < kSamples; s++) content << "\tNA" << s;
+  content << "\n";
+  for (int i = 1; i <= kVariants; i++) {
+    content << "1\t" << i * 1000 << "\trs" << i << "\tA\tG\t" << i << ".5\tPASS\tAC=1;AN="
+            << 2 * kSamples << ";DP=" << 60 * kSamples << "\tGT:AD:DP:GQ:PL";
+    for (int s = 0; s < kSamples; s++) {
+      int d = (i * 31 + s * 17) % 60;
+      content << "\t0/1:" << d << "," << 60 - d << ":60:" << d % 99 << ":" << d * 10 << ",0,"
+              << d * 20;
+    }
+    content << "\n";
+  }
+
+  // Allocations per record when each variant is returned by value and when a context is reused
+  for (bool reuse : {false, true}) {
+    std::stringstream input(content.str());
+    auto source = VCFSource::MakeVariantSource(input);
+    ASSERT_TRUE(source);
+
+    size_t sites = 0, genotypes = 0;
+    size_t start = allocations_g.load();
+    if (reuse) {
+      VariantContext v;
+      while (source->NextVariant(v)) {
+        sites++;
+        genotypes += v.genotypes().size();
+      }
+    } else {
+      while (auto r = source->NextVariant()) {
+        sites++;
+        genotypes += r->genotypes().size();
+      }
+    }
+    size_t allocations = allocations_g.load() - start;
+    EXPECT_EQ(kVariants, sites);
+    EXPECT_EQ(kSamples * kVariants, genotypes);
+    EXPECT_LE(allocations, (reuse ? 1 : 10) * kVariants);
+  }
+}
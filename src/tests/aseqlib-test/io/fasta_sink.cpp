@@ -2,11 +2,18 @@
 // Created by Michael Linderman on 2/28/16.
 //
 
+#include <fstream>
+#include <iterator>
+
 #include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include <cppformat/format.h>
 
 #include "aseq/io/fasta.hpp"
+#include "aseq/io/reference.hpp"
 
 using namespace aseq::io;
+namespace fs = boost::filesystem;
 
 TEST(FastaSinkTest, WritesFastaEntryWithLineWrapping) {
   std::stringstream sink_stream;
@@ -16,3 +23,60 @@ TEST(FastaSinkTest, WritesFastaEntryWithLineWrapping) {
 
   EXPECT_EQ(std::string(">ref\nABCDE\nFGHIJ\nKL\n"), sink_stream.str());
 }
+
+class FastaSinkFileTest : public ::testing::Test {
+ protected:
+  FastaSinkFileTest() : directory_(fs::temp_directory_path() / fs::unique_path()) {
+    fs::create_directory(directory_);
+  }
+
+  virtual void SetUp() { ASSERT_TRUE(fs::exists(directory_)); }
+  virtual void TearDown() { fs::remove_all(directory_); }
+
+  static std::string MakeSequence(int i) {
+    std::string sequence;
+    for (int j = 0; j < 50 + i % 37; j++) sequence.push_back("ACGT"[(i + j * j) % 4]);
+    return sequence;
+  }
+
+  fs::path directory_;
+};
+
+TEST_F(FastaSinkFileTest, WritesIndexedFastaFile) {
+  auto file = directory_ / "test.fa";
+  {
+    FastaSink sink(file, 5);
+    sink.PushSequence("ref", "ABCDEFGHIJKL").PushSequence("alt", "MNOP");
+  }
+
+  std::ifstream fasta(file.native());
+  EXPECT_EQ(">ref\nABCDE\nFGHIJ\nKL\n>alt\nMNOP\n",
+            std::string(std::istreambuf_iterator<char>(fasta), std::istreambuf_iterator<char>()));
+
+  std::ifstream fai(file.native() + ".fai");
+  EXPECT_EQ("ref\t12\t5\t5\t6\nalt\t4\t25\t5\t6\n",
+            std::string(std::istreambuf_iterator<char>(fai), std::istreambuf_iterator<char>()));
+
+  ReferenceSource reference(file);
+  EXPECT_EQ("EFGHIJK", reference.Sequence("ref", 5, 11));
+  EXPECT_EQ("NOP", reference.Sequence("alt", 2, 4));
+}
+
+TEST_F(FastaSinkFileTest, WritesIndexedBGZFFastaFile) {
+  const int kSequences = 5000;  // Enough to span many BGZF blocks
+  auto file = directory_ / "test.fa.gz";
+  {
+    FastaSink sink(file, 60, 2);
+    for (int i = 0; i < kSequences; i++) {
+      sink.PushSequence(fmt::format("seq{}", i), MakeSequence(i));
+    }
+  }
+  ASSERT_TRUE(fs::exists(file.native() + ".fai"));
+  ASSERT_TRUE(fs::exists(file.native() + ".gzi"));
+
+  ReferenceSource reference(file);
+  for (int i = 0; i < kSequences; i += 97) {
+    auto sequence = MakeSequence(i);
+    EXPECT_EQ(sequence, reference.Sequence(fmt::format("seq{}", i), 1, sequence.size()));
+  }
+}
@@ -2,7 +2,10 @@
 // Created by Michael Linderman on 12/12/15.
 //
 
+#include <fstream>
+
 #include <gtest/gtest.h>
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <cppformat/format.h>
 
@@ -47,4 +50,257 @@ TEST_F(TabixLineReaderTest, ReadsLinesFromTabixFile) {
     EXPECT_GT(line->size(), 0);
   }
   EXPECT_FALSE(reader->ReadNextLine());
-}
\ No newline at end of file
+}
+TEST_F(TabixLineReaderTest, ReadsLinesWithMultipleThreads) {
+  auto reader = ASCIILineReaderInterface::MakeLineReader(file_, 4);
+  ASSERT_TRUE(reader);
+  EXPECT_TRUE(reader->IsIndexed());
+
+  auto expected = ASCIILineReaderInterface::MakeLineReader(file_);
+  while (auto line = expected->ReadNextLine()) {
+    auto actual = reader->ReadNextLine();
+    ASSERT_TRUE(actual);
+    EXPECT_EQ(boost::copy_range<std::string>(*line), boost::copy_range<std::string>(*actual));
+  }
+  EXPECT_FALSE(reader->ReadNextLine());
+}
+
+namespace {
+const int kVariants = 20000;
+}
+
+class MultiBlockTabixLineReaderTest : public ::testing::Test {
+ protected:
+  MultiBlockTabixLineReaderTest() : directory_(fs::temp_directory_path() / fs::unique_path()) {
+    fs::create_directory(directory_);
+    file_ = directory_ / "test.vcf.gz";
+  }
+
+  virtual void SetUp() {
+    ASSERT_TRUE(fs::exists(directory_));
+
+    // Generate enough variants to span many BGZF blocks, with some lines spanning blocks
+    auto writer = ASCIILineWriterInterface::MakeLineWriter(file_, aseq::io::FileFormat::VCF4_2);
+    writer->Write("##fileformat=VCFv4.2\n");
+    writer->Write("#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n");
+    for (int i = 1; i <= kVariants; i++) {
+      writer->Write(
+          fmt::format("1\t{}\t.\tA\tG\t.\t.\tDESC={}\n", i * 10, std::string(i % 97, 'X')));
+    }
+  }
+
+  virtual void TearDown() { fs::remove_all(directory_); }
+
+  fs::path directory_;
+  fs::path file_;
+};
+
+TEST_F(MultiBlockTabixLineReaderTest, ReadsLinesWithMultipleThreads) {
+  auto reader = ASCIILineReaderInterface::MakeLineReader(file_, 4);
+  ASSERT_TRUE(reader);
+
+  for (int i = 0; i < 2; i++) ASSERT_TRUE(reader->ReadNextLine());  // Header
+  for (int i = 1; i <= kVariants; i++) {
+    auto line = reader->ReadNextLine();
+    ASSERT_TRUE(line);
+    EXPECT_EQ(fmt::format("1\t{}\t.\tA\tG\t.\t.\tDESC={}", i * 10, std::string(i % 97, 'X')),
+              boost::copy_range<std::string>(*line));
+  }
+  EXPECT_FALSE(reader->ReadNextLine());
+}
+
+TEST_F(MultiBlockTabixLineReaderTest, ReadsRegionsWithMultipleThreads) {
+  auto reader = ASCIILineReaderInterface::MakeLineReader(file_, 4);
+  ASSERT_TRUE(reader);
+
+  for (int start : {95, 50000, 199990}) {
+    reader->SetRegion("1", start, start + 1000);
+    int i = (start + 9) / 10;
+    while (auto line = reader->ReadNextLine()) {
+      EXPECT_EQ(fmt::format("1\t{}\t.\tA\tG\t.\t.\tDESC={}", i * 10, std::string(i % 97, 'X')),
+                boost::copy_range<std::string>(*line));
+      i++;
+    }
+    EXPECT_EQ(std::min((start + 1000) / 10, kVariants) + 1, i);
+  }
+}
+
+TEST(MappedLineReaderTest, ReadsLinesFromUncompressedFile) {
+  auto file = test_inputs_g / "sites_only.vcf";
+  auto reader = ASCIILineReaderInterface::MakeLineReader(file);
+  ASSERT_TRUE(reader);
+  EXPECT_FALSE(reader->IsIndexed());
+
+  std::ifstream content(file.native());
+  auto expected = ASCIILineReaderInterface::MakeLineReader(content);
+
+  while (auto line = expected->ReadNextLine()) {
+    auto actual = reader->ReadNextLine();
+    ASSERT_TRUE(actual);
+    EXPECT_EQ(boost::copy_range<std::string>(*line), boost::copy_range<std::string>(*actual));
+  }
+  EXPECT_FALSE(reader->ReadNextLine());
+}
+
+TEST(MappedLineReaderTest, ReadsFinalLineWithoutNewline) {
+  auto directory = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directory(directory);
+  auto file = directory / "test.txt";
+  {
+    std::ofstream content(file.native());
+    content << "line1\n\nline3";
+  }
+
+  {
+    auto reader = ASCIILineReaderInterface::MakeLineReader(file);
+    ASSERT_TRUE(reader);
+    for (auto expected : {"line1", "", "line3"}) {
+      auto line = reader->ReadNextLine();
+      ASSERT_TRUE(line);
+      EXPECT_EQ(expected, boost::copy_range<std::string>(*line));
+    }
+    EXPECT_FALSE(reader->ReadNextLine());
+  }
+
+  fs::remove_all(directory);
+}
+
+TEST(LineBatchTest, ReadsBatchesOfLines) {
+  std::stringstream content("line1\nline2\nline3\n");
+  auto reader = ASCIILineReaderInterface::MakeLineReader(content);
+  ASSERT_TRUE(reader);
+
+  LineBatch batch(2);
+  EXPECT_EQ(2, reader->ReadNextLines(batch));
+  EXPECT_TRUE(batch.full());
+  EXPECT_EQ("line1", boost::copy_range<std::string>(batch[0]));
+  EXPECT_EQ("line2", boost::copy_range<std::string>(batch[1]));
+
+  batch.clear();
+  EXPECT_EQ(1, reader->ReadNextLines(batch));
+  EXPECT_EQ("line3", boost::copy_range<std::string>(batch[0]));
+
+  batch.clear();
+  EXPECT_EQ(0, reader->ReadNextLines(batch));
+  EXPECT_TRUE(batch.empty());
+}
+
+TEST(LineBatchTest, ReadsBatchesFromMappedAndTabixFiles) {
+  for (auto file : {"sites_only.vcf", "sites_only.vcf.gz"}) {
+    auto expected = ASCIILineReaderInterface::MakeLineReader(test_inputs_g / file);
+    auto reader = ASCIILineReaderInterface::MakeLineReader(test_inputs_g / file);
+
+    LineBatch batch(3);
+    while (reader->ReadNextLines(batch) > 0) {
+      for (size_t i = 0; i < batch.size(); i++) {
+        auto line = expected->ReadNextLine();
+        ASSERT_TRUE(line);
+        EXPECT_EQ(boost::copy_range<std::string>(*line), boost::copy_range<std::string>(batch[i]));
+      }
+      batch.clear();
+    }
+    EXPECT_FALSE(expected->ReadNextLine());
+  }
+}
+
+TEST_F(MultiBlockTabixLineReaderTest, ReadsMultipleRegionsOnce) {
+  using aseq::model::Region;
+
+  auto reader = ASCIILineReaderInterface::MakeLineReader(file_, 4);
+  ASSERT_TRUE(reader);
+
+  // Overlapping and adjacent regions, out of order
+  reader->SetRegions({Region("1", 150001, 160000), Region("1", 95, 1000), Region("1", 500, 2000),
+                      Region("1", 2001, 2100), Region("1", 155001, 170000)});
+
+  std::vector<int> expected;
+  for (int i = 10; i <= 210; i++) expected.push_back(i * 10);
+  for (int i = 15001; i <= 17000; i++) expected.push_back(i * 10);
+
+  std::vector<int> actual;
+  while (auto line = reader->ReadNextLine()) {
+    std::vector<std::string> fields;
+    boost::split(fields, *line, boost::is_any_of("\t"));
+    actual.push_back(std::stoi(fields[1]));
+  }
+  EXPECT_EQ(expected, actual);
+}
+
+TEST_F(MultiBlockTabixLineReaderTest, ReadsShardsWithoutIndex) {
+  fs::remove(file_.native() + ".tbi");
+
+  for (size_t shards : {1, 3, 7, 64}) {
+    auto reader = ASCIILineReaderInterface::MakeLineReader(file_);
+    ASSERT_TRUE(reader);
+    EXPECT_FALSE(reader->IsIndexed());
+    ASSERT_TRUE(reader->IsShardable());
+    for (int i = 0; i < 2; i++) ASSERT_TRUE(reader->ReadNextLine());  // Header
+
+    // Concatenated shards should contain every line exactly once, in order
+    int i = 1;
+    for (size_t s = 0; s < shards; s++) {
+      auto shard = reader->MakeShard(s, shards);
+      ASSERT_TRUE(shard);
+      while (auto line = shard->ReadNextLine()) {
+        ASSERT_LE(i, kVariants);
+        EXPECT_EQ(fmt::format("1\t{}\t.\tA\tG\t.\t.\tDESC={}", i * 10, std::string(i % 97, 'X')),
+                  boost::copy_range<std::string>(*line));
+        i++;
+      }
+    }
+    EXPECT_EQ(kVariants + 1, i);
+  }
+}
+
+TEST(MappedLineReaderTest, ReadsShards) {
+  auto file = test_inputs_g / "sites_only.vcf";
+  std::ifstream content(file.native());
+  auto expected_reader = ASCIILineReaderInterface::MakeLineReader(content);
+  std::vector<std::string> expected;
+  while (auto line = expected_reader->ReadNextLine()) {
+    if (!boost::starts_with(*line, "#")) expected.push_back(boost::copy_range<std::string>(*line));
+  }
+
+  for (size_t shards : {1, 2, 5, 1000}) {
+    auto reader = ASCIILineReaderInterface::MakeLineReader(file);
+    ASSERT_TRUE(reader);
+    ASSERT_TRUE(reader->IsShardable());
+    while (auto line = reader->ReadNextLine()) {  // Header
+      if (boost::starts_with(*line, "#CHROM")) break;
+    }
+
+    std::vector<std::string> actual;
+    for (size_t s = 0; s < shards; s++) {
+      auto shard = reader->MakeShard(s, shards);
+      LineBatch batch(2);
+      while (shard->ReadNextLines(batch) > 0) {
+        for (size_t i = 0; i < batch.size(); i++)
+          actual.push_back(boost::copy_range<std::string>(batch[i]));
+        batch.clear();
+      }
+    }
+    EXPECT_EQ(expected, actual);
+  }
+}
+
+TEST(BEDRegionsTest, ReadsRegionsWithClosedCoordinates) {
+  std::stringstream content(
+      "track name=test\n#comment\nchr1\t0\t100\n\nchr2\t1000\t2000\tname\t0\t+\n");
+  auto reader = ASCIILineReaderInterface::MakeLineReader(content);
+  auto regions = ReadBEDRegions(*reader);
+  ASSERT_EQ(2, regions.size());
+  EXPECT_EQ(aseq::model::Contig("chr1"), regions[0].contig());
+  EXPECT_EQ(1, regions[0].pos());
+  EXPECT_EQ(100, regions[0].end());
+  EXPECT_EQ(aseq::model::Contig("chr2"), regions[1].contig());
+  EXPECT_EQ(1001, regions[1].pos());
+  EXPECT_EQ(2000, regions[1].end());
+
+  using aseq::util::file_parse_error;
+  for (auto invalid : {"chr1\t0", "chr1\t0\t", "chr1\tx\t100", "chr1\t0\t10x", "chr1\t-1\t100",
+                       "chr1\t100\t0", "chr1\t0\t99999999999999999999"}) {
+    std::stringstream bad(invalid);
+    auto bad_reader = ASCIILineReaderInterface::MakeLineReader(bad);
+    EXPECT_THROW(ReadBEDRegions(*bad_reader), file_parse_error) << invalid;
+  }
+}
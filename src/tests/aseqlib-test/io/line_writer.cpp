@@ -3,6 +3,7 @@
 //
 
 #include <fstream>
+#include <iostream>
 #include <istream>
 
 #include <gtest/gtest.h>
@@ -28,6 +29,46 @@ TEST(ASCIIStreamWriterTest, WritesLinesToASCIIStream) {
   EXPECT_EQ("line1\nline2\nline3\n", sink_stream.str());
 }
 
+TEST(ASCIIBufferedWriterTest, WritesBufferedLinesOnFlush) {
+  std::stringstream sink_stream;
+
+  auto writer = ASCIILineWriterInterface::MakeBufferedLineWriter(sink_stream);
+  ASSERT_TRUE(writer);
+
+  writer->Write("line1\n");
+  ASSERT_NE(nullptr, writer->buffer());
+  writer->buffer()->append("line2\n");  // Lines can also be formatted directly into the buffer
+  writer->Commit();
+  EXPECT_EQ("", sink_stream.str());
+
+  writer->Flush();
+  EXPECT_EQ("line1\nline2\n", sink_stream.str());
+
+  // Large outputs are written in multiple blocks (in order)
+  std::string expected = sink_stream.str();
+  for (int i = 3; i <= 1000000; i++) {
+    auto line = fmt::format("line{}\n", i);
+    writer->Write(line);
+    expected += line;
+  }
+  writer.reset();
+  EXPECT_EQ(expected, sink_stream.str());
+}
+
+TEST(ASCIIBufferedWriterTest, WritesThroughRedirectedStreamBuffer) {
+  std::stringstream sink_stream;
+  auto original = std::cout.rdbuf(sink_stream.rdbuf());
+  {
+    std::cout << "before\n";
+    auto writer = ASCIILineWriterInterface::MakeBufferedLineWriter(std::cout);
+    writer->Write("line1\n");
+    writer->Flush();
+    std::cout << "after\n";
+  }
+  std::cout.rdbuf(original);
+  EXPECT_EQ("before\nline1\nafter\n", sink_stream.str());
+}
+
 class BGZipLineWriterTest : public ::testing::Test {
  protected:
   BGZipLineWriterTest() : directory_(fs::temp_directory_path() / fs::unique_path()) {
@@ -42,6 +83,24 @@ class BGZipLineWriterTest : public ::testing::Test {
   fs::path file_;
 };
 
+TEST_F(BGZipLineWriterTest, WritesLinesToUncompressedFile) {
+  file_ = directory_ / "test.vcf";
+  {
+    auto writer = ASCIILineWriterInterface::MakeLineWriter(file_);
+    ASSERT_TRUE(writer);
+    for (int i = 1; i <= 3; i++) {
+      writer->Write(fmt::format("line{}\n", i));
+    }
+  }
+
+  std::ifstream file(file_.native());
+  for (int i = 1; i <= 3; i++) {
+    std::string line;
+    std::getline(file, line);
+    EXPECT_EQ(fmt::format("line{}", i), line);
+  }
+}
+
 TEST_F(BGZipLineWriterTest, WriteLinesToBGZipFile) {
   using namespace boost::iostreams;
 
@@ -63,4 +122,46 @@ TEST_F(BGZipLineWriterTest, WriteLinesToBGZipFile) {
     std::getline(in, line);
     EXPECT_EQ(fmt::format("line{}", i), line);
   }
-}
\ No newline at end of file
+}
+
+TEST_F(BGZipLineWriterTest, ReportsErrorsOnClose) {
+  fs::create_symlink("/dev/full", file_);  // Writes fail with ENOSPC
+  auto writer = ASCIILineWriterInterface::MakeLineWriter(file_);
+  ASSERT_TRUE(writer);
+  writer->Write("line1\n");
+  EXPECT_THROW(writer->Close(), aseq::util::file_write_error);
+  EXPECT_NO_THROW(writer.reset());  // Errors are only reported once
+}
+
+TEST_F(BGZipLineWriterTest, WritesIndexedVCFWithMultipleThreads) {
+  const int kVariants = 20000;
+  file_ = directory_ / "test.vcf.gz";
+  {
+    auto writer = ASCIILineWriterInterface::MakeLineWriter(file_, FileFormat::VCF4_2, 4);
+    ASSERT_TRUE(writer);
+    writer->Write("##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n");
+    for (int i = 1; i <= kVariants; i++) {
+      // Split some records across writes to exercise indexing of partial lines
+      writer->Write(fmt::format("{}\t{}\t.\tA\tG\t.\t.\t", (i <= kVariants / 2) ? 1 : 2, i * 10));
+      writer->Write(fmt::format("DESC={}\n", std::string(i % 97, 'X')));
+    }
+  }
+  ASSERT_TRUE(fs::exists(file_.native() + ".tbi"));
+
+  auto reader = ASCIILineReaderInterface::MakeLineReader(file_);
+  ASSERT_TRUE(reader->IsIndexed());
+
+  for (int i = 0; i < 2; i++) ASSERT_TRUE(reader->ReadNextLine());  // Header
+  int count = 0;
+  while (reader->ReadNextLine()) count++;
+  EXPECT_EQ(kVariants, count);
+
+  reader->SetRegion("2", 100001, 100100);
+  for (int i = 10001; i <= 10010; i++) {
+    auto line = reader->ReadNextLine();
+    ASSERT_TRUE(line);
+    EXPECT_EQ(fmt::format("2\t{}\t.\tA\tG\t.\t.\tDESC={}", i * 10, std::string(i % 97, 'X')),
+              boost::copy_range<std::string>(*line));
+  }
+  EXPECT_FALSE(reader->ReadNextLine());
+}
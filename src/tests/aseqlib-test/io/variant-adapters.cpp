@@ -6,6 +6,7 @@
 #include <boost/filesystem.hpp>
 
 #include "aseq/io/variant-adapters.hpp"
+#include "aseq/io/vcf.hpp"
 
 using namespace aseq::io;
 using namespace aseq::model;
@@ -71,6 +72,105 @@ TEST(VariantMergingSourceTest, MergesSitesOnlyVariantsInOrder) {
   EXPECT_FALSE(v);
 }
 
+TEST(VariantMergingSourceTest, MergesVariantsInContigDictionaryOrder) {
+  auto vcf1 =
+      "##fileformat=VCFv4.2\n"
+      "##contig=<ID=chr2>\n"
+      "##contig=<ID=chr10>\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+      "chr2\t5\t.\tA\tT\t.\t.\t.\n"
+      "chr10\t1\t.\tA\tT\t.\t.\t.";
+  auto vcf2 =  // Contigs absent from the first file are ordered after its contigs
+      "##fileformat=VCFv4.2\n"
+      "##contig=<ID=chr10>\n"
+      "##contig=<ID=chr1>\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+      "chr10\t2\t.\tC\tG\t.\t.\t.\n"
+      "chr1\t3\t.\tC\tG\t.\t.\t.";
+  std::stringstream variants1(vcf1), variants2(vcf2);
+  auto source = VariantMergeSourceInterface::MakeMergeVariantSource(
+      VariantSourceInterface::MakeVariantSource(variants1),
+      VariantSourceInterface::MakeVariantSource(variants2));
+  ASSERT_TRUE(source);
+
+  auto& contigs = static_cast<const VCFHeader&>(source->header()).contigs();
+  ASSERT_EQ(3, contigs.size());
+  EXPECT_EQ(2, contigs.Find("chr1"));
+
+  // chr2 before chr10 (not lexicographic order), chr1 is after all of the first file's contigs
+  std::vector<std::pair<std::string, Pos> > expected{
+      {"chr2", 5}, {"chr10", 1}, {"chr10", 2}, {"chr1", 3}};
+  for (auto& e : expected) {
+    auto v = source->NextVariant();
+    ASSERT_TRUE(v);
+    EXPECT_EQ(Contig(e.first), v->contig());
+    EXPECT_EQ(e.second, v->pos());
+    EXPECT_EQ(contigs.Find(v->contig()), v->contig_id());
+  }
+  EXPECT_FALSE(source->NextVariant());
+}
+
+TEST(VariantMergingSourceTest, MergesVariantsFromSourcesWithoutContigLines) {
+  auto vcf1 =
+      "##fileformat=VCFv4.2\n"
+      "##contig=<ID=chr2>\n"
+      "##contig=<ID=chr10>\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+      "chr2\t5\t.\tA\tT\t.\t.\t.\n"
+      "chr10\t1\t.\tA\tT\t.\t.\t.";
+  auto vcf2 =  // Contigs are looked up by name in the merged dictionary
+      "##fileformat=VCFv4.2\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+      "chr2\t6\t.\tC\tG\t.\t.\t.\n"
+      "chr10\t2\t.\tC\tG\t.\t.\t.";
+  std::stringstream variants1(vcf1), variants2(vcf2);
+  auto source = VariantMergeSourceInterface::MakeMergeVariantSource(
+      VariantSourceInterface::MakeVariantSource(variants1),
+      VariantSourceInterface::MakeVariantSource(variants2));
+  ASSERT_TRUE(source);
+
+  std::vector<std::pair<std::string, Pos> > expected{
+      {"chr2", 5}, {"chr2", 6}, {"chr10", 1}, {"chr10", 2}};
+  for (auto& e : expected) {
+    auto v = source->NextVariant();
+    ASSERT_TRUE(v);
+    EXPECT_EQ(Contig(e.first), v->contig());
+    EXPECT_EQ(e.second, v->pos());
+  }
+  EXPECT_FALSE(source->NextVariant());
+}
+
+TEST(VariantMergingSourceTest, RefillsReusedVariantContext) {
+  using SourceLabel = VariantMergeSourceInterface::SourceLabel;
+
+  auto vcf1 =
+      "##fileformat=VCFv4.2\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+      "1\t1\t.\tA\tT\t.\t.\t.\n"
+      "1\t3\t.\tG\tC\t.\t.\t.";
+  auto vcf2 =
+      "##fileformat=VCFv4.2\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+      "1\t2\t.\tC\tG\t.\t.\t.\n"
+      "1\t3\t.\tG\tC\t.\t.\t.";
+  std::stringstream variants1(vcf1), variants2(vcf2);
+  auto source = VariantMergeSourceInterface::MakeMergeVariantSource(
+      VariantSourceInterface::MakeVariantSource(variants1),
+      VariantSourceInterface::MakeVariantSource(variants2));
+  ASSERT_TRUE(source);
+
+  VariantContext v;
+  std::vector<std::pair<Pos, SourceLabel>> expected{{1, source->source1_label()},
+                                                    {2, source->source2_label()},
+                                                    {3, source->merged_label()}};
+  for (auto& e : expected) {
+    ASSERT_TRUE(source->NextVariant(v));
+    EXPECT_EQ(e.first, v.pos());
+    EXPECT_EQ(e.second, v.GetAttribute<SourceLabel>(source->source_key()));
+  }
+  EXPECT_FALSE(source->NextVariant(v));
+}
+
 TEST(VariantMergingSourceTest, CombinesDifferentComponentsOfSitesOnlyVariants) {
   using SourceLabel = VariantMergeSourceInterface::SourceLabel;
 
@@ -6,6 +6,7 @@
 
 #include <gtest/gtest.h>
 #include <boost/filesystem.hpp>
+#include <cppformat/format.h>
 
 #include "aseq/model/variant_context.hpp"
 #include "aseq/model/genotype.hpp"
@@ -75,6 +76,21 @@ TEST_P(VCFSitesOnlySourceTest, IteratesAndParsesVariants) {
   });
 }
 
+TEST_P(VCFSitesOnlySourceTest, IteratesShards) {
+  auto source = VariantSourceInterface::MakeVariantSource(file_);
+  ASSERT_TRUE(source);
+  ASSERT_TRUE(source->IsShardable());
+
+  std::vector<aseq::model::Pos> positions;
+  for (size_t s = 0; s < 2; s++) {
+    auto shard = source->MakeShard(s, 2);
+    ASSERT_TRUE(shard);
+    EXPECT_EQ(3, boost::size(dynamic_cast<VCFSource*>(shard.get())->header().INFOValues()));
+    while (auto r = shard->NextVariant()) positions.push_back(r->pos());
+  }
+  EXPECT_EQ(std::vector<aseq::model::Pos>({11916414, 11916594, 11916764}), positions);
+}
+
 INSTANTIATE_TEST_CASE_P(VCFSitesOnly, VCFSitesOnlySourceTest,
                         ::testing::Values("sites_only.vcf", "sites_only.vcf.gz"));
 
@@ -132,6 +148,137 @@ TEST_P(VCFSpecificationSourceTest, IteratesAndParsesVariants) {
   EXPECT_FALSE(r);  // There are five variants in the file
 }
 
+TEST_P(VCFSpecificationSourceTest, ParsesProjectedFieldsAndSamples) {
+  using aseq::util::Attributes;
+  auto source = VariantSourceInterface::MakeVariantSource(file_);
+  ASSERT_TRUE(source);
+
+  VariantProjection projection;
+  projection.info = std::vector<VariantProjection::Key>{"DP"};
+  projection.format = std::vector<VariantProjection::Key>{"GQ"};
+  projection.samples = std::vector<aseq::model::Sample>{"NA00003", "NA00002"};
+  source->SetProjection(projection);
+
+  // 20 14370 rs6054257 G A 29 PASS NS=3;DP=14;AF=0.5;DB;H2 GT:GQ:DP:HQ ... 1|0:48:8:51,51 1/1:43:5:.,.
+  auto r = source->NextVariant();
+  ASSERT_TRUE(r);
+  EXPECT_EQ(14, r->GetAttribute<Attributes::Integer>("DP"));
+  EXPECT_FALSE(r->HasAttribute("NS"));
+  EXPECT_FALSE(r->HasAttribute("DB"));
+
+  ASSERT_EQ(2, r->NumGenotypes());
+  auto& gt = r->GetGenotype("NA00002");
+  EXPECT_EQ(aseq::model::Genotype::kAltRefP, gt.alleles());  // GT is always parsed
+  EXPECT_EQ(48, gt.GetAttribute<Attributes::Integer>("GQ"));
+  EXPECT_FALSE(gt.HasAttribute("DP"));
+  EXPECT_EQ(43, r->GetGenotype("NA00003").GetAttribute<Attributes::Integer>("GQ"));
+  EXPECT_THROW(r->GetGenotype("NA00001"), aseq::util::no_such_sample);
+}
+
+TEST_P(VCFSpecificationSourceTest, RefillsReusedVariantContext) {
+  auto expected = VariantSourceInterface::MakeVariantSource(file_);
+  auto source = VariantSourceInterface::MakeVariantSource(file_);
+  ASSERT_TRUE(expected && source);
+
+  aseq::model::VariantContext v;
+  while (auto e = expected->NextVariant()) {
+    ASSERT_TRUE(source->NextVariant(v));
+    EXPECT_EQ(e->pos(), v.pos());
+    EXPECT_EQ(e->end(), v.end());
+    EXPECT_EQ(e->ref(), v.ref());
+    EXPECT_EQ(e->alts(), v.alts());
+    EXPECT_EQ(e->ids(), v.ids());
+    EXPECT_EQ(e->qual(), v.qual());
+    EXPECT_EQ(e->filters(), v.filters());
+    EXPECT_EQ(e->attributes().size(), v.attributes().size());
+
+    ASSERT_EQ(e->NumGenotypes(), v.NumGenotypes());
+    for (auto& gt : e->genotypes()) {
+      auto& reused = v.GetGenotype(gt.sample());
+      EXPECT_EQ(gt.sample(), reused.sample());
+      EXPECT_EQ(gt.alleles(), reused.alleles());
+      EXPECT_EQ(gt.attributes().size(), reused.attributes().size());
+    }
+  }
+  EXPECT_FALSE(source->NextVariant(v));
+}
+
+TEST_P(VCFSpecificationSourceTest, DecodesFORMATColumns) {
+  using aseq::util::Attributes;
+  auto source = VariantSourceInterface::MakeVariantSource(file_);
+  ASSERT_TRUE(source);
+
+  const std::vector<Attributes::key_type> keys{"GQ", "DP", "HQ", "GT", "XX"};
+  std::vector<aseq::model::VariantContext::FormatColumn> columns(keys.size());
+  aseq::model::VariantContext::FormatColumn decoded;
+  while (auto r = source->NextVariant()) {
+    const auto& v = *r;
+    for (size_t k = 0; k < keys.size(); k++) {
+      v.GetFormatColumn(keys[k], columns[k]);  // From the undecoded sample columns
+      ASSERT_EQ(v.NumGenotypes(), columns[k].size());
+    }
+    for (size_t k = 0; k < keys.size(); k++) {
+      v.GetFormatColumn(keys[k], decoded);  // From the decoded genotypes
+      ASSERT_EQ(v.NumGenotypes(), decoded.size());
+      for (auto& gt : v.genotypes()) {
+        size_t g = v.GenotypeIndex(gt.sample());
+        auto expected = gt.GetAttributeOr(keys[k], Attributes::mapped_type());
+        EXPECT_EQ(expected.empty(), columns[k][g].empty());
+        EXPECT_EQ(expected.empty(), decoded[g].empty());
+        if (!expected.empty()) {
+          EXPECT_EQ(fmt::format("{}", expected), fmt::format("{}", columns[k][g]));
+          EXPECT_EQ(fmt::format("{}", expected), fmt::format("{}", decoded[g]));
+        }
+      }
+    }
+  }
+}
+
+TEST_P(VCFSpecificationSourceTest, IndexesProjectedSamples) {
+  using aseq::util::Attributes;
+  auto source = VariantSourceInterface::MakeVariantSource(file_);
+  ASSERT_TRUE(source);
+
+  VariantProjection projection;
+  projection.samples = std::vector<aseq::model::Sample>{"NA00003", "NA00002"};
+  source->SetProjection(projection);
+
+  // 20 14370 rs6054257 G A 29 PASS NS=3;DP=14;AF=0.5;DB;H2 GT:GQ:DP:HQ ... 1|0:48:8:51,51 1/1:43:5:.,.
+  auto r = source->NextVariant();
+  ASSERT_TRUE(r);
+  EXPECT_EQ(0, r->GenotypeIndex("NA00003"));
+  EXPECT_EQ(1, r->GenotypeIndex("NA00002"));
+  EXPECT_THROW(r->GenotypeIndex("NA00001"), aseq::util::no_such_sample);
+
+  aseq::model::VariantContext::FormatColumn column;
+  r->GetFormatColumn("DP", column);
+  ASSERT_EQ(2, column.size());
+  EXPECT_EQ(5, column[0].cast<Attributes::Integer>());
+  EXPECT_EQ(8, column[1].cast<Attributes::Integer>());
+}
+
+TEST_P(VCFSpecificationSourceTest, RetainsRecordsAfterProjectionIsReset) {
+  auto source = VariantSourceInterface::MakeVariantSource(file_);
+  ASSERT_TRUE(source);
+
+  auto r = source->NextVariant();
+  ASSERT_TRUE(r);
+  EXPECT_TRUE(r->HasCleanRecord());
+
+  VariantProjection projection;
+  projection.info = std::vector<VariantProjection::Key>{"DP"};
+  source->SetProjection(projection);
+  r = source->NextVariant();
+  ASSERT_TRUE(r);
+  EXPECT_FALSE(r->HasCleanRecord());  // The line has fields missing from the projected variant
+
+  source->SetProjection(VariantProjection());
+  r = source->NextVariant();
+  ASSERT_TRUE(r);
+  EXPECT_TRUE(r->HasCleanRecord());
+  EXPECT_TRUE(r->HasAttribute("NS"));
+}
+
 INSTANTIATE_TEST_CASE_P(VCFSpecification, VCFSpecificationSourceTest,
                         ::testing::Values("vcf_specification.vcf"));
 
@@ -176,4 +323,55 @@ TEST_F(VCFSVSourceQueryTest, ShouldNotReturnSVOutsideQuery) {
     auto r = source_->NextVariant();
     EXPECT_FALSE(r);
   });
-}
\ No newline at end of file
+}
+TEST_F(VCFSVSourceQueryTest, QueriesMultipleRegions) {
+  using aseq::model::Region;
+
+  source_->SetRegions({Region("2", 321880, 321890), Region("1", 2827698, 2827698),
+                       Region("2", 321700, 321800), Region("X", 1, 1000)});
+  auto r = source_->NextVariant();
+  ASSERT_TRUE(r);
+  EXPECT_EQ(2827694, r->pos());
+
+  r = source_->NextVariant();
+  ASSERT_TRUE(r);  // Overlaps multiple regions, but should only be returned once
+  EXPECT_EQ(321682, r->pos());
+
+  EXPECT_FALSE(source_->NextVariant());
+}
+
+TEST(VCFParallelSourceTest, ParsesVariantsInOrderWithMultipleThreads) {
+  auto directory = fs::temp_directory_path() / fs::unique_path();
+  fs::create_directory(directory);
+  auto file = directory / "test.vcf";
+  {
+    // Enough variants for many batches, with an undefined INFO field that must be auto-generated
+    std::ofstream content(file.native());
+    content << "##fileformat=VCFv4.2\n"
+            << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+            << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tNA1\tNA2\n";
+    for (int i = 1; i <= 10000; i++) {
+      content << "1\t" << i << "\t.\tA\tG\t.\tPASS\tXX=" << i << "\tGT\t0/1\t1/1\n";
+    }
+  }
+
+  {
+    auto source = VariantSourceInterface::MakeVariantSource(file, 4);
+    ASSERT_TRUE(source);
+
+    int i = 1;
+    while (auto r = source->NextVariant()) {
+      EXPECT_EQ(i, r->pos());
+      EXPECT_EQ(2, r->NumGenotypes());
+      EXPECT_EQ(std::vector<std::string>({std::to_string(i)}),
+                r->GetAttribute<std::vector<std::string>>("XX"));
+      i++;
+    }
+    EXPECT_EQ(10001, i);
+
+    auto& header = dynamic_cast<VCFSource*>(source.get())->header();
+    EXPECT_TRUE(header.HasINFOField("XX"));
+  }
+
+  fs::remove_all(directory);
+}
@@ -2,6 +2,10 @@
 // Created by Michael Linderman on 3/6/16.
 //
 
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
 #include <cppformat/format.h>
 #include <gtest/gtest.h>
 #include <boost/filesystem.hpp>
@@ -57,6 +61,24 @@ TEST_F(VCFVariantGeneratingTest, GeneratesVCFHeaderWithSamples) {
   }
 }
 
+TEST_F(VCFVariantGeneratingTest, GeneratesVCFHeaderWithContigs) {
+  header_.AddContig("chr2", 242193529);
+  header_.AddContig("chr10");
+
+  std::stringstream content;
+  VCFSink sink(header_, ASCIILineWriterInterface::MakeLineWriter(content));
+  EXPECT_NE(std::string::npos, content.str().find("##contig=<ID=chr2,length=242193529>\n"));
+  EXPECT_NE(std::string::npos, content.str().find("##contig=<ID=chr10>\n"));
+
+  auto source = VariantSourceInterface::MakeVariantSource(content);
+  ASSERT_TRUE(source);
+  auto& contigs = dynamic_cast<VCFSource*>(source.get())->header().contigs();
+  ASSERT_EQ(2, contigs.size());
+  EXPECT_EQ(0, contigs.Find("chr2"));
+  EXPECT_EQ(242193529, contigs[0].length);
+  EXPECT_EQ(1, contigs.Find("chr10"));
+}
+
 TEST_F(VCFVariantGeneratingTest, GeneratesSitesOnlyVariants) {
   using aseq::io::impl::GenerateVCFVariant;
   EXPECT_NO_THROW({
@@ -69,9 +91,9 @@ TEST_F(VCFVariantGeneratingTest, GeneratesSitesOnlyVariants) {
     header_.AddFILTERField(VCFHeader::Field("FAIL", "Failed filter"));
 
     VariantContext cxt("1", 1, Allele::A, {Allele::T, Allele::C});
-    cxt.ids_ = VariantContext::IDs({"rs100", "rs101"});
-    cxt.qual_ = 100.0;
-    cxt.filters_ = VariantContext::Filters({VCFHeader::FILTER::PASS, "FAIL"});
+    cxt.ids() = VariantContext::IDs({"rs100", "rs101"});
+    cxt.SetQual(100.0f);
+    cxt.filters() = VariantContext::Filters({VCFHeader::FILTER::PASS, "FAIL"});
     cxt.SetAttribute(VCFHeader::INFO::AC, Attributes::Integers({1}));
 
     std::string line = GenerateVCFVariant(header_, cxt);
@@ -101,6 +123,251 @@ TEST_F(VCFVariantGeneratingTest, GeneratesVariantsWithSamples) {
   });
 }
 
+TEST_F(VCFVariantGeneratingTest, GeneratesShortestRoundTripFloats) {
+  using aseq::io::impl::GenerateVCFVariant;
+  header_.AddINFOField(VCFHeader::Field("FL", VCFHeader::Field::A, VCFHeader::Field::Type::FLOAT,
+                                        "Float values"));
+
+  VariantContext cxt("1", 1, Allele::A, Allele::T);
+  cxt.SetQual(29.5f);
+  cxt.SetAttribute("FL", Attributes::Floats({0.25f, 0.f, -3.f, 1e30f, 1.f / 3, 1.5e-5f}));
+  EXPECT_EQ("1\t1\t.\tA\tT\t29.5\t.\tFL=0.25,0.0,-3.0,1e+30,0.33333334,1.5e-05",
+            GenerateVCFVariant(header_, cxt));
+
+  // The formatted values parse to the same values
+  std::stringstream content;
+  {
+    VCFSink sink(header_, ASCIILineWriterInterface::MakeLineWriter(content));
+    sink.PushVariant(cxt);
+  }
+  auto source = VariantSourceInterface::MakeVariantSource(content);
+  ASSERT_TRUE(source);
+  auto result = source->NextVariant();
+  ASSERT_TRUE(result);
+  EXPECT_EQ(cxt.qual(), result->qual());
+  EXPECT_EQ(cxt.GetAttribute<Attributes::Floats>("FL"),
+            result->GetAttribute<Attributes::Floats>("FL"));
+}
+
+TEST_F(VCFVariantGeneratingTest, GeneratesGenotypesInHeaderOrder) {
+  using aseq::io::impl::GenerateVCFVariant;
+  header_.AddFORMATField(VCFHeader::FORMAT::HQ);
+  header_.SetSamples({"Sample0", "Sample1", "Sample2"});
+
+  VariantContext cxt("1", 1, Allele::A, Allele::T);
+  cxt.AddGenotype("Sample2", Genotype::Alleles(false, 1, AlleleIndex(VariantContext::kNoCallIdx)));
+  Attributes::mapped_type hq(Attributes::Integers({10, 15}));
+  cxt.AddGenotype("Sample0", Genotype::kAltRefP, Attributes({{VCFHeader::FORMAT::HQ, hq}}));
+
+  std::string line = GenerateVCFVariant(header_, cxt);
+  std::string format = line.substr(line.find("\tGT"));
+  // FORMAT fields are written in the order they are declared in the header
+  EXPECT_EQ("\tGT:GQ:HQ\t1|0:.:10,15\t.:.:.\t./1:.:.", format);
+}
+
+TEST_F(VCFVariantGeneratingTest, GeneratesINFOInHeaderOrder) {
+  using aseq::io::impl::GenerateVCFVariant;
+  typedef VCFHeader::Field Field;
+
+  // The keys are first used in the opposite of the output order
+  VariantContext cxt("1", 1, Allele::A, Allele::T);
+  cxt.SetAttribute("SINK_ORDER_UB", Attributes::Integer(4));
+  cxt.SetAttribute("SINK_ORDER_D2", Attributes::Integer(2));
+  cxt.SetAttribute("SINK_ORDER_UA", Attributes::Integer(3));
+  cxt.SetAttribute("SINK_ORDER_D1", Attributes::Integer(1));
+  cxt.SetAttribute(VCFHeader::INFO::AC, Attributes::Integers({1}));
+
+  // Declared fields are written in header order, followed by the undeclared fields by name
+  header_.AddINFOField(Field("SINK_ORDER_D1", 1, Field::Type::INTEGER, ""));
+  header_.AddINFOField(Field("SINK_ORDER_D2", 1, Field::Type::INTEGER, ""));
+  EXPECT_EQ(
+      "1\t1\t.\tA\tT\t.\t.\t"
+      "AC=1;SINK_ORDER_D1=1;SINK_ORDER_D2=2;SINK_ORDER_UA=3;SINK_ORDER_UB=4",
+      GenerateVCFVariant(header_, cxt));
+}
+
+TEST_F(VCFVariantGeneratingTest, PassesThroughUnmodifiedRecords) {
+  std::stringstream vcf(
+      "##fileformat=VCFv4.2\n"
+      "##INFO=<ID=AC,Number=A,Type=Integer,Description=\"Allele count\">\n"
+      "##FILTER=<ID=PASS,Description=\"All filters passed\">\n"
+      "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+      "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"Genotype quality\">\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSample0\tSample1\n"
+      "1\t100\trs1\tA\tT\t29.50\tPASS\tAC=01\tGT:GQ\t0/1:30\t0/0:.\n");
+  auto source = VariantSourceInterface::MakeVariantSource(vcf);
+  ASSERT_TRUE(source);
+  auto& source_header = dynamic_cast<VCFSource*>(source.get())->header();
+
+  VariantContext cxt;
+  ASSERT_TRUE(source->NextVariant(cxt));
+  EXPECT_TRUE(cxt.HasCleanRecord());
+
+  auto Format = [&cxt](const VCFHeader& header) {
+    std::stringstream content;
+    {
+      VCFSink sink(header, ASCIILineWriterInterface::MakeLineWriter(content));
+      sink.PushVariant(cxt);
+    }
+    std::string line;
+    while (std::getline(content, line) && line[0] == '#') {
+    }
+    return line;
+  };
+
+  // The record is written verbatim, preserving its original formatting
+  EXPECT_EQ("1\t100\trs1\tA\tT\t29.50\tPASS\tAC=01\tGT:GQ\t0/1:30\t0/0:.",
+            Format(source_header));
+
+  // Sinks with different samples or FORMAT fields reformat the record
+  EXPECT_EQ("1\t100\trs1\tA\tT\t29.5\tPASS\tAC=1", Format(header_));
+  VCFHeader gt_only(FileFormat::VCF4_2);
+  gt_only.AddFORMATField(VCFHeader::FORMAT::GT);
+  gt_only.SetSamples({"Sample0", "Sample1"});
+  EXPECT_EQ("1\t100\trs1\tA\tT\t29.5\tPASS\tAC=1\tGT\t0/1\t0/0", Format(gt_only));
+
+  // Modified records are reformatted
+  cxt.SetAttribute(VCFHeader::INFO::AC, Attributes::Integers({2}));
+  EXPECT_FALSE(cxt.HasCleanRecord());
+  std::string line = Format(source_header);
+  EXPECT_EQ("1\t100\trs1\tA\tT\t29.5\tPASS\tAC=2", line.substr(0, line.find("\tGT")));
+}
+
+TEST_F(VCFVariantGeneratingTest, DiscardsPartialRecordsOnError) {
+  std::stringstream vcf(
+      "##fileformat=VCFv4.2\n"
+      "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n"
+      "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"Genotype quality\">\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSample0\tSample1\n"
+      "1\t100\trs1\tA\tT\t29.5\tPASS\t.\tGT:GQ\t0/1:abc\t0/0:.\n"
+      "1\t200\trs2\tA\tT\t29.5\tPASS\t.\tGT:GQ\t0/1:30\t0/0:.\n");
+  auto source = VariantSourceInterface::MakeVariantSource(vcf);
+  ASSERT_TRUE(source);
+
+  // Reformatting the record (for a sink without GQ) decodes the malformed genotypes
+  VCFHeader gt_only(FileFormat::VCF4_2);
+  gt_only.AddFORMATField(VCFHeader::FORMAT::GT);
+  gt_only.SetSamples({"Sample0", "Sample1"});
+
+  std::stringstream content;
+  {
+    VCFSink sink(gt_only, ASCIILineWriterInterface::MakeBufferedLineWriter(content));
+    VariantContext cxt;
+    ASSERT_TRUE(source->NextVariant(cxt));
+    EXPECT_THROW(sink.PushVariant(cxt), file_parse_error);
+    ASSERT_TRUE(source->NextVariant(cxt));
+    sink.PushVariant(cxt);
+  }
+
+  std::string line;
+  while (std::getline(content, line) && line[0] == '#') {
+  }
+  EXPECT_EQ("1\t200\trs2\tA\tT\t29.5\tPASS\t.\tGT\t0/1\t0/0", line);
+  EXPECT_FALSE(std::getline(content, line));
+}
+
+TEST_F(VCFVariantGeneratingTest, FormatsVariantsInParallelInPushOrder) {
+  header_.SetSamples({"Sample0", "Sample1"});
+  auto MakeVariant = [](int i) {
+    VariantContext cxt("1", i, Allele::A, Allele::T);
+    cxt.SetAttribute(VCFHeader::INFO::AC, Attributes::Integers({i % 3}));
+    Attributes::mapped_type gq(i % 99);
+    cxt.AddGenotype("Sample0", Genotype::kRefAlt, Attributes({{VCFHeader::FORMAT::GQ, gq}}));
+    cxt.AddGenotype("Sample1", Genotype::kRefRef, Attributes());
+    return cxt;
+  };
+  const int kVariants = 1000;
+
+  std::stringstream expected, actual;
+  {
+    VCFSink sink(header_, ASCIILineWriterInterface::MakeLineWriter(expected));
+    for (int i = 1; i <= kVariants; i++) sink.PushVariant(MakeVariant(i));
+  }
+  {
+    VCFSink sink(header_, ASCIILineWriterInterface::MakeLineWriter(actual), 4);
+    for (int i = 1; i <= kVariants; i++) {
+      auto cxt = MakeVariant(i);
+      if (i % 7 == 0)
+        sink.PushVariant(cxt);  // Formatted on this thread, but still written in order
+      else
+        sink.PushVariant(std::move(cxt));
+      if (i == kVariants / 2) {  // Flush waits until the preceding variants are written
+        sink.Flush();
+        std::string written = actual.str();
+        EXPECT_EQ(expected.str().substr(0, written.size()), written);
+        EXPECT_EQ('\n', written.back());
+        EXPECT_NE(std::string::npos, written.find(fmt::format("\n1\t{}\t", kVariants / 2)));
+      }
+    }
+  }  // Destruction waits until all of the variants are written
+  EXPECT_EQ(expected.str(), actual.str());
+}
+
+// Throughput of writing PL/AD-heavy records compared to copying the same bytes, run with
+// --gtest_also_run_disabled_tests
+TEST_F(VCFVariantGeneratingTest, DISABLED_BenchmarkGeneratesNumericFORMATFields) {
+  typedef VCFHeader::Field Field;
+  const int kSamples = 500, kVariants = 2000;
+
+  header_.AddFORMATField(Field("AD", Field::R, Field::Type::INTEGER, ""));
+  header_.AddFORMATField(Field("PL", Field::G, Field::Type::INTEGER, ""));
+  std::vector<Sample> samples;
+  for (int s = 0; s < kSamples; s++) samples.emplace_back("NA" + std::to_string(s));
+  header_.SetSamples(samples.begin(), samples.end());
+
+  std::vector<VariantContext> variants;
+  for (int i = 1; i <= kVariants; i++) {
+    VariantContext cxt("1", i * 1000, Allele::A, {Allele::G, Allele::T});
+    cxt.SetQual(static_cast<float>(i) + 0.5f);
+    cxt.filters() = VariantContext::Filters({VCFHeader::FILTER::PASS});
+    cxt.SetAttribute(VCFHeader::INFO::AC, Attributes::Integers({1, 0}));
+    for (int s = 0; s < kSamples; s++) {
+      int d = (i * 31 + s * 17) % 60;
+      Attributes::mapped_type ad(Attributes::Integers({d, 60 - d, 0})), gq(d % 99),
+          pl(Attributes::Integers({d * 10, 0, d * 20, 1200, 900, 2400}));
+      cxt.AddGenotype(samples[s], Genotype::kRefAlt,
+                      Attributes({{"AD", ad}, {VCFHeader::FORMAT::GQ, gq}, {"PL", pl}}));
+    }
+    variants.push_back(std::move(cxt));
+  }
+
+  // Records are formatted directly into the buffered writer's blocks
+  std::stringstream content;
+  auto start = std::chrono::steady_clock::now();
+  {
+    VCFSink sink(header_, ASCIILineWriterInterface::MakeBufferedLineWriter(content));
+    for (auto& cxt : variants) sink.PushVariant(cxt);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::string output = content.str();
+  std::vector<char> copy(output.size());
+  auto copy_start = std::chrono::steady_clock::now();
+  memcpy(copy.data(), output.data(), output.size());
+  std::chrono::duration<double> copy_elapsed = std::chrono::steady_clock::now() - copy_start;
+  EXPECT_EQ(output.back(), copy.back());
+
+  double megabytes = static_cast<double>(output.size()) / 1e6;
+  std::cout << "[ BENCHMARK] " << kVariants / elapsed.count() << " records/second, "
+            << megabytes / elapsed.count() << " MB/s (memcpy " << megabytes / copy_elapsed.count()
+            << " MB/s, " << kSamples << " samples)" << std::endl;
+
+  // The variants are moved into an asynchronous sink so they can be formatted in parallel
+  const size_t kThreads = 4;
+  std::stringstream async_content;
+  auto async_start = std::chrono::steady_clock::now();
+  {
+    VCFSink async_sink(header_, ASCIILineWriterInterface::MakeLineWriter(async_content), kThreads);
+    for (auto& cxt : variants) async_sink.PushVariant(std::move(cxt));
+  }
+  std::chrono::duration<double> async_elapsed = std::chrono::steady_clock::now() - async_start;
+  EXPECT_EQ(output, async_content.str());
+
+  std::cout << "[ BENCHMARK] " << kVariants / async_elapsed.count() << " records/second, "
+            << megabytes / async_elapsed.count() << " MB/s (" << kThreads
+            << " threads)" << std::endl;
+}
+
 TEST_F(VCFVariantGeneratingTest, GeneratesVCFWithSamples) {
   header_.SetSamples({"Sample0", "Sample1"});
   std::stringstream content;
@@ -2,6 +2,11 @@
 // Created by Michael Linderman on 12/18/15.
 //
 
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
 #include <gtest/gtest.h>
 #include <boost/filesystem.hpp>
 
@@ -69,6 +74,36 @@ TEST(VCFHeaderParsingTest, ParsesFixedLengthVectorHeaderLines) {
   });
 }
 
+TEST(VCFHeaderParsingTest, ParsesContigLinesInOrder) {
+  // clang-format off
+  std::stringstream content(
+      "##fileformat=VCFv4.2\n"
+      "##contig=<ID=chr2,length=242193529,assembly=\"GRCh38, primary\">\n"
+      "##contig=<ID=chr10,length=133797422>\n"
+      "##contig=<ID=chrUn_KI270302v1>\n"
+      "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+      "chr2\t1\t.\tA\tT\t.\t.\t.\n"
+      "chr10\t1\t.\tA\tT\t.\t.\t.\n"
+      "chrM\t1\t.\tA\tT\t.\t.\t.\n"
+  );
+  // clang-format on
+  VCFSource source(FileFormat::VCF4_2, ASCIILineReaderInterface::MakeLineReader(content));
+  auto& contigs = source.header().contigs();
+  ASSERT_EQ(3, contigs.size());
+  EXPECT_EQ(Contig("chr2"), contigs[0].contig);
+  EXPECT_EQ(242193529, contigs[0].length);
+  EXPECT_EQ(1, contigs.Find("chr10"));
+  EXPECT_EQ(133797422, contigs[1].length);
+  EXPECT_EQ(0, contigs[2].length);
+  EXPECT_EQ(kUnknownContigID, contigs.Find("chrM"));
+
+  for (ContigID expected : {0, 1, kUnknownContigID}) {
+    auto v = source.NextVariant();
+    ASSERT_TRUE(v);
+    EXPECT_EQ(expected, v->contig_id());
+  }
+}
+
 class VCFVariantParsingTest : public ::testing::Test {
  public:
   VCFVariantParsingTest() : header_(FileFormat::VCF4_2) {}
@@ -192,7 +227,6 @@ TEST_F(VCFVariantParsingTest, ParsesMinimalVariantWithSamples) {
 
     {
       auto& gt = context.GetGenotype("NA12878");
-      ASSERT_EQ(&context, &gt.variant_context());
       EXPECT_FALSE(gt.HasAttribute(VCFHeader::FORMAT::GT));
       EXPECT_EQ(Genotype::kRefAlt, gt.alleles());
       EXPECT_FALSE(gt.Phased());
@@ -238,3 +272,155 @@ TEST_F(VCFVariantParsingTest, ParsesComplexVariantWithSamples) {
 
   });
 }
+
+TEST_F(VCFVariantParsingTest, DecodesGenotypesOnDemand) {
+  using aseq::io::impl::ParseVCFVariantLine;
+  using aseq::util::file_parse_error;
+  header_.SetSamples({"NA12878", "NA12891"});
+
+  // Sample columns are only validated for count when the variant is parsed...
+  EXPECT_THROW(ParseVCFVariantLine("1\t1\t.\tA\tG\t.\t.\t.\tGT:DP\t0/1:20", header_),
+               file_parse_error);
+  EXPECT_THROW(ParseVCFVariantLine("1\t1\t.\tA\tG\t.\t.\t.\tGT:DP\t0/1:20\t0/1\t0/1", header_),
+               file_parse_error);
+
+  // ...with values decoded on the first access to the genotypes
+  VariantContext context =
+      ParseVCFVariantLine("1\t1\t.\tA\tG\t.\t.\t.\tGT:DP\t0/1:20\t1/1:X", header_);
+  EXPECT_EQ(2, context.NumGenotypes());
+  EXPECT_THROW(context.genotypes(), file_parse_error);
+}
+
+TEST_F(VCFVariantParsingTest, DecodesCommonFORMATLayouts) {
+  using aseq::io::impl::ParseVCFVariantLine;
+  using aseq::util::Attributes;
+  using aseq::util::file_parse_error;
+  typedef VCFHeader::Field Field;
+  header_.AddFORMATField(Field("AD", Field::R, Field::Type::INTEGER, ""));
+  header_.AddFORMATField(Field("PL", Field::G, Field::Type::INTEGER, ""));
+  header_.SetSamples({"NA12878", "NA12891"});
+
+  // The same values should be decoded from the specialized (GT:GQ:DP:HQ) and generic layouts
+  for (auto line : {"1\t1\t.\tA\tG\t.\t.\t.\tGT:GQ:DP:HQ\t0/1:30:20:4,5\t1|1:.:25",
+                    "1\t1\t.\tA\tG\t.\t.\t.\tGT:HQ:DP:GQ\t0/1:4,5:20:30\t1|1:.,.:25:."}) {
+    VariantContext context = ParseVCFVariantLine(line, header_);
+    auto& gt1 = context.GetGenotype("NA12878");
+    EXPECT_EQ(Genotype::kRefAlt, gt1.alleles());
+    EXPECT_EQ(30, gt1.GetAttribute<Attributes::Integer>(VCFHeader::FORMAT::GQ));
+    EXPECT_EQ(20, gt1.GetAttribute<Attributes::Integer>(VCFHeader::FORMAT::DP));
+    EXPECT_EQ(Attributes::Integers({4, 5}),
+              gt1.GetAttribute<Attributes::Integers>(VCFHeader::FORMAT::HQ));
+
+    auto& gt2 = context.GetGenotype("NA12891");
+    EXPECT_TRUE(gt2.Phased());
+    EXPECT_FALSE(gt2.HasAttribute(VCFHeader::FORMAT::GQ));
+    EXPECT_EQ(25, gt2.GetAttribute<Attributes::Integer>(VCFHeader::FORMAT::DP));
+    EXPECT_FALSE(gt2.HasAttribute(VCFHeader::FORMAT::HQ));
+  }
+
+  {
+    VariantContext context = ParseVCFVariantLine(
+        "1\t1\t.\tA\tG,T\t.\t.\t.\tGT:AD:DP:GQ:PL\t./.\t1/2:0,10,12:22:99:900,600,500,300,0,400",
+        header_);
+    EXPECT_EQ(Genotype::kNoCallNoCall, context.GetGenotype("NA12878").alleles());
+    auto& gt = context.GetGenotype("NA12891");
+    EXPECT_EQ(Attributes::Integers({0, 10, 12}), gt.GetAttribute<Attributes::Integers>("AD"));
+    EXPECT_EQ(Attributes::Integers({900, 600, 500, 300, 0, 400}),
+              gt.GetAttribute<Attributes::Integers>("PL"));
+  }
+
+  for (auto line : {"1\t1\t.\tA\tG\t.\t.\t.\tGT:GQ\t0/1:30:20\t0/1",
+                    "1\t1\t.\tA\tG\t.\t.\t.\tGT:GQ\t0/1:3x\t0/1",
+                    "1\t1\t.\tA\tG\t.\t.\t.\tGT\t0/1\tX"}) {
+    VariantContext context = ParseVCFVariantLine(line, header_);
+    EXPECT_THROW(context.genotypes(), file_parse_error);
+  }
+}
+
+TEST_F(VCFVariantParsingTest, ParsesNumericValues) {
+  using aseq::io::impl::ParseVCFVariantLine;
+  using aseq::util::Attributes;
+  using aseq::util::file_parse_error;
+  typedef VCFHeader::Field Field;
+  header_.AddINFOField(Field("FS", 1, Field::Type::FLOAT, ""));
+  header_.AddINFOField(Field("FL", Field::UNBOUNDED, Field::Type::FLOAT, ""));
+
+  {
+    VariantContext context = ParseVCFVariantLine(
+        "1\t123456789\t.\tA\tG\t1e3\t.\tEND=+123456790;FS=-0.5e-2;FL=1.5,.25,nan;HOMLEN=-1,0", header_);
+    EXPECT_EQ(123456789, context.pos());
+    EXPECT_EQ(123456790, context.end());
+    EXPECT_FLOAT_EQ(1000.0f, *context.qual());
+    EXPECT_FLOAT_EQ(-0.005f, context.GetAttribute<Attributes::Float>("FS"));
+    auto& fl = context.GetAttribute<Attributes::Floats>("FL");
+    ASSERT_EQ(3, fl.size());
+    EXPECT_FLOAT_EQ(1.5f, fl[0]);
+    EXPECT_FLOAT_EQ(0.25f, fl[1]);
+    EXPECT_TRUE(std::isnan(fl[2]));
+    EXPECT_EQ(Attributes::Integers({-1, 0}), context.GetAttribute<Attributes::Integers>("HOMLEN"));
+  }
+  {
+    // Values with more digits than the fast path handles exactly
+    VariantContext context = ParseVCFVariantLine(
+        "1\t1\t.\tA\tG\t.5\t.\tFS=0.1234567890123456789012;FL=1e30,-2.5E-30", header_);
+    EXPECT_FLOAT_EQ(0.5f, *context.qual());
+    EXPECT_FLOAT_EQ(0.12345679f, context.GetAttribute<Attributes::Float>("FS"));
+    EXPECT_EQ(Attributes::Floats({1e30f, -2.5e-30f}), context.GetAttribute<Attributes::Floats>("FL"));
+  }
+  {
+    // Missing values
+    VariantContext context =
+        ParseVCFVariantLine("1\t1\t.\tA\tG\t.\t.\tEND=.;FS=.;HOMLEN=.,.", header_);
+    EXPECT_FALSE(context.HasQual());
+    EXPECT_FALSE(context.HasAttribute("END"));
+    EXPECT_FALSE(context.HasAttribute("FS"));
+    EXPECT_FALSE(context.HasAttribute("HOMLEN"));
+  }
+
+  EXPECT_THROW(ParseVCFVariantLine("1\t1x\t.\tA\tG\t.\t.\t.", header_), file_parse_error);
+  EXPECT_THROW(ParseVCFVariantLine("1\t1\t.\tA\tG\t1.0x\t.\t.", header_), file_parse_error);
+  EXPECT_THROW(ParseVCFVariantLine("1\t1\t.\tA\tG\t.\t.\tEND=99999999999", header_),
+               file_parse_error);
+  EXPECT_THROW(ParseVCFVariantLine("1\t1\t.\tA\tG\t.\t.\tEND=-", header_), file_parse_error);
+  EXPECT_THROW(ParseVCFVariantLine("1\t1\t.\tA\tG\t.\t.\tFS=1.0.0", header_), file_parse_error);
+  EXPECT_THROW(ParseVCFVariantLine("1\t1\t.\tA\tG\t.\t.\tHOMLEN=1,,2", header_), file_parse_error);
+}
+
+// Throughput of parsing (and decoding the genotypes of) PL/AD-heavy records, run with
+// --gtest_also_run_disabled_tests
+TEST_F(VCFVariantParsingTest, DISABLED_BenchmarkParsesNumericFORMATFields) {
+  using aseq::io::impl::ParseVCFVariantLine;
+  typedef VCFHeader::Field Field;
+  const int kSamples = 500, kVariants = 2000;
+
+  header_.AddFORMATField(Field("AD", Field::R, Field::Type::INTEGER, ""));
+  header_.AddFORMATField(Field("PL", Field::G, Field::Type::INTEGER, ""));
+  std::vector<Sample> samples;
+  for (int s = 0; s < kSamples; s++) samples.emplace_back("NA" + std::to_string(s));
+  header_.SetSamples(samples.begin(), samples.end());
+
+  std::vector<std::string> lines;
+  for (int i = 1; i <= kVariants; i++) {
+    std::string line =
+        "1\t" + std::to_string(i * 1000) + "\t.\tA\tG,T\t" + std::to_string(i) + ".5\tPASS\t.";
+    line += "\tGT:AD:DP:GQ:PL";
+    for (int s = 0; s < kSamples; s++) {
+      int d = (i * 31 + s * 17) % 60;
+      line += "\t0/1:" + std::to_string(d) + "," + std::to_string(60 - d) + ",0:60:" +
+              std::to_string(d % 99) + ":" + std::to_string(d * 10) + ",0," +
+              std::to_string(d * 20) + ",1200,900,2400";
+    }
+    lines.push_back(std::move(line));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  size_t genotypes = 0;
+  for (auto& line : lines) {
+    VariantContext context = ParseVCFVariantLine(line, header_);
+    genotypes += context.genotypes().size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(kSamples * kVariants, genotypes);
+  std::cout << "[ BENCHMARK] " << kVariants / elapsed.count() << " records/second ("
+            << kSamples << " samples)" << std::endl;
+}
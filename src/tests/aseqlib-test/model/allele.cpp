@@ -12,3 +12,39 @@ TEST(AllelePropertiesTest, IdentifiesSymbolicAllele) {
   EXPECT_TRUE(Allele("<DEL>").IsSymbolic());
   EXPECT_FALSE(Allele("A").IsSymbolic());
 }
+
+TEST(AllelePropertiesTest, StoresShortAllelesInline) {
+  EXPECT_TRUE(Allele("A").IsInline());
+  EXPECT_TRUE(Allele("").IsInline());
+  EXPECT_TRUE(Allele(std::string(Allele::kMaxInlineSize, 'G')).IsInline());
+  EXPECT_FALSE(Allele(std::string(Allele::kMaxInlineSize + 1, 'G')).IsInline());
+  EXPECT_FALSE(Allele("<DEL>").IsInline());
+  EXPECT_EQ(Allele::MISSING, Allele());
+
+  for (size_t size : {0, 1, 14, 15, 16, 100}) {
+    std::string bases(size, 'C');
+    Allele allele(bases), same(bases.begin(), bases.end());
+    EXPECT_EQ(size, allele.size());
+    EXPECT_EQ(bases, allele.str());
+    EXPECT_STREQ(bases.c_str(), allele.c_str());
+    EXPECT_EQ(allele, same);
+    EXPECT_EQ(std::hash<Allele>()(allele), std::hash<Allele>()(same));
+  }
+}
+
+TEST(AllelePropertiesTest, ComparesAndSlicesAlleles) {
+  Allele longer("ACGTACGTACGTACGTAC");
+  EXPECT_NE(Allele("A"), Allele("C"));
+  EXPECT_NE(Allele("A"), Allele("AA"));
+  EXPECT_LT(Allele("A"), Allele("AC"));
+  EXPECT_LT(Allele("AC"), longer);
+  EXPECT_LT(longer, Allele("C"));
+
+  EXPECT_EQ(Allele("ACGT"), longer.SubAllele(0, 4));
+  EXPECT_TRUE(longer.SubAllele(0, 4).IsInline());
+  EXPECT_EQ(Allele("TAC"), longer.SubAllele(15));
+  EXPECT_EQ(Allele("GA"), "G" + Allele::A);
+  EXPECT_EQ('A', longer.front());
+  EXPECT_EQ('C', longer.back());
+  EXPECT_EQ('C', *longer.rbegin());
+}
@@ -2,6 +2,13 @@
 // Created by Michael Linderman on 12/18/15.
 //
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include "aseq/model/variant_context.hpp"
@@ -51,3 +58,147 @@ TEST(VariantCompareTest, OrdersPreciseBiAndMultiallelicVariants) {
     EXPECT_EQ(CompareVariants::result_type::SUPERSET, cmp(b, a));
   }
 }
+
+TEST(VariantCompareTest, OrdersContigsByDictionaryID) {
+  CompareVariants cmp;
+  ContigDictionary contigs;
+  contigs.Add("chr2");
+  contigs.Add("chr10");
+
+  VariantContext a("chr2", 100, Allele::A), b("chr10", 1, Allele::A);
+  EXPECT_EQ(CompareVariants::result_type::AFTER, cmp(a, b));  // Lexicographic without IDs
+
+  a.set_contig_id(contigs.Find(a.contig()));
+  b.set_contig_id(contigs.Find(b.contig()));
+  EXPECT_EQ(CompareVariants::result_type::BEFORE, cmp(a, b));
+  EXPECT_EQ(CompareVariants::result_type::AFTER, cmp(b, a));
+
+  VariantContext c("chr2", 100, Allele::A);
+  c.set_contig_id(0);
+  EXPECT_EQ(CompareVariants::result_type::EQUAL, cmp(a, c));
+
+  // Contigs without IDs consistently follow those in the dictionary
+  VariantContext d("chr1", 1, Allele::A);
+  EXPECT_EQ(CompareVariants::result_type::BEFORE, cmp(b, d));
+  EXPECT_EQ(CompareVariants::result_type::AFTER, cmp(d, a));
+}
+
+TEST(VariantContextTest, MovesWithoutCopyingGenotypes) {
+  using aseq::util::Attributes;
+  static_assert(std::is_nothrow_move_constructible<VariantContext>::value, "");
+  static_assert(std::is_nothrow_move_assignable<VariantContext>::value, "");
+
+  VariantContext a("1", 100, Allele::A, Allele::T);
+  a.AddGenotype("NA12878", Genotype::kRefAlt, Attributes({{"DP", Attributes::mapped_type(10)}}));
+  a.AddGenotype("NA12891", Genotype::kAltAlt);
+  const Genotype* genotypes = a.genotypes().data();
+
+  VariantContext b(std::move(a));
+  EXPECT_EQ(genotypes, b.genotypes().data());
+
+  VariantContext c;
+  c = std::move(b);
+  EXPECT_EQ(genotypes, c.genotypes().data());
+  EXPECT_EQ(Genotype::kRefAlt, c.GetGenotype("NA12878").alleles());
+  EXPECT_EQ(10, c.GetGenotype("NA12878").GetAttribute<Attributes::Integer>("DP"));
+  EXPECT_EQ(Genotype::kAltAlt, c.GetGenotype("NA12891").alleles());
+}
+
+namespace {
+class TwoSampleDecoder : public aseq::model::impl::GenotypeDecoder {
+ public:
+  explicit TwoSampleDecoder(std::atomic<int>* decodes = nullptr)
+      : index_(new SampleIndex({{"NA12878", 0}, {"NA12891", 1}})), decodes_(decodes) {}
+
+  size_t NumGenotypes() const override { return 2; }
+  void Decode(VariantContext::Genotypes& genotypes) const override {
+    if (decodes_) ++*decodes_;
+    genotypes.emplace_back("NA12878", Genotype::kRefAlt);
+    genotypes.emplace_back("NA12891", Genotype::kAltAlt);
+  }
+  void DecodeColumn(const aseq::util::Attributes::key_type&,
+                    std::vector<aseq::util::Attributes::mapped_type>&) const override {}
+  std::shared_ptr<const SampleIndex> sample_index() const override { return index_; }
+
+ private:
+  std::shared_ptr<const SampleIndex> index_;
+  std::atomic<int>* decodes_;
+};
+}
+
+TEST(VariantContextTest, ReleasesGenotypeDecoder) {
+  VariantContext a("1", 100, Allele::A, Allele::T);
+  a.SetGenotypeDecoder(std::unique_ptr<TwoSampleDecoder>(new TwoSampleDecoder()));
+  EXPECT_EQ(2, a.NumGenotypes());
+
+  // Genotypes that weren't decoded are discarded with the decoder
+  EXPECT_TRUE(a.ReleaseGenotypeDecoder());
+  EXPECT_EQ(0, a.NumGenotypes());
+  EXPECT_EQ(nullptr, a.FindGenotype("NA12891"));
+
+  // Genotypes that were decoded are retained
+  a.SetGenotypeDecoder(std::unique_ptr<TwoSampleDecoder>(new TwoSampleDecoder()));
+  EXPECT_EQ(Genotype::kAltAlt, a.GetGenotype("NA12891").alleles());
+  EXPECT_TRUE(a.ReleaseGenotypeDecoder());
+  EXPECT_EQ(2, a.NumGenotypes());
+  EXPECT_EQ(Genotype::kAltAlt, a.GetGenotype("NA12891").alleles());
+}
+
+TEST(VariantContextTest, DecodesGenotypesOnceFromMultipleThreads) {
+  std::atomic<int> decodes{0};
+  VariantContext a("1", 100, Allele::A, Allele::T);
+  a.SetGenotypeDecoder(std::unique_ptr<TwoSampleDecoder>(new TwoSampleDecoder(&decodes)));
+
+  const VariantContext& c = a;
+  std::vector<std::thread> threads;
+  std::atomic<int> found{0};
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&c, &found] {
+      if (c.genotypes().size() == 2 && c.GetGenotype("NA12891").alleles() == Genotype::kAltAlt)
+        ++found;
+    });
+  }
+  for (auto& t : threads) t.join();
+  EXPECT_EQ(1, decodes);
+  EXPECT_EQ(4, found);
+}
+
+TEST(VariantContextTest, TracksModificationsThroughMutableAccessors) {
+  using aseq::util::Attributes;
+  // The attributes can't be modified through the base class without being tracked
+  static_assert(!std::is_convertible<VariantContext*, aseq::util::HasAttributes*>::value, "");
+
+  const char record[] = "1\t100\t.\tA\tT\t.\t.\tDP=10";
+  auto samples = std::make_shared<const std::vector<Sample> >();
+  VariantContext a("1", 100, Allele::A, Allele::T);
+  std::vector<std::function<void(VariantContext&)> > mutations{
+      [](VariantContext& v) { v.ids().push_back("rs1"); },
+      [](VariantContext& v) { v.filters().push_back("PASS"); },
+      [](VariantContext& v) { v.SetQual(10.0f); },
+      [](VariantContext& v) { v.GetAttribute<Attributes::Integer>("DP") = 20; },
+      [](VariantContext& v) { v.attributes().clear(); },
+      [](VariantContext& v) { v.EraseAttribute("DP"); }};
+  for (auto& mutate : mutations) {
+    a.SetAttribute("DP", Attributes::Integer(10));
+    a.SetSourceRecord(record, record + sizeof(record) - 1, samples);
+    ASSERT_TRUE(a.HasCleanRecord());
+    EXPECT_EQ(10, static_cast<const VariantContext&>(a).GetAttribute<Attributes::Integer>("DP"));
+    EXPECT_TRUE(a.HasCleanRecord());  // Const access doesn't modify the context
+    mutate(a);
+    EXPECT_FALSE(a.HasCleanRecord());
+  }
+}
+
+TEST(VariantContextTest, ReadsVectorAttributesAsStdVectors) {
+  using aseq::util::Attributes;
+  VariantContext a("1", 100, Allele::A, {Allele::T, Allele::C});
+  a.SetAttribute("AC", std::vector<int>({1, 2}));
+  EXPECT_EQ(Attributes::Integers({1, 2}), a.GetAttribute<Attributes::Integers>("AC"));
+
+  // Reading a converted copy doesn't modify the context
+  const char record[] = "1\t100\t.\tA\tT,C\t.\t.\tAC=1,2";
+  a.SetSourceRecord(record, record + sizeof(record) - 1,
+                    std::make_shared<const std::vector<Sample> >());
+  EXPECT_EQ(std::vector<int>({1, 2}), a.GetAttribute<std::vector<int> >("AC"));
+  EXPECT_TRUE(a.HasCleanRecord());
+}
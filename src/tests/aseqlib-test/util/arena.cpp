@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aseq/util/arena.hpp"
+#include "aseq/util/attributes.hpp"
+
+using aseq::util::Arena;
+using aseq::util::ArenaAllocator;
+
+TEST(ArenaTest, AllocatesAlignedMemoryFromBlocks) {
+  Arena arena(64);
+  auto* c = static_cast<char*>(arena.Allocate(1, 1));
+  auto* d = static_cast<double*>(arena.Allocate(sizeof(double), alignof(double)));
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(d) % alignof(double));
+  EXPECT_LT(reinterpret_cast<uintptr_t>(c), reinterpret_cast<uintptr_t>(d));
+
+  // Allocations larger than the block size get their own block
+  auto* large = static_cast<char*>(arena.Allocate(1024));
+  std::fill(large, large + 1024, 'A');
+  EXPECT_EQ('A', large[1023]);
+
+  arena.Reset();
+  EXPECT_NE(nullptr, arena.Allocate(16));
+}
+
+TEST(ArenaTest, ContainersAllocateFromArena) {
+  auto arena = std::make_shared<Arena>();
+  {
+    std::vector<int, ArenaAllocator<int> > values(arena);
+    for (int i = 0; i < 1000; i++) values.push_back(i);  // Requires multiple blocks
+    EXPECT_EQ(999, values.back());
+    EXPECT_EQ(arena, values.get_allocator().arena());
+
+    // Copies allocate from the heap, moves retain the arena
+    auto copy = values;
+    EXPECT_FALSE(copy.get_allocator().arena());
+    EXPECT_EQ(values, copy);
+    auto moved = std::move(values);
+    EXPECT_EQ(arena, moved.get_allocator().arena());
+  }
+  EXPECT_EQ(1, arena.use_count());  // Containers release their reference to the arena
+}
+
+TEST(ArenaTest, AttributesAllocateFromArena) {
+  using aseq::util::Attributes;
+  auto arena = std::make_shared<Arena>();
+
+  Attributes attrs{Attributes::allocator_type(arena)};
+  attrs.emplace("ARENA_TEST_KEY1", 1);
+  attrs.emplace("ARENA_TEST_KEY2", std::string("value"));
+  EXPECT_EQ(arena, attrs.get_allocator().arena());
+  EXPECT_EQ(1, attrs.at<Attributes::Integer>("ARENA_TEST_KEY1"));
+  EXPECT_EQ("value", attrs.at<Attributes::String>("ARENA_TEST_KEY2"));
+}
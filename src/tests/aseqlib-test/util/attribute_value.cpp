@@ -0,0 +1,114 @@
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aseq/util/attribute_value.hpp"
+
+using aseq::util::AttributeType;
+using aseq::util::AttributeValue;
+using aseq::util::any_cast;
+
+namespace {
+struct Point {
+  int x, y;
+};
+bool operator==(const Point& lhs, const Point& rhs) { return lhs.x == rhs.x && lhs.y == rhs.y; }
+std::ostream& operator<<(std::ostream& os, const Point& p) { return os << p.x << ':' << p.y; }
+
+bool IsInline(const AttributeValue& value, const void* data) {
+  auto begin = reinterpret_cast<const char*>(&value);
+  return data >= begin && data < begin + sizeof(value);
+}
+}
+
+TEST(AttributeValueTest, StoresShortVectorsInline) {
+  AttributeValue pl(AttributeValue::Integers({900, 600, 500, 300, 0, 400}));
+  EXPECT_EQ(AttributeType::INTEGERS, pl.type());
+  EXPECT_TRUE(IsInline(pl, pl.cast<AttributeValue::Integers>().data()));
+
+  AttributeValue copy(pl);
+  EXPECT_EQ(pl, copy);
+  EXPECT_TRUE(IsInline(copy, copy.cast<AttributeValue::Integers>().data()));
+
+  AttributeValue moved(std::move(copy));
+  EXPECT_EQ(pl, moved);
+  EXPECT_TRUE(IsInline(moved, moved.cast<AttributeValue::Integers>().data()));
+
+  // Longer vectors spill to the heap
+  AttributeValue::Integers values(AttributeValue::kInlineValues + 1, 1);
+  AttributeValue spilled(values);
+  EXPECT_EQ(values, any_cast<const AttributeValue::Integers&>(spilled));
+  EXPECT_FALSE(IsInline(spilled, spilled.cast<AttributeValue::Integers>().data()));
+}
+
+TEST(AttributeValueTest, CastsToTheStoredType) {
+  AttributeValue value;
+  EXPECT_TRUE(value.empty());
+  EXPECT_EQ(nullptr, any_cast<AttributeValue::Integer>(&value));
+
+  value = 5;
+  EXPECT_EQ(AttributeType::INTEGER, value.type());
+  EXPECT_EQ(5, any_cast<AttributeValue::Integer>(value));
+  EXPECT_EQ(nullptr, any_cast<AttributeValue::Float>(&value));
+  EXPECT_THROW(value.cast<AttributeValue::String>(), aseq::util::bad_any_cast);
+
+  any_cast<AttributeValue::Integer&>(value) = 7;
+  EXPECT_EQ(7, value.cast<AttributeValue::Integer>());
+
+  value = std::string("PASS");
+  EXPECT_EQ(AttributeType::STRING, value.type());
+  EXPECT_EQ("PASS", value.cast<AttributeValue::String>());
+
+  // Types other than the VCF types are stored type-erased
+  value = Point{1, 2};
+  EXPECT_EQ(AttributeType::OTHER, value.type());
+  EXPECT_EQ(Point({1, 2}), value.cast<Point>());
+  EXPECT_EQ(typeid(Point), value.type_info());
+  EXPECT_EQ(AttributeValue(Point{1, 2}), value);
+  EXPECT_NE(AttributeValue(Point{1, 3}), value);
+
+  value.reset();
+  EXPECT_TRUE(value.empty());
+  EXPECT_EQ(AttributeValue(), value);
+}
+
+TEST(AttributeValueTest, ConvertsStdVectors) {
+  // std::vectors are stored as the inline vectors...
+  AttributeValue value(std::vector<int>({20, 10}));
+  EXPECT_EQ(AttributeType::INTEGERS, value.type());
+  EXPECT_EQ(AttributeValue(AttributeValue::Integers({20, 10})), value);
+  value = std::vector<int>({30});
+  EXPECT_EQ(AttributeValue::Integers({30}), value.cast<AttributeValue::Integers>());
+
+  // ...and converted back when read as std::vectors
+  EXPECT_EQ(std::vector<int>({30}), value.cast<std::vector<int> >());
+  EXPECT_EQ(std::vector<int>({30}), any_cast<const std::vector<int>&>(value));
+  EXPECT_THROW(value.cast<std::vector<float> >(), aseq::util::bad_any_cast);
+
+  AttributeValue floats(AttributeValue::Floats({0.5f, 0.25f}));
+  EXPECT_EQ(std::vector<float>({0.5f, 0.25f}), floats.cast<std::vector<float> >());
+}
+
+TEST(AttributeValueTest, ComparesFloatsBitwise) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  EXPECT_EQ(AttributeValue(0.5f), AttributeValue(0.5f));
+  EXPECT_NE(AttributeValue(0.5f), AttributeValue(0.25f));
+  EXPECT_EQ(AttributeValue(nan), AttributeValue(nan));
+  EXPECT_NE(AttributeValue(0.0f), AttributeValue(-0.0f));
+  EXPECT_EQ(AttributeValue(AttributeValue::Floats({0.5f, nan})),
+            AttributeValue(AttributeValue::Floats({0.5f, nan})));
+  EXPECT_NE(AttributeValue(AttributeValue::Floats({0.5f})),
+            AttributeValue(AttributeValue::Floats({0.5f, 0.5f})));
+}
+
+TEST(AttributeValueTest, WritesValuesAsInVCF) {
+  std::ostringstream os;
+  os << AttributeValue(AttributeValue::Integers({-5, 4})) << ' '
+     << AttributeValue(AttributeValue::Floats({0.5f})) << ' '
+     << AttributeValue(AttributeValue::Strings({"a", "b"})) << ' ' << AttributeValue(Point{1, 2})
+     << ' ' << AttributeValue();
+  EXPECT_EQ("-5,4 0.5 a,b 1:2 ", os.str());
+}
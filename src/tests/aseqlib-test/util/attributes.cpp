@@ -0,0 +1,91 @@
+#include <iterator>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "aseq/util/attributes.hpp"
+
+using aseq::util::Attributes;
+
+TEST(AttributesTest, AssignsStableIndicesToKeys) {
+  Attributes::key_type key1("ATTRIBUTES_TEST_KEY1"), key2(std::string("ATTRIBUTES_TEST_KEY2"));
+  EXPECT_NE(key1.index(), key2.index());
+  EXPECT_EQ(key1.index(), Attributes::key_type("ATTRIBUTES_TEST_KEY1").index());
+  EXPECT_EQ(key1, Attributes::key_type(std::string("ATTRIBUTES_TEST_KEY1")));
+}
+
+TEST(AttributesTest, StoresAttributesInKeyOrder) {
+  Attributes::key_type key1("ATTRIBUTES_TEST_ORDER1"), key2("ATTRIBUTES_TEST_ORDER2"),
+      key3("ATTRIBUTES_TEST_ORDER3");
+
+  Attributes attrs;
+  EXPECT_TRUE(attrs.emplace(key3, 3).second);
+  EXPECT_TRUE(attrs.emplace(key1, Attributes::Integers({1, 2})).second);
+  EXPECT_TRUE(attrs.emplace("ATTRIBUTES_TEST_ORDER2", std::string("2")).second);
+  EXPECT_FALSE(attrs.emplace(key1, 10).second);  // Existing attributes are not replaced
+  ASSERT_EQ(3, attrs.size());
+
+  std::vector<Attributes::key_type> keys;
+  for (auto& attr : attrs) keys.push_back(attr.first);
+  EXPECT_EQ(std::vector<Attributes::key_type>({key1, key2, key3}), keys);
+
+  EXPECT_EQ(Attributes::Integers({1, 2}), attrs.at<Attributes::Integers>(key1));
+  EXPECT_EQ("2", attrs.at<std::string>("ATTRIBUTES_TEST_ORDER2"));  // Lookup by string
+  EXPECT_EQ(3, attrs.at_or<Attributes::Integer>(key3, 0));
+
+  EXPECT_EQ(1, attrs.erase(key2));
+  EXPECT_EQ(0, attrs.erase(key2));
+  EXPECT_EQ(attrs.end(), attrs.find(key2));
+  EXPECT_EQ(-1, attrs.at_or<Attributes::Integer>(key2, -1));
+  EXPECT_THROW(attrs.at<Attributes::Integer>(key2), std::out_of_range);
+  EXPECT_EQ(3, attrs.at<Attributes::Integer>(key3));
+}
+
+TEST(AttributesTest, FindsAttributesBeyondIndexedKeys) {
+  // Create enough keys that some have indices beyond those tracked in the bitmap
+  std::vector<Attributes::key_type> keys;
+  for (int i = 0; i < 100; i++) keys.emplace_back("ATTRIBUTES_TEST_MANY" + std::to_string(i));
+
+  Attributes attrs;
+  for (int i = 99; i >= 0; i -= 3) attrs[keys[i]] = i;
+  for (int i = 0; i < 100; i++) {
+    if ((99 - i) % 3 == 0)
+      EXPECT_EQ(i, attrs.at<Attributes::Integer>(keys[i]));
+    else
+      EXPECT_EQ(attrs.end(), attrs.find(keys[i]));
+  }
+}
+
+TEST(AttributesTest, InsertsCopiesOrMovesFromRange) {
+  Attributes::key_type key1("ATTRIBUTES_TEST_INSERT1"), key2("ATTRIBUTES_TEST_INSERT2");
+  Attributes source;
+  source.emplace(key1, std::string("one"));
+  source.emplace(key2, std::string("two"));
+
+  // The source attributes are unchanged when inserted by copy...
+  Attributes copy;
+  copy.emplace(key2, std::string("existing"));
+  copy.insert(source.begin(), source.end());
+  EXPECT_EQ("one", copy.at<std::string>(key1));
+  EXPECT_EQ("existing", copy.at<std::string>(key2));
+  EXPECT_EQ("one", source.at<std::string>(key1));
+  EXPECT_EQ("two", source.at<std::string>(key2));
+
+  // ...and can be moved with move iterators
+  Attributes moved;
+  moved.insert(std::make_move_iterator(source.begin()), std::make_move_iterator(source.end()));
+  EXPECT_EQ("one", moved.at<std::string>(key1));
+  EXPECT_EQ("two", moved.at<std::string>(key2));
+}
+
+TEST(AttributesTest, ReadsVectorsAsStdVectors) {
+  Attributes::key_type key("ATTRIBUTES_TEST_VECTOR");
+  aseq::util::HasAttributes has;
+  has.SetAttribute(key, std::vector<int>({1, 2}));
+  EXPECT_EQ(std::vector<int>({1, 2}), has.GetAttribute<std::vector<int> >(key));
+  EXPECT_EQ(Attributes::Integers({1, 2}), has.GetAttribute<Attributes::Integers>(key));
+  EXPECT_EQ(std::vector<int>({3}), has.GetAttributeOr<std::vector<int> >("MISSING", {3}));
+
+  const auto& attrs = has.attributes();
+  EXPECT_EQ(std::vector<int>({1, 2}), attrs.at<std::vector<int> >(key));
+}
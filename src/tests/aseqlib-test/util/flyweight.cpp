@@ -0,0 +1,64 @@
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <cppformat/format.h>
+
+#include "aseq/util/flyweight.hpp"
+
+using aseq::util::flyweight_string_no_track;
+using aseq::util::indexed_flyweight_string_no_track;
+
+namespace {
+struct test_tag {};
+struct indexed_test_tag {};
+}  // namespace
+
+TEST(FlyweightStringTest, InternsEqualStringsOnce) {
+  typedef flyweight_string_no_track<test_tag> String;
+
+  std::string value("value");
+  String a(value), b("value"), c(boost::make_iterator_range(value)), d("other");
+  EXPECT_EQ(&a.get(), &b.get());
+  EXPECT_EQ(&a.get(), &c.get());
+  EXPECT_EQ(a, c);
+  EXPECT_NE(a, d);
+  EXPECT_LT(d, a);
+  EXPECT_EQ("value", a.get());
+  EXPECT_TRUE(String().empty());
+  EXPECT_EQ(String(), String(""));
+}
+
+TEST(FlyweightStringTest, InternsConsistentlyAcrossThreads) {
+  typedef indexed_flyweight_string_no_track<indexed_test_tag> String;
+  const size_t kThreads = 8, kStrings = 2000;
+
+  // Every thread interns the same strings (in different orders)
+  std::vector<std::vector<String> > interned(kThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; t++) {
+    threads.emplace_back([&interned, t, kStrings] {
+      for (size_t i = 0; i < kStrings; i++) {
+        interned[t].emplace_back(fmt::format("string{}", (i * (t + 1)) % kStrings));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  std::set<uint32_t> indices;
+  for (size_t i = 0; i < kStrings; i++) {
+    String expected(fmt::format("string{}", i));
+    indices.insert(expected.index());
+    for (size_t t = 0; t < kThreads; t++) {
+      auto& s = interned[t][i];
+      EXPECT_EQ(String(s.get()), s);
+      EXPECT_EQ(String(s.get()).index(), s.index());
+    }
+  }
+
+  // Indices are dense, i.e. each distinct string has a unique index less than the number of strings
+  EXPECT_EQ(kStrings, indices.size());
+  EXPECT_LT(*indices.rbegin(), kStrings);
+}